@@ -0,0 +1,211 @@
+#pragma once
+
+#include <atomic>
+#include <mutex>
+#include <stdint.h>
+#include <string.h>
+#include <vulkan/vulkan.h>
+#include "ctk/ctk.h"
+#include "ctk/memory.h"
+#include "vtk/vtk.h"
+
+////////////////////////////////////////////////////////////
+/// Data
+////////////////////////////////////////////////////////////
+static u32 const VTK_HOST_ALLOCATION_SCOPE_COUNT = VK_SYSTEM_ALLOCATION_SCOPE_INSTANCE + 1;
+
+struct VTK_HostAllocationStats {
+    u64 bytes;
+    u64 peak_bytes;
+    u64 allocation_count;
+    u64 total_allocation_count;
+    u64 internal_bytes; // Driver-internal allocations reported through notifications; not made through vtk.
+};
+
+struct VTK_HostAllocationScope {
+    // CTK_Allocator isn't assumed to be thread-safe and drivers allocate from any thread, so calls into it are locked.
+    // Scopes sharing an allocator share its lock.
+    CTK_Allocator *allocator;
+    std::mutex *mutex;
+    std::atomic<u64> bytes;
+    std::atomic<u64> peak_bytes;
+    std::atomic<u64> allocation_count;
+    std::atomic<u64> total_allocation_count;
+    std::atomic<s64> internal_bytes;
+};
+
+// Routes driver host allocations into one CTK_Allocator per VkSystemAllocationScope (several scopes may share one).
+// Must not be copied or moved once its callbacks are in use.
+struct VTK_HostAllocator {
+    VTK_HostAllocationScope scopes[VTK_HOST_ALLOCATION_SCOPE_COUNT];
+    std::mutex mutexes[VTK_HOST_ALLOCATION_SCOPE_COUNT]; // One per distinct allocator, at its first scope's index.
+    VkAllocationCallbacks callbacks;
+};
+
+// Stored immediately before every pointer handed to the driver, so free/realloc can find the original block and scope.
+struct _VTK_HostAllocationHeader {
+    void *base;
+    u64 size;
+    u32 scope;
+    u32 alignment;
+};
+
+////////////////////////////////////////////////////////////
+/// Internal
+////////////////////////////////////////////////////////////
+static _VTK_HostAllocationHeader *_vtk_host_allocation_header(void *memory) {
+    return (_VTK_HostAllocationHeader *)memory - 1;
+}
+
+static void *VKAPI_CALL _vtk_host_allocate(void *user_data, size_t size, size_t alignment,
+                                           VkSystemAllocationScope allocation_scope) {
+    auto host_allocator = (VTK_HostAllocator *)user_data;
+    VTK_HostAllocationScope *scope = host_allocator->scopes + allocation_scope;
+    alignment = alignment < alignof(_VTK_HostAllocationHeader) ? alignof(_VTK_HostAllocationHeader) : alignment;
+
+    // CTK allocation counts are 32-bit; a larger block is reported to the driver as a failed allocation rather than
+    // truncated.
+    if (size > CTK_U32_MAX || alignment > CTK_U32_MAX ||
+        (u64)size + alignment + sizeof(_VTK_HostAllocationHeader) > CTK_U32_MAX) {
+        return NULL;
+    }
+
+    u8 *base = NULL;
+    {
+        std::lock_guard<std::mutex> lock(*scope->mutex);
+        base = ctk_alloc<u8>(scope->allocator, (u32)(size + alignment + sizeof(_VTK_HostAllocationHeader)));
+    }
+
+    if (base == NULL)
+        return NULL;
+
+    uintptr_t unaligned = (uintptr_t)(base + sizeof(_VTK_HostAllocationHeader));
+    void *memory = (void *)((unaligned + alignment - 1) & ~(uintptr_t)(alignment - 1));
+    _VTK_HostAllocationHeader *header = _vtk_host_allocation_header(memory);
+    header->base = base;
+    header->size = size;
+    header->scope = (u32)allocation_scope;
+    header->alignment = (u32)alignment;
+
+    u64 bytes = scope->bytes.fetch_add(size, std::memory_order_relaxed) + size;
+    u64 peak_bytes = scope->peak_bytes.load(std::memory_order_relaxed);
+    while (bytes > peak_bytes && !scope->peak_bytes.compare_exchange_weak(peak_bytes, bytes, std::memory_order_relaxed));
+    scope->allocation_count.fetch_add(1, std::memory_order_relaxed);
+    scope->total_allocation_count.fetch_add(1, std::memory_order_relaxed);
+    return memory;
+}
+
+static void VKAPI_CALL _vtk_host_free(void *user_data, void *memory) {
+    if (memory == NULL)
+        return;
+
+    auto host_allocator = (VTK_HostAllocator *)user_data;
+    _VTK_HostAllocationHeader *header = _vtk_host_allocation_header(memory);
+    VTK_HostAllocationScope *scope = host_allocator->scopes + header->scope;
+    scope->bytes.fetch_sub(header->size, std::memory_order_relaxed);
+    scope->allocation_count.fetch_sub(1, std::memory_order_relaxed);
+
+    std::lock_guard<std::mutex> lock(*scope->mutex);
+    ctk_free(scope->allocator, header->base);
+}
+
+static void *VKAPI_CALL _vtk_host_reallocate(void *user_data, void *original, size_t size, size_t alignment,
+                                             VkSystemAllocationScope allocation_scope) {
+    if (original == NULL)
+        return _vtk_host_allocate(user_data, size, alignment, allocation_scope);
+
+    if (size == 0) {
+        _vtk_host_free(user_data, original);
+        return NULL;
+    }
+
+    // CTK allocators have no in-place grow, so this is always allocate + copy + free.
+    void *memory = _vtk_host_allocate(user_data, size, alignment, allocation_scope);
+    if (memory == NULL)
+        return NULL; // Original must stay valid on failure.
+
+    u64 original_size = _vtk_host_allocation_header(original)->size;
+    memcpy(memory, original, original_size < size ? original_size : size);
+    _vtk_host_free(user_data, original);
+    return memory;
+}
+
+static void VKAPI_CALL _vtk_host_internal_allocation(void *user_data, size_t size, VkInternalAllocationType,
+                                                     VkSystemAllocationScope allocation_scope) {
+    auto host_allocator = (VTK_HostAllocator *)user_data;
+    host_allocator->scopes[allocation_scope].internal_bytes.fetch_add((s64)size, std::memory_order_relaxed);
+}
+
+static void VKAPI_CALL _vtk_host_internal_free(void *user_data, size_t size, VkInternalAllocationType,
+                                               VkSystemAllocationScope allocation_scope) {
+    auto host_allocator = (VTK_HostAllocator *)user_data;
+    host_allocator->scopes[allocation_scope].internal_bytes.fetch_sub((s64)size, std::memory_order_relaxed);
+}
+
+static cstr _vtk_host_allocation_scope_name(u32 allocation_scope) {
+    static cstr const NAMES[] = { "command", "object", "cache", "device", "instance" };
+    return NAMES[allocation_scope];
+}
+
+////////////////////////////////////////////////////////////
+/// Interface
+////////////////////////////////////////////////////////////
+
+// allocators is indexed by VkSystemAllocationScope; every entry must be set. Short-lived command scope allocations
+// benefit most from a separate allocator, since they otherwise churn alongside long-lived object/device allocations.
+static void vtk_init_host_allocator(VTK_HostAllocator *host_allocator,
+                                    CTK_Allocator *allocators[VTK_HOST_ALLOCATION_SCOPE_COUNT]) {
+    for (u32 i = 0; i < VTK_HOST_ALLOCATION_SCOPE_COUNT; ++i) {
+        CTK_ASSERT(allocators[i] != NULL);
+        VTK_HostAllocationScope *scope = host_allocator->scopes + i;
+        scope->allocator = allocators[i];
+        u32 first_sharing_scope = 0;
+        while (allocators[first_sharing_scope] != allocators[i])
+            ++first_sharing_scope;
+
+        scope->mutex = host_allocator->mutexes + first_sharing_scope;
+        scope->bytes = 0;
+        scope->peak_bytes = 0;
+        scope->allocation_count = 0;
+        scope->total_allocation_count = 0;
+        scope->internal_bytes = 0;
+    }
+
+    host_allocator->callbacks = {};
+    host_allocator->callbacks.pUserData = host_allocator;
+    host_allocator->callbacks.pfnAllocation = _vtk_host_allocate;
+    host_allocator->callbacks.pfnReallocation = _vtk_host_reallocate;
+    host_allocator->callbacks.pfnFree = _vtk_host_free;
+    host_allocator->callbacks.pfnInternalAllocation = _vtk_host_internal_allocation;
+    host_allocator->callbacks.pfnInternalFree = _vtk_host_internal_free;
+}
+
+// Makes every vtk object creation/destruction use host_allocator. Install before creating the instance and leave it
+// installed until after it's destroyed; Vulkan requires objects to be freed with compatible callbacks.
+static void vtk_install_host_allocator(VTK_HostAllocator *host_allocator) {
+    vtk_set_allocation_callbacks(&host_allocator->callbacks);
+}
+
+static VTK_HostAllocationStats vtk_host_allocation_stats(VTK_HostAllocator *host_allocator,
+                                                         VkSystemAllocationScope allocation_scope) {
+    VTK_HostAllocationScope *scope = host_allocator->scopes + allocation_scope;
+    VTK_HostAllocationStats stats = {};
+    stats.bytes = scope->bytes.load(std::memory_order_relaxed);
+    stats.peak_bytes = scope->peak_bytes.load(std::memory_order_relaxed);
+    stats.allocation_count = scope->allocation_count.load(std::memory_order_relaxed);
+    stats.total_allocation_count = scope->total_allocation_count.load(std::memory_order_relaxed);
+    s64 internal_bytes = scope->internal_bytes.load(std::memory_order_relaxed);
+    stats.internal_bytes = internal_bytes > 0 ? (u64)internal_bytes : 0;
+    return stats;
+}
+
+static void vtk_log_host_allocation_stats(VTK_HostAllocator *host_allocator) {
+    ctk_info("vulkan host allocations:     bytes        peak   live  total allocs    internal");
+    for (u32 i = 0; i < VTK_HOST_ALLOCATION_SCOPE_COUNT; ++i) {
+        VTK_HostAllocationStats stats = vtk_host_allocation_stats(host_allocator, (VkSystemAllocationScope)i);
+        ctk_info("    %-20s %11llu %11llu %6llu %13llu %11llu", _vtk_host_allocation_scope_name(i),
+                 (unsigned long long)stats.bytes, (unsigned long long)stats.peak_bytes,
+                 (unsigned long long)stats.allocation_count, (unsigned long long)stats.total_allocation_count,
+                 (unsigned long long)stats.internal_bytes);
+    }
+}
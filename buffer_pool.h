@@ -0,0 +1,223 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include "ctk/ctk.h"
+#include "vtk/vtk.h"
+#include "vtk/device_memory.h"
+#include "vtk/memory_types.h"
+
+////////////////////////////////////////////////////////////
+/// Data
+////////////////////////////////////////////////////////////
+static u32 const VTK_BUFFER_POOL_MAX_ENTRIES = 1024;
+static u32 const VTK_BUFFER_POOL_MIN_SIZE_CLASS = 8; // 256 bytes.
+static u32 const VTK_NULL_POOLED_BUFFER = CTK_U32_MAX;
+
+enum {
+    _VTK_POOLED_BUFFER_EMPTY, // Slot without a buffer; reused before the entry count grows.
+    _VTK_POOLED_BUFFER_FREE,
+    _VTK_POOLED_BUFFER_IN_USE,
+    _VTK_POOLED_BUFFER_RETIRING, // Released; waiting on its fence or frame before it can be reused.
+};
+
+struct _VTK_BufferPoolEntry {
+    VkBufferUsageFlags usage;
+    s32 intent;
+    u32 size_class;
+    u32 allocation;
+    s32 state;
+    VkFence fence;
+    u64 retire_frame;
+    u64 last_used_frame;
+};
+
+struct VTK_PooledBuffer {
+    u32 entry;
+    VkBuffer buffer;
+    VkDeviceSize size; // Size-class size; at least the requested size.
+    u8 *mapped;        // NULL unless the selected memory type is host-visible.
+};
+
+struct VTK_BufferPoolStats {
+    u64 requests;
+    u64 hits;
+    u64 buffers_created;
+    u64 buffers_trimmed;
+    u32 live_buffers;
+    VkDeviceSize live_bytes;
+};
+
+// Recycles short-lived buffers (staging, readback, compute scratch) keyed by usage, memory intent and power-of-two size
+// class, so transient use doesn't pay for vkCreateBuffer, memory allocation and binding every time.
+struct VTK_BufferPool {
+    VTK_DeviceMemoryAllocator *allocator;
+    VTK_MemoryTypeSelector *selector;
+
+    // Entry indexes are handed out in VTK_PooledBuffer, so entries never move.
+    _VTK_BufferPoolEntry entries[VTK_BUFFER_POOL_MAX_ENTRIES];
+    u32 entry_count;
+    u64 frame;
+    u32 frames_in_flight;
+
+    // Free buffers not reused for this many frames are destroyed by vtk_update_buffer_pool().
+    u32 idle_frames;
+
+    VTK_BufferPoolStats stats;
+};
+
+////////////////////////////////////////////////////////////
+/// Internal
+////////////////////////////////////////////////////////////
+static u32 _vtk_buffer_size_class(VkDeviceSize size) {
+    u32 size_class = VTK_BUFFER_POOL_MIN_SIZE_CLASS;
+    while (((VkDeviceSize)1 << size_class) < size)
+        ++size_class;
+
+    return size_class;
+}
+
+static VTK_PooledBuffer _vtk_pooled_buffer(VTK_BufferPool *pool, u32 entry_index) {
+    _VTK_BufferPoolEntry *entry = pool->entries + entry_index;
+    VTK_DeviceAllocation *allocation = vtk_device_allocation(pool->allocator, entry->allocation);
+    VTK_PooledBuffer pooled_buffer = {};
+    pooled_buffer.entry = entry_index;
+    pooled_buffer.buffer = allocation->buffer;
+    pooled_buffer.size = (VkDeviceSize)1 << entry->size_class;
+    pooled_buffer.mapped = allocation->mapped;
+    return pooled_buffer;
+}
+
+static void _vtk_destroy_pooled_buffer(VTK_BufferPool *pool, u32 entry_index) {
+    _VTK_BufferPoolEntry *entry = pool->entries + entry_index;
+    vtk_free_device_region(pool->allocator, entry->allocation);
+    --pool->stats.live_buffers;
+    pool->stats.live_bytes -= (VkDeviceSize)1 << entry->size_class;
+    *entry = {};
+}
+
+////////////////////////////////////////////////////////////
+/// Interface
+////////////////////////////////////////////////////////////
+static void vtk_init_buffer_pool(VTK_BufferPool *pool, VTK_DeviceMemoryAllocator *allocator,
+                                 VTK_MemoryTypeSelector *selector, u32 frames_in_flight, u32 idle_frames) {
+    pool->allocator = allocator;
+    pool->selector = selector;
+    pool->entry_count = 0;
+    pool->frame = 0;
+    pool->frames_in_flight = frames_in_flight;
+    pool->idle_frames = idle_frames;
+    pool->stats = {};
+}
+
+// The device must be idle.
+static void vtk_destroy_buffer_pool(VTK_BufferPool *pool) {
+    for (u32 i = 0; i < pool->entry_count; ++i) {
+        if (pool->entries[i].state != _VTK_POOLED_BUFFER_EMPTY)
+            _vtk_destroy_pooled_buffer(pool, i);
+    }
+
+    pool->entry_count = 0;
+}
+
+// Returns a buffer of at least size bytes, reusing a free one of the same usage, intent and size class if there is one.
+// Contents are undefined. buffer is VK_NULL_HANDLE (and entry VTK_NULL_POOLED_BUFFER) if device memory is exhausted.
+static VTK_PooledBuffer vtk_acquire_pooled_buffer(VTK_BufferPool *pool, VkBufferUsageFlags usage, s32 intent,
+                                                  VkDeviceSize size, cstr debug_name = NULL) {
+    u32 size_class = _vtk_buffer_size_class(size);
+    ++pool->stats.requests;
+    for (u32 i = 0; i < pool->entry_count; ++i) {
+        _VTK_BufferPoolEntry *entry = pool->entries + i;
+        if (entry->state == _VTK_POOLED_BUFFER_FREE && entry->usage == usage && entry->intent == intent &&
+            entry->size_class == size_class) {
+            entry->state = _VTK_POOLED_BUFFER_IN_USE;
+            entry->last_used_frame = pool->frame;
+            ++pool->stats.hits;
+            return _vtk_pooled_buffer(pool, i);
+        }
+    }
+
+    u32 entry_index = 0;
+    while (entry_index < pool->entry_count && pool->entries[entry_index].state != _VTK_POOLED_BUFFER_EMPTY)
+        ++entry_index;
+
+    VTK_PooledBuffer none = {};
+    none.entry = VTK_NULL_POOLED_BUFFER;
+    if (entry_index == VTK_BUFFER_POOL_MAX_ENTRIES) {
+        ctk_warning("buffer pool full (%u buffers)", VTK_BUFFER_POOL_MAX_ENTRIES);
+        return none;
+    }
+
+    VkBufferCreateInfo info = {};
+    info.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+    info.size = (VkDeviceSize)1 << size_class;
+    info.usage = usage;
+    info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    u32 allocation = vtk_create_allocated_buffer(pool->allocator, pool->selector, &info, intent, false, debug_name);
+    if (allocation == VTK_NULL_ALLOCATION)
+        return none;
+
+    if (entry_index == pool->entry_count)
+        ++pool->entry_count;
+
+    _VTK_BufferPoolEntry *entry = pool->entries + entry_index;
+    *entry = {};
+    entry->usage = usage;
+    entry->intent = intent;
+    entry->size_class = size_class;
+    entry->allocation = allocation;
+    entry->state = _VTK_POOLED_BUFFER_IN_USE;
+    entry->last_used_frame = pool->frame;
+    ++pool->stats.buffers_created;
+    ++pool->stats.live_buffers;
+    pool->stats.live_bytes += info.size;
+    return _vtk_pooled_buffer(pool, entry_index);
+}
+
+// Hands the buffer back once its last use has completed: when fence is signaled, or frames_in_flight frames from now if
+// fence is VK_NULL_HANDLE. A fence must not be reset before vtk_update_buffer_pool() has seen it signaled, so per-frame
+// fences that are reset every frame should use the frame-based form instead.
+static void vtk_release_pooled_buffer(VTK_BufferPool *pool, VTK_PooledBuffer *pooled_buffer,
+                                      VkFence fence = VK_NULL_HANDLE) {
+    _VTK_BufferPoolEntry *entry = pool->entries + pooled_buffer->entry;
+    CTK_ASSERT(entry->state == _VTK_POOLED_BUFFER_IN_USE);
+    entry->state = _VTK_POOLED_BUFFER_RETIRING;
+    entry->fence = fence;
+    entry->retire_frame = pool->frame + pool->frames_in_flight;
+    *pooled_buffer = {};
+    pooled_buffer->entry = VTK_NULL_POOLED_BUFFER;
+}
+
+// Call once per frame. Returns retired buffers to the free list and destroys free buffers idle for more than
+// idle_frames frames.
+static void vtk_update_buffer_pool(VTK_BufferPool *pool) {
+    ++pool->frame;
+    for (u32 i = 0; i < pool->entry_count; ++i) {
+        _VTK_BufferPoolEntry *entry = pool->entries + i;
+        if (entry->state == _VTK_POOLED_BUFFER_RETIRING) {
+            bool retired = entry->fence != VK_NULL_HANDLE
+                           ? vkGetFenceStatus(pool->allocator->logical_device, entry->fence) == VK_SUCCESS
+                           : pool->frame >= entry->retire_frame;
+            if (retired) {
+                entry->state = _VTK_POOLED_BUFFER_FREE;
+                entry->fence = VK_NULL_HANDLE;
+                entry->last_used_frame = pool->frame;
+            }
+        }
+        else if (entry->state == _VTK_POOLED_BUFFER_FREE && pool->frame - entry->last_used_frame > pool->idle_frames) {
+            _vtk_destroy_pooled_buffer(pool, i);
+            ++pool->stats.buffers_trimmed;
+        }
+    }
+}
+
+static f64 vtk_buffer_pool_hit_rate(VTK_BufferPool *pool) {
+    return pool->stats.requests > 0 ? (f64)pool->stats.hits / (f64)pool->stats.requests : 0.0;
+}
+
+static void vtk_log_buffer_pool_stats(VTK_BufferPool *pool) {
+    VTK_BufferPoolStats *stats = &pool->stats;
+    ctk_info("buffer pool: %llu requests, %.1f%% hits, %llu created, %llu trimmed, %u live (%llu KiB)",
+             (unsigned long long)stats->requests, vtk_buffer_pool_hit_rate(pool) * 100.0,
+             (unsigned long long)stats->buffers_created, (unsigned long long)stats->buffers_trimmed,
+             stats->live_buffers, (unsigned long long)(stats->live_bytes >> 10));
+}
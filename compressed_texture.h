@@ -0,0 +1,672 @@
+#pragma once
+
+#include <string.h>
+#include <vulkan/vulkan.h>
+#include "ctk/ctk.h"
+#include "vtk/vtk.h"
+#include "vtk/device.h"
+#include "vtk/device_memory.h"
+#include "vtk/memory_types.h"
+#include "vtk/host_memory.h"
+#include "vtk/texture.h"
+#include "vtk/debug_utils.h"
+
+#ifdef _WIN32
+    #ifndef WIN32_LEAN_AND_MEAN
+        #define WIN32_LEAN_AND_MEAN
+    #endif
+    #include <windows.h>
+#else
+    #include <fcntl.h>
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+    #include <unistd.h>
+#endif
+
+////////////////////////////////////////////////////////////
+/// Data
+////////////////////////////////////////////////////////////
+static u32 const VTK_COMPRESSED_TEXTURE_MAX_REGIONS = 512;
+
+// Container headers are rejected beyond these, before any sizes are derived from them.
+static u32 const VTK_COMPRESSED_TEXTURE_MAX_EXTENT = 16384;
+static u32 const VTK_COMPRESSED_TEXTURE_MAX_LAYERS = 2048;
+
+// Block-compression families, in order of preference when more than one is supported.
+enum {
+    VTK_TEXTURE_COMPRESSION_BC,
+    VTK_TEXTURE_COMPRESSION_ASTC,
+    VTK_TEXTURE_COMPRESSION_ETC2,
+    VTK_TEXTURE_COMPRESSION_COUNT,
+    VTK_TEXTURE_COMPRESSION_NONE = VTK_TEXTURE_COMPRESSION_COUNT,
+};
+
+static cstr const _VTK_TEXTURE_COMPRESSION_NAMES[] = {
+    "BC",
+    "ASTC",
+    "ETC2",
+};
+
+struct _VTK_MappedFile {
+    u8 *data;
+    u64 size;
+#ifdef _WIN32
+    HANDLE file;
+    HANDLE mapping;
+#endif
+};
+
+// Block layout of a compressed format: block_width x block_height texels in block_size bytes.
+struct _VTK_BlockFormat {
+    s32 compression;
+    u32 block_size;
+    u32 block_width;
+    u32 block_height;
+};
+
+// Where a container's mips and layers live, relative to the start of the file.
+struct _VTK_CompressedTextureLayout {
+    VkFormat format;
+    VkExtent3D extent;
+    u32 mip_levels;
+    u32 layer_count;
+    bool cube;
+    u64 data_offset; // Start of the image data; region offsets are relative to it.
+    u64 data_size;
+    CTK_StaticArray<VkBufferImageCopy, VTK_COMPRESSED_TEXTURE_MAX_REGIONS> regions;
+};
+
+struct VTK_CompressedTextureStats {
+    u64 textures_loaded;
+    u64 textures_failed;
+    u64 bytes_uploaded;
+    u64 bytes_imported; // Uploaded straight from the file mapping, with no CPU copy.
+    u64 load_ns;
+};
+
+// Loads pre-compressed KTX2 and DDS containers: the file is memory-mapped, imported as a transfer source through
+// VK_EXT_external_memory_host when possible, and every mip and layer goes to the GPU in one vkCmdCopyBufferToImage.
+// Nothing is decoded on the CPU, and textures stay block-compressed in VRAM. Loads are synchronous.
+struct VTK_CompressedTextureLoader {
+    VkPhysicalDevice physical_device;
+    VkDevice logical_device;
+    VkQueue queue;
+    VkCommandPool command_pool;
+    VkCommandBuffer command_buffer;
+    VTK_DeviceDispatch *dispatch; // Upload commands are recorded through the device's dispatch table.
+    VTK_DeviceMemoryAllocator *allocator;
+    VTK_MemoryTypeSelector *selector;
+    VTK_HostMemoryImporter *importer; // Optional; file data is copied into upload memory without one.
+
+    // Families the device has enabled, best first.
+    CTK_StaticArray<s32, VTK_TEXTURE_COMPRESSION_COUNT> compressions;
+
+    VTK_CompressedTextureStats stats;
+};
+
+////////////////////////////////////////////////////////////
+/// Internal
+////////////////////////////////////////////////////////////
+
+// Mapped copy-on-write: pages stay backed by the file, but are writable as far as the host-pointer import is concerned.
+static bool _vtk_map_file(cstr path, _VTK_MappedFile *mapped_file) {
+    *mapped_file = {};
+#ifdef _WIN32
+    mapped_file->file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING,
+                                    FILE_ATTRIBUTE_NORMAL, NULL);
+    if (mapped_file->file == INVALID_HANDLE_VALUE)
+        return false;
+
+    LARGE_INTEGER file_size = {};
+    GetFileSizeEx(mapped_file->file, &file_size);
+    mapped_file->size = (u64)file_size.QuadPart;
+    mapped_file->mapping = mapped_file->size > 0
+                           ? CreateFileMappingA(mapped_file->file, NULL, PAGE_WRITECOPY, 0, 0, NULL)
+                           : NULL;
+    if (mapped_file->mapping != NULL)
+        mapped_file->data = (u8 *)MapViewOfFile(mapped_file->mapping, FILE_MAP_COPY, 0, 0, 0);
+
+    if (mapped_file->data == NULL) {
+        if (mapped_file->mapping != NULL)
+            CloseHandle(mapped_file->mapping);
+
+        CloseHandle(mapped_file->file);
+        return false;
+    }
+#else
+    s32 file = open(path, O_RDONLY);
+    if (file < 0)
+        return false;
+
+    struct stat file_stat = {};
+    if (fstat(file, &file_stat) != 0 || file_stat.st_size == 0) {
+        close(file);
+        return false;
+    }
+
+    mapped_file->size = (u64)file_stat.st_size;
+    void *data = mmap(NULL, mapped_file->size, PROT_READ | PROT_WRITE, MAP_PRIVATE, file, 0);
+    close(file);
+    if (data == MAP_FAILED)
+        return false;
+
+    mapped_file->data = (u8 *)data;
+#endif
+    return true;
+}
+
+static void _vtk_unmap_file(_VTK_MappedFile *mapped_file) {
+#ifdef _WIN32
+    UnmapViewOfFile(mapped_file->data);
+    CloseHandle(mapped_file->mapping);
+    CloseHandle(mapped_file->file);
+#else
+    munmap(mapped_file->data, mapped_file->size);
+#endif
+    *mapped_file = {};
+}
+
+static _VTK_BlockFormat _vtk_block_format(VkFormat format) {
+    static u8 const ASTC_BLOCK_DIMENSIONS[][2] = {
+        { 4, 4 }, { 5, 4 }, { 5, 5 }, { 6, 5 }, { 6, 6 }, { 8, 5 }, { 8, 6 },
+        { 8, 8 }, { 10, 5 }, { 10, 6 }, { 10, 8 }, { 10, 10 }, { 12, 10 }, { 12, 12 },
+    };
+
+    _VTK_BlockFormat block_format = {};
+    block_format.compression = VTK_TEXTURE_COMPRESSION_NONE;
+    if (format >= VK_FORMAT_BC1_RGB_UNORM_BLOCK && format <= VK_FORMAT_BC7_SRGB_BLOCK) {
+        bool half_block = format <= VK_FORMAT_BC1_RGBA_SRGB_BLOCK || format == VK_FORMAT_BC4_UNORM_BLOCK ||
+                          format == VK_FORMAT_BC4_SNORM_BLOCK;
+        block_format = { VTK_TEXTURE_COMPRESSION_BC, half_block ? 8u : 16u, 4, 4 };
+    }
+    else if (format >= VK_FORMAT_ETC2_R8G8B8_UNORM_BLOCK && format <= VK_FORMAT_EAC_R11G11_SNORM_BLOCK) {
+        bool full_block = format == VK_FORMAT_ETC2_R8G8B8A8_UNORM_BLOCK ||
+                          format == VK_FORMAT_ETC2_R8G8B8A8_SRGB_BLOCK || format >= VK_FORMAT_EAC_R11G11_UNORM_BLOCK;
+        block_format = { VTK_TEXTURE_COMPRESSION_ETC2, full_block ? 16u : 8u, 4, 4 };
+    }
+    else if (format >= VK_FORMAT_ASTC_4x4_UNORM_BLOCK && format <= VK_FORMAT_ASTC_12x12_SRGB_BLOCK) {
+        u8 const *dimensions = ASTC_BLOCK_DIMENSIONS[(format - VK_FORMAT_ASTC_4x4_UNORM_BLOCK) / 2];
+        block_format = { VTK_TEXTURE_COMPRESSION_ASTC, 16, dimensions[0], dimensions[1] };
+    }
+
+    return block_format;
+}
+
+static u64 _vtk_compressed_image_size(_VTK_BlockFormat *block_format, VkExtent3D extent, u32 mip_level) {
+    u32 width = extent.width >> mip_level > 0 ? extent.width >> mip_level : 1;
+    u32 height = extent.height >> mip_level > 0 ? extent.height >> mip_level : 1;
+    u64 blocks_x = (width + block_format->block_width - 1) / block_format->block_width;
+    u64 blocks_y = (height + block_format->block_height - 1) / block_format->block_height;
+    return blocks_x * blocks_y * block_format->block_size;
+}
+
+static void _vtk_push_compressed_region(_VTK_CompressedTextureLayout *layout, u64 offset, u32 mip_level,
+                                        u32 base_layer, u32 layer_count) {
+    VkBufferImageCopy region = {};
+    region.bufferOffset = offset;
+    region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    region.imageSubresource.mipLevel = mip_level;
+    region.imageSubresource.baseArrayLayer = base_layer;
+    region.imageSubresource.layerCount = layer_count;
+    region.imageExtent.width = layout->extent.width >> mip_level > 0 ? layout->extent.width >> mip_level : 1;
+    region.imageExtent.height = layout->extent.height >> mip_level > 0 ? layout->extent.height >> mip_level : 1;
+    region.imageExtent.depth = 1;
+    ctk_push(&layout->regions, region);
+}
+
+// Header fields are untrusted: the extent and layer count must be bounded before image sizes are derived from them, and
+// a level count beyond the full mip chain would make later levels 1x1 duplicates the image can't hold.
+static bool _vtk_compressed_layout_valid(_VTK_CompressedTextureLayout *layout, cstr path) {
+    if (layout->extent.width == 0 || layout->extent.width > VTK_COMPRESSED_TEXTURE_MAX_EXTENT ||
+        layout->extent.height == 0 || layout->extent.height > VTK_COMPRESSED_TEXTURE_MAX_EXTENT) {
+        ctk_warning("compressed texture \"%s\" has invalid extent %ux%u", path, layout->extent.width,
+                    layout->extent.height);
+        return false;
+    }
+
+    if (layout->mip_levels > vtk_mip_level_count(layout->extent)) {
+        ctk_warning("compressed texture \"%s\" has %u mip levels, more than its extent allows", path,
+                    layout->mip_levels);
+        return false;
+    }
+
+    return true;
+}
+
+// KTX2 stores each level's layers and faces contiguously, so a level is one region covering every layer.
+static bool _vtk_parse_ktx2(_VTK_MappedFile *file, _VTK_CompressedTextureLayout *layout, cstr path) {
+    static u8 const KTX2_IDENTIFIER[12] = { 0xAB, 'K', 'T', 'X', ' ', '2', '0', 0xBB, '\r', '\n', 0x1A, '\n' };
+    struct Header {
+        u8 identifier[12];
+        u32 vk_format;
+        u32 type_size;
+        u32 pixel_width;
+        u32 pixel_height;
+        u32 pixel_depth;
+        u32 layer_count;
+        u32 face_count;
+        u32 level_count;
+        u32 supercompression_scheme;
+        u32 dfd_byte_offset;
+        u32 dfd_byte_length;
+        u32 kvd_byte_offset;
+        u32 kvd_byte_length;
+        u64 sgd_byte_offset;
+        u64 sgd_byte_length;
+    };
+    struct LevelIndex {
+        u64 byte_offset;
+        u64 byte_length;
+        u64 uncompressed_byte_length;
+    };
+
+    if (file->size < sizeof(Header) || memcmp(file->data, KTX2_IDENTIFIER, sizeof(KTX2_IDENTIFIER)) != 0)
+        return false;
+
+    Header header = {};
+    memcpy(&header, file->data, sizeof(Header));
+    if (header.supercompression_scheme != 0 || header.pixel_height == 0 || header.pixel_depth > 1) {
+        ctk_warning("KTX2 texture \"%s\" is supercompressed, 1D or 3D, which isn't supported", path);
+        return false;
+    }
+
+    if ((header.face_count != 1 && header.face_count != 6) ||
+        header.layer_count > VTK_COMPRESSED_TEXTURE_MAX_LAYERS / header.face_count) {
+        ctk_warning("KTX2 texture \"%s\" has invalid face count %u or layer count %u", path, header.face_count,
+                    header.layer_count);
+        return false;
+    }
+
+    layout->format = (VkFormat)header.vk_format;
+    layout->extent = { header.pixel_width, header.pixel_height, 1 };
+    layout->mip_levels = header.level_count > 0 ? header.level_count : 1;
+    layout->cube = header.face_count == 6;
+    layout->layer_count = (header.layer_count > 0 ? header.layer_count : 1) * header.face_count;
+    if (!_vtk_compressed_layout_valid(layout, path))
+        return false;
+
+    _VTK_BlockFormat block_format = _vtk_block_format(layout->format);
+    if (block_format.compression == VTK_TEXTURE_COMPRESSION_NONE) {
+        ctk_warning("KTX2 texture \"%s\" has format %u, which isn't block-compressed", path, header.vk_format);
+        return false;
+    }
+
+    u64 level_index_end = sizeof(Header) + (u64)layout->mip_levels * sizeof(LevelIndex);
+    if (layout->mip_levels > VTK_COMPRESSED_TEXTURE_MAX_REGIONS || level_index_end > file->size)
+        return false;
+
+    // Levels are stored smallest first, so the data starts at the last level's offset.
+    LevelIndex levels[VTK_COMPRESSED_TEXTURE_MAX_REGIONS];
+    memcpy(levels, file->data + sizeof(Header), (u64)layout->mip_levels * sizeof(LevelIndex));
+    layout->data_offset = file->size;
+    for (u32 level = 0; level < layout->mip_levels; ++level) {
+        u64 expected_size = _vtk_compressed_image_size(&block_format, layout->extent, level) * layout->layer_count;
+        if (levels[level].byte_length != expected_size || levels[level].byte_offset > file->size ||
+            expected_size > file->size - levels[level].byte_offset) {
+            return false;
+        }
+
+        layout->data_offset = levels[level].byte_offset < layout->data_offset ? levels[level].byte_offset
+                                                                              : layout->data_offset;
+    }
+
+    layout->data_size = file->size - layout->data_offset;
+    for (u32 level = 0; level < layout->mip_levels; ++level)
+        _vtk_push_compressed_region(layout, levels[level].byte_offset - layout->data_offset, level, 0,
+                                    layout->layer_count);
+
+    return true;
+}
+
+static VkFormat _vtk_dds_dxgi_format(u32 dxgi_format) {
+    switch (dxgi_format) {
+        case 71: return VK_FORMAT_BC1_RGBA_UNORM_BLOCK;
+        case 72: return VK_FORMAT_BC1_RGBA_SRGB_BLOCK;
+        case 74: return VK_FORMAT_BC2_UNORM_BLOCK;
+        case 75: return VK_FORMAT_BC2_SRGB_BLOCK;
+        case 77: return VK_FORMAT_BC3_UNORM_BLOCK;
+        case 78: return VK_FORMAT_BC3_SRGB_BLOCK;
+        case 80: return VK_FORMAT_BC4_UNORM_BLOCK;
+        case 81: return VK_FORMAT_BC4_SNORM_BLOCK;
+        case 83: return VK_FORMAT_BC5_UNORM_BLOCK;
+        case 84: return VK_FORMAT_BC5_SNORM_BLOCK;
+        case 95: return VK_FORMAT_BC6H_UFLOAT_BLOCK;
+        case 96: return VK_FORMAT_BC6H_SFLOAT_BLOCK;
+        case 98: return VK_FORMAT_BC7_UNORM_BLOCK;
+        case 99: return VK_FORMAT_BC7_SRGB_BLOCK;
+        default: return VK_FORMAT_UNDEFINED;
+    }
+}
+
+// Legacy FourCC codes carry no color space; srgb picks it for the color formats.
+static VkFormat _vtk_dds_four_cc_format(u32 four_cc, bool srgb) {
+    auto code = [](char const (&name)[5]) {
+        return (u32)(u8)name[0] | (u32)(u8)name[1] << 8 | (u32)(u8)name[2] << 16 | (u32)(u8)name[3] << 24;
+    };
+
+    if (four_cc == code("DXT1"))
+        return srgb ? VK_FORMAT_BC1_RGBA_SRGB_BLOCK : VK_FORMAT_BC1_RGBA_UNORM_BLOCK;
+    if (four_cc == code("DXT2") || four_cc == code("DXT3"))
+        return srgb ? VK_FORMAT_BC2_SRGB_BLOCK : VK_FORMAT_BC2_UNORM_BLOCK;
+    if (four_cc == code("DXT4") || four_cc == code("DXT5"))
+        return srgb ? VK_FORMAT_BC3_SRGB_BLOCK : VK_FORMAT_BC3_UNORM_BLOCK;
+    if (four_cc == code("ATI1") || four_cc == code("BC4U"))
+        return VK_FORMAT_BC4_UNORM_BLOCK;
+    if (four_cc == code("ATI2") || four_cc == code("BC5U"))
+        return VK_FORMAT_BC5_UNORM_BLOCK;
+
+    return VK_FORMAT_UNDEFINED;
+}
+
+// DDS stores each layer's full mip chain before the next layer's, so every (layer, mip) pair is its own region.
+static bool _vtk_parse_dds(_VTK_MappedFile *file, _VTK_CompressedTextureLayout *layout, bool srgb, cstr path) {
+    static u32 const DDS_MAGIC = 0x20534444; // "DDS "
+    static u32 const DDSD_MIPMAPCOUNT = 0x20000;
+    static u32 const DDSCAPS2_CUBEMAP = 0x200;
+    static u32 const DDSCAPS2_VOLUME = 0x200000;
+    static u32 const DDS_RESOURCE_MISC_TEXTURECUBE = 0x4;
+    static u32 const DDS_DIMENSION_TEXTURE2D = 3;
+    struct Header {
+        u32 magic;
+        u32 size;
+        u32 flags;
+        u32 height;
+        u32 width;
+        u32 pitch_or_linear_size;
+        u32 depth;
+        u32 mip_map_count;
+        u32 reserved1[11];
+        u32 pixel_format_size;
+        u32 pixel_format_flags;
+        u32 four_cc;
+        u32 rgb_bit_count;
+        u32 bit_masks[4];
+        u32 caps;
+        u32 caps2;
+        u32 caps3;
+        u32 caps4;
+        u32 reserved2;
+    };
+    struct HeaderDX10 {
+        u32 dxgi_format;
+        u32 resource_dimension;
+        u32 misc_flag;
+        u32 array_size;
+        u32 misc_flags2;
+    };
+
+    Header header = {};
+    if (file->size < sizeof(Header))
+        return false;
+
+    memcpy(&header, file->data, sizeof(Header));
+    if (header.magic != DDS_MAGIC)
+        return false;
+
+    layout->extent = { header.width, header.height, 1 };
+    layout->mip_levels = header.flags & DDSD_MIPMAPCOUNT && header.mip_map_count > 0 ? header.mip_map_count : 1;
+    layout->data_offset = sizeof(Header);
+    bool dx10 = header.four_cc == 0x30315844; // "DX10"
+    if (dx10) {
+        HeaderDX10 header_dx10 = {};
+        if (file->size < sizeof(Header) + sizeof(HeaderDX10))
+            return false;
+
+        memcpy(&header_dx10, file->data + sizeof(Header), sizeof(HeaderDX10));
+        if (header_dx10.resource_dimension != DDS_DIMENSION_TEXTURE2D) {
+            ctk_warning("DDS texture \"%s\" isn't 2D, which isn't supported", path);
+            return false;
+        }
+
+        if (header_dx10.array_size > VTK_COMPRESSED_TEXTURE_MAX_LAYERS / 6) {
+            ctk_warning("DDS texture \"%s\" has invalid array size %u", path, header_dx10.array_size);
+            return false;
+        }
+
+        layout->format = _vtk_dds_dxgi_format(header_dx10.dxgi_format);
+        layout->cube = header_dx10.misc_flag & DDS_RESOURCE_MISC_TEXTURECUBE;
+        layout->layer_count = (header_dx10.array_size > 0 ? header_dx10.array_size : 1) * (layout->cube ? 6 : 1);
+        layout->data_offset += sizeof(HeaderDX10);
+    }
+    else {
+        if (header.caps2 & DDSCAPS2_VOLUME) {
+            ctk_warning("DDS texture \"%s\" is a volume texture, which isn't supported", path);
+            return false;
+        }
+
+        layout->format = _vtk_dds_four_cc_format(header.four_cc, srgb);
+        layout->cube = header.caps2 & DDSCAPS2_CUBEMAP;
+        layout->layer_count = layout->cube ? 6 : 1;
+    }
+
+    if (!_vtk_compressed_layout_valid(layout, path))
+        return false;
+
+    _VTK_BlockFormat block_format = _vtk_block_format(layout->format);
+    if (layout->format == VK_FORMAT_UNDEFINED || block_format.compression == VTK_TEXTURE_COMPRESSION_NONE) {
+        ctk_warning("DDS texture \"%s\" doesn't use a supported block-compressed format", path);
+        return false;
+    }
+
+    if ((u64)layout->layer_count * layout->mip_levels > VTK_COMPRESSED_TEXTURE_MAX_REGIONS)
+        return false;
+
+    u64 offset = 0;
+    for (u32 layer = 0; layer < layout->layer_count; ++layer) {
+        for (u32 level = 0; level < layout->mip_levels; ++level) {
+            _vtk_push_compressed_region(layout, offset, level, layer, 1);
+            offset += _vtk_compressed_image_size(&block_format, layout->extent, level);
+        }
+    }
+
+    layout->data_size = offset;
+    return layout->data_offset + layout->data_size <= file->size;
+}
+
+// Makes the layout's data available as a transfer source. The import path needs every region offset to stay aligned
+// to the format's block size, which DDS files with a DX10 header break; those are copied instead.
+static VTK_ImportedHostMemory _vtk_stage_compressed_texture(VTK_CompressedTextureLoader *loader,
+                                                            _VTK_MappedFile *file,
+                                                            _VTK_CompressedTextureLayout *layout, cstr path) {
+    u8 const *data = file->data + layout->data_offset;
+    u32 block_size = _vtk_block_format(layout->format).block_size;
+    if (loader->importer != NULL && layout->data_offset % block_size == 0)
+        return vtk_import_host_memory(loader->importer, data, layout->data_size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+                                      path);
+
+    VkBufferCreateInfo buffer_info = {};
+    buffer_info.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+    buffer_info.size = layout->data_size;
+    buffer_info.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+    buffer_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    VTK_ImportedHostMemory staged = {};
+    staged.allocation = vtk_create_allocated_buffer(loader->allocator, loader->selector, &buffer_info,
+                                                    VTK_MEMORY_INTENT_UPLOAD, false, path);
+    if (staged.allocation == VTK_NULL_ALLOCATION)
+        return staged;
+
+    VTK_DeviceAllocation *allocation = vtk_device_allocation(loader->allocator, staged.allocation);
+    memcpy(allocation->mapped, data, layout->data_size);
+    staged.buffer = allocation->buffer;
+    staged.size = layout->data_size;
+    return staged;
+}
+
+static bool _vtk_compressed_format_supported(VTK_CompressedTextureLoader *loader, VkFormat format) {
+    s32 compression = _vtk_block_format(format).compression;
+    bool compression_enabled = false;
+    for (u32 i = 0; i < loader->compressions.count; ++i)
+        compression_enabled |= loader->compressions[i] == compression;
+
+    VkFormatProperties properties = {};
+    vkGetPhysicalDeviceFormatProperties(loader->physical_device, format, &properties);
+    VkFormatFeatureFlags required = VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT | VK_FORMAT_FEATURE_TRANSFER_DST_BIT;
+    return compression_enabled && (properties.optimalTilingFeatures & required) == required;
+}
+
+static VTK_Texture _vtk_load_compressed_texture(VTK_CompressedTextureLoader *loader, cstr path, bool srgb) {
+    VTK_Texture texture = {};
+    texture.allocation = VTK_NULL_ALLOCATION;
+    _VTK_MappedFile file = {};
+    if (!_vtk_map_file(path, &file)) {
+        ctk_warning("failed to map compressed texture \"%s\"", path);
+        return texture;
+    }
+
+    _VTK_CompressedTextureLayout layout = {};
+    bool parsed = _vtk_parse_ktx2(&file, &layout, path) || _vtk_parse_dds(&file, &layout, srgb, path);
+    if (!parsed || !_vtk_compressed_format_supported(loader, layout.format)) {
+        if (parsed)
+            ctk_warning("compressed texture \"%s\" has format %u, which the device can't sample", path, layout.format);
+        else
+            ctk_warning("failed to load \"%s\" as a KTX2 or DDS texture", path);
+
+        _vtk_unmap_file(&file);
+        return texture;
+    }
+
+    VTK_TextureInfo info = vtk_default_texture_info(layout.format, layout.extent.width, layout.extent.height);
+    info.mip_levels = layout.mip_levels;
+    info.layer_count = layout.layer_count;
+    info.view_type = layout.cube ? (layout.layer_count > 6 ? VK_IMAGE_VIEW_TYPE_CUBE_ARRAY : VK_IMAGE_VIEW_TYPE_CUBE)
+                     : layout.layer_count > 1 ? VK_IMAGE_VIEW_TYPE_2D_ARRAY
+                     : VK_IMAGE_VIEW_TYPE_2D;
+    info.debug_name = path;
+    texture = vtk_create_texture(loader->allocator, loader->selector, &info);
+    VTK_ImportedHostMemory staged = {};
+    if (texture.allocation != VTK_NULL_ALLOCATION)
+        staged = _vtk_stage_compressed_texture(loader, &file, &layout, path);
+
+    if (staged.buffer == VK_NULL_HANDLE) {
+        ctk_warning("out of device memory loading compressed texture \"%s\"", path);
+        vtk_destroy_texture(loader->allocator, &texture);
+        _vtk_unmap_file(&file);
+        return texture;
+    }
+
+    for (u32 i = 0; i < layout.regions.count; ++i)
+        layout.regions[i].bufferOffset += staged.offset;
+
+    VTK_DeviceDispatch *dispatch = loader->dispatch;
+    vtk_begin_temp_commands(dispatch, loader->command_buffer);
+    VTK_BEGIN_DEBUG_LABEL(loader->command_buffer, "compressed texture upload");
+    VkImageMemoryBarrier pre_barrier =
+        vtk_texture_barrier(&texture, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 0,
+                            VK_ACCESS_TRANSFER_WRITE_BIT, 0, texture.mip_levels);
+    dispatch->vkCmdPipelineBarrier(loader->command_buffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+                                   VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, NULL, 0, NULL, 1, &pre_barrier);
+    dispatch->vkCmdCopyBufferToImage(loader->command_buffer, staged.buffer, texture.image,
+                                     VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, layout.regions.count, layout.regions.data);
+    VkImageMemoryBarrier post_barrier =
+        vtk_texture_barrier(&texture, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+                            VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT, 0, texture.mip_levels);
+    dispatch->vkCmdPipelineBarrier(loader->command_buffer, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                                   VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, 0, 0, NULL, 0, NULL, 1, &post_barrier);
+    VTK_END_DEBUG_LABEL(loader->command_buffer);
+    vtk_submit_temp_commands(loader->command_buffer, loader->queue);
+
+    loader->stats.bytes_uploaded += layout.data_size;
+    if (staged.imported)
+        loader->stats.bytes_imported += layout.data_size;
+
+    if (loader->importer != NULL)
+        vtk_release_host_memory(loader->importer, &staged);
+    else
+        vtk_free_device_region(loader->allocator, staged.allocation);
+
+    _vtk_unmap_file(&file);
+    return texture;
+}
+
+////////////////////////////////////////////////////////////
+/// Interface
+////////////////////////////////////////////////////////////
+
+// Whether device was created with the feature a compression family needs. vtk_default_device_info() requests all of
+// them as optional features.
+static bool vtk_texture_compression_enabled(VTK_Device *device, s32 compression) {
+    switch (compression) {
+        case VTK_TEXTURE_COMPRESSION_BC:   return device->enabled_features.textureCompressionBC;
+        case VTK_TEXTURE_COMPRESSION_ASTC: return device->enabled_features.textureCompressionASTC_LDR;
+        case VTK_TEXTURE_COMPRESSION_ETC2: return device->enabled_features.textureCompressionETC2;
+        default:                           return false;
+    }
+}
+
+// importer may be NULL, in which case file data is copied into upload memory instead of imported.
+static void vtk_init_compressed_texture_loader(VTK_CompressedTextureLoader *loader, VTK_Device *device,
+                                               VTK_DeviceMemoryAllocator *allocator, VTK_MemoryTypeSelector *selector,
+                                               VTK_HostMemoryImporter *importer, VkQueue queue,
+                                               u32 queue_family_index) {
+    *loader = {};
+    loader->physical_device = device->physical;
+    loader->logical_device = device->logical;
+    loader->queue = queue;
+    loader->dispatch = &device->dispatch;
+    loader->allocator = allocator;
+    loader->selector = selector;
+    loader->importer = importer;
+    for (s32 compression = 0; compression < VTK_TEXTURE_COMPRESSION_COUNT; ++compression) {
+        if (vtk_texture_compression_enabled(device, compression))
+            ctk_push(&loader->compressions, compression);
+    }
+
+    if (loader->compressions.count == 0)
+        ctk_warning("device has no block-compressed texture formats enabled");
+
+    VkCommandPoolCreateInfo pool_info = {};
+    pool_info.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+    pool_info.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT | VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+    pool_info.queueFamilyIndex = queue_family_index;
+    vtk_validate_result(vkCreateCommandPool(loader->logical_device, &pool_info, vtk_allocation_callbacks(),
+                                            &loader->command_pool),
+                        "failed to create compressed texture loader command pool");
+    loader->command_buffer = vtk_allocate_command_buffer(loader->logical_device, loader->command_pool,
+                                                         VK_COMMAND_BUFFER_LEVEL_PRIMARY);
+}
+
+static void vtk_destroy_compressed_texture_loader(VTK_CompressedTextureLoader *loader) {
+    vkDestroyCommandPool(loader->logical_device, loader->command_pool, vtk_allocation_callbacks());
+}
+
+// Best compression family the device has enabled, or VTK_TEXTURE_COMPRESSION_NONE.
+static s32 vtk_preferred_texture_compression(VTK_CompressedTextureLoader *loader) {
+    return loader->compressions.count > 0 ? loader->compressions[0] : VTK_TEXTURE_COMPRESSION_NONE;
+}
+
+// paths holds one encoding of the same texture per compression family (NULL where there is none); the best family the
+// device supports is loaded, falling back to the next on failure. Containers are recognized by content, not extension.
+// srgb only applies to legacy DDS files, whose FourCC codes don't say. Blocks until the upload completes. Returns a
+// texture with allocation == VTK_NULL_ALLOCATION if no encoding could be loaded.
+static VTK_Texture vtk_load_compressed_texture(VTK_CompressedTextureLoader *loader,
+                                               cstr const paths[VTK_TEXTURE_COMPRESSION_COUNT], bool srgb) {
+    VTK_CPU_ZONE("vtk_load_compressed_texture");
+    u64 start_ns = _vtk_now_ns();
+    VTK_Texture texture = {};
+    texture.allocation = VTK_NULL_ALLOCATION;
+    for (u32 i = 0; i < loader->compressions.count && texture.allocation == VTK_NULL_ALLOCATION; ++i) {
+        cstr path = paths[loader->compressions[i]];
+        if (path != NULL)
+            texture = _vtk_load_compressed_texture(loader, path, srgb);
+    }
+
+    if (texture.allocation != VTK_NULL_ALLOCATION)
+        ++loader->stats.textures_loaded;
+    else
+        ++loader->stats.textures_failed;
+
+    loader->stats.load_ns += _vtk_now_ns() - start_ns;
+    return texture;
+}
+
+static void vtk_log_compressed_texture_stats(VTK_CompressedTextureLoader *loader) {
+    VTK_CompressedTextureStats *stats = &loader->stats;
+    s32 preferred = vtk_preferred_texture_compression(loader);
+    cstr preferred_name =
+        preferred == VTK_TEXTURE_COMPRESSION_NONE ? "none" : _VTK_TEXTURE_COMPRESSION_NAMES[preferred];
+    ctk_info("compressed textures (prefer %s): %llu loaded, %llu failed, %llu MiB uploaded (%llu MiB imported) "
+             "in %.1f ms", preferred_name,
+             (unsigned long long)stats->textures_loaded, (unsigned long long)stats->textures_failed,
+             (unsigned long long)(stats->bytes_uploaded >> 20), (unsigned long long)(stats->bytes_imported >> 20),
+             (f64)stats->load_ns / 1000000.0);
+}
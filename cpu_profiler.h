@@ -0,0 +1,170 @@
+#pragma once
+
+#include <chrono>
+#include <stdio.h>
+#include "ctk/ctk.h"
+
+////////////////////////////////////////////////////////////
+/// Timing
+////////////////////////////////////////////////////////////
+static u64 _vtk_now_ns() {
+    return (u64)std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+////////////////////////////////////////////////////////////
+/// JSON
+////////////////////////////////////////////////////////////
+
+// Writes string as a quoted JSON string; names in exported traces and stats are caller-provided.
+static void _vtk_write_json_string(FILE *file, cstr string) {
+    fputc('"', file);
+    for (cstr c = string; *c; ++c) {
+        if (*c == '"' || *c == '\\')
+            fprintf(file, "\\%c", *c);
+        else if ((u8)*c < 0x20)
+            fprintf(file, "\\u%04x", (u32)(u8)*c);
+        else
+            fputc(*c, file);
+    }
+    fputc('"', file);
+}
+
+////////////////////////////////////////////////////////////
+/// Macros
+////////////////////////////////////////////////////////////
+#define _VTK_CONCAT_INNER(A, B) A ## B
+#define _VTK_CONCAT(A, B) _VTK_CONCAT_INNER(A, B)
+
+// Zones only exist when VTK_CPU_PROFILER is defined; otherwise VTK_CPU_ZONE expands to nothing and nothing below is
+// compiled in. NAME must be a string literal (or otherwise outlive the trace export).
+#ifdef VTK_CPU_PROFILER
+    #define VTK_CPU_ZONE(NAME) _VTK_CpuZone _VTK_CONCAT(_vtk_cpu_zone_, __LINE__)(NAME)
+#else
+    #define VTK_CPU_ZONE(NAME)
+#endif
+
+#ifdef VTK_CPU_PROFILER
+
+#include <atomic>
+#include <stdlib.h>
+
+////////////////////////////////////////////////////////////
+/// Data
+////////////////////////////////////////////////////////////
+static u32 const VTK_CPU_PROFILER_MAX_THREADS = 64;
+static u32 const VTK_CPU_PROFILER_RING_SIZE = 16384; // Must be a power of 2.
+
+struct _VTK_CpuZoneEvent {
+    cstr name;
+    u64 begin_ns;
+    u64 end_ns;
+};
+
+// Single-producer ring: only the owning thread writes events and bumps write_index; exporters read behind it and drop
+// anything the writer may have lapped while they were reading.
+struct _VTK_CpuZoneRing {
+    _VTK_CpuZoneEvent events[VTK_CPU_PROFILER_RING_SIZE];
+    std::atomic<u64> write_index;
+    u32 thread_index;
+};
+
+struct _VTK_CpuProfiler {
+    _VTK_CpuZoneRing *rings[VTK_CPU_PROFILER_MAX_THREADS];
+    std::atomic<u32> ring_count;
+    u64 start_ns;
+};
+
+static _VTK_CpuProfiler _vtk_cpu_profiler = { {}, {0}, _vtk_now_ns() };
+static thread_local _VTK_CpuZoneRing *_vtk_cpu_zone_ring = NULL;
+
+////////////////////////////////////////////////////////////
+/// Internal
+////////////////////////////////////////////////////////////
+static _VTK_CpuZoneRing *_vtk_thread_cpu_zone_ring() {
+    if (_vtk_cpu_zone_ring != NULL)
+        return _vtk_cpu_zone_ring;
+
+    u32 thread_index = _vtk_cpu_profiler.ring_count.fetch_add(1, std::memory_order_relaxed);
+    if (thread_index >= VTK_CPU_PROFILER_MAX_THREADS)
+        CTK_FATAL("cpu profiler cannot track more than %u threads", VTK_CPU_PROFILER_MAX_THREADS)
+
+    // Rings are never freed so events from exited threads can still be exported.
+    _vtk_cpu_zone_ring = (_VTK_CpuZoneRing *)calloc(1, sizeof(_VTK_CpuZoneRing));
+    _vtk_cpu_zone_ring->thread_index = thread_index;
+    std::atomic_thread_fence(std::memory_order_release);
+    _vtk_cpu_profiler.rings[thread_index] = _vtk_cpu_zone_ring;
+    return _vtk_cpu_zone_ring;
+}
+
+struct _VTK_CpuZone {
+    cstr name;
+    u64 begin_ns;
+
+    _VTK_CpuZone(cstr zone_name) : name(zone_name), begin_ns(_vtk_now_ns()) {}
+
+    ~_VTK_CpuZone() {
+        _VTK_CpuZoneRing *ring = _vtk_thread_cpu_zone_ring();
+        u64 write_index = ring->write_index.load(std::memory_order_relaxed);
+        _VTK_CpuZoneEvent *event = ring->events + (write_index & (VTK_CPU_PROFILER_RING_SIZE - 1));
+        event->name = name;
+        event->begin_ns = begin_ns;
+        event->end_ns = _vtk_now_ns();
+        ring->write_index.store(write_index + 1, std::memory_order_release);
+    }
+};
+
+////////////////////////////////////////////////////////////
+/// Interface
+////////////////////////////////////////////////////////////
+
+// Chrome trace JSON (chrome://tracing, Perfetto). Write order is vtk_begin_chrome_trace(), any number of
+// vtk_write_cpu_trace_events() / vtk_write_gpu_trace_events() calls, then vtk_end_chrome_trace(). Timestamps are
+// microseconds relative to the first zone-capable point in the process, on the _vtk_now_ns() clock.
+static void vtk_begin_chrome_trace(FILE *file) {
+    fprintf(file, "{\"traceEvents\": [\n");
+    fprintf(file, "{ \"ph\": \"M\", \"pid\": 0, \"name\": \"process_name\", \"args\": { \"name\": \"CPU\" } }");
+}
+
+static void vtk_end_chrome_trace(FILE *file) {
+    fprintf(file, "\n]}\n");
+}
+
+// Writes every event still held in each thread's ring. Safe to call while other threads are recording.
+static void vtk_write_cpu_trace_events(FILE *file) {
+    u32 ring_count = _vtk_cpu_profiler.ring_count.load(std::memory_order_acquire);
+    ring_count = ring_count < VTK_CPU_PROFILER_MAX_THREADS ? ring_count : VTK_CPU_PROFILER_MAX_THREADS;
+    for (u32 ring_index = 0; ring_index < ring_count; ++ring_index) {
+        _VTK_CpuZoneRing *ring = _vtk_cpu_profiler.rings[ring_index];
+        if (ring == NULL)
+            continue; // Registered but not published yet.
+
+        fprintf(file, ",\n{ \"ph\": \"M\", \"pid\": 0, \"tid\": %u, \"name\": \"thread_name\", "
+                      "\"args\": { \"name\": \"thread %u\" } }", ring->thread_index, ring->thread_index);
+
+        u64 end = ring->write_index.load(std::memory_order_acquire);
+        u64 begin = end > VTK_CPU_PROFILER_RING_SIZE ? end - VTK_CPU_PROFILER_RING_SIZE : 0;
+        for (u64 i = begin; i < end; ++i) {
+            _VTK_CpuZoneEvent event = ring->events[i & (VTK_CPU_PROFILER_RING_SIZE - 1)];
+
+            // Drop the event if the writer has lapped it since end was loaded; current - i == RING_SIZE means the
+            // writer is overwriting this slot right now.
+            u64 current = ring->write_index.load(std::memory_order_acquire);
+            if (current - i >= VTK_CPU_PROFILER_RING_SIZE)
+                continue;
+
+            fprintf(file, ",\n{ \"ph\": \"X\", \"pid\": 0, \"tid\": %u, \"name\": ", ring->thread_index);
+            _vtk_write_json_string(file, event.name);
+            fprintf(file, ", \"ts\": %.3f, \"dur\": %.3f }",
+                    (f64)(event.begin_ns - _vtk_cpu_profiler.start_ns) / 1000.0,
+                    (f64)(event.end_ns - event.begin_ns) / 1000.0);
+        }
+    }
+}
+
+// Offset of the trace timeline on the _vtk_now_ns() clock, for other event sources written into the same trace.
+static u64 vtk_chrome_trace_start_ns() {
+    return _vtk_cpu_profiler.start_ns;
+}
+
+#endif
@@ -0,0 +1,273 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <stdio.h>
+#include <string.h>
+#include <thread>
+#include <vulkan/vulkan.h>
+#include "ctk/ctk.h"
+#include "vtk/vtk.h"
+#include "vtk/dispatch.h"
+
+////////////////////////////////////////////////////////////
+/// Data
+////////////////////////////////////////////////////////////
+static u32 const VTK_DEBUG_MESSAGE_MAX_ENTRIES = 512;
+static u32 const VTK_DEBUG_MESSAGE_MAX_ID_NAME_SIZE = 64;
+static u32 const VTK_DEBUG_MESSAGE_MAX_TEXT_SIZE = 1024;
+
+struct VTK_DebugMessagePolicy {
+    // Messages with these severities CTK_FATAL on the calling thread, after being logged.
+    VkDebugUtilsMessageSeverityFlagsEXT abort_severities;
+
+    // Messages with severities outside this mask are counted but never logged.
+    VkDebugUtilsMessageSeverityFlagsEXT log_severities;
+
+    // Full message text is logged the first max_text_logs times a message is flushed; after that only its counts are.
+    u32 max_text_logs;
+    u32 flush_interval_ms;
+};
+
+struct _VTK_DebugMessageEntry {
+    s32 id_number;
+    char id_name[VTK_DEBUG_MESSAGE_MAX_ID_NAME_SIZE];
+    char text[VTK_DEBUG_MESSAGE_MAX_TEXT_SIZE];
+    VkDebugUtilsMessageSeverityFlagBitsEXT severity;
+    VkDebugUtilsMessageTypeFlagsEXT types;
+    u64 count;
+    u64 flushed_count;
+    u32 text_log_count;
+    bool used;
+};
+
+struct _VTK_FlushedDebugMessage {
+    char id_name[VTK_DEBUG_MESSAGE_MAX_ID_NAME_SIZE];
+    VkDebugUtilsMessageSeverityFlagBitsEXT severity;
+    u64 new_count;
+    u64 total_count;
+    u32 entry_index;
+    bool log_text;
+};
+
+// Receives debug utils messages through vtk_aggregating_debug_callback. Messages are deduplicated by
+// messageIdNumber/pMessageIdName and counted on the calling thread; logging happens on a background thread every
+// flush_interval_ms, so repeated per-frame warnings cost a hash lookup instead of a formatted log line. Must not be
+// copied or moved after vtk_init_debug_message_aggregator().
+struct VTK_DebugMessageAggregator {
+    VTK_DebugMessagePolicy policy;
+    _VTK_DebugMessageEntry entries[VTK_DEBUG_MESSAGE_MAX_ENTRIES];
+    u32 entry_count;
+    u64 dropped_count;
+
+    // Flush snapshot; only touched by the flush thread, or after it has been joined.
+    _VTK_FlushedDebugMessage flushed[VTK_DEBUG_MESSAGE_MAX_ENTRIES];
+
+    std::mutex mutex;
+    std::condition_variable flush_condition;
+    std::thread flush_thread;
+    bool running;
+};
+
+////////////////////////////////////////////////////////////
+/// Internal
+////////////////////////////////////////////////////////////
+static u32 _vtk_debug_message_hash(s32 id_number, cstr id_name) {
+    u32 hash = 2166136261u ^ (u32)id_number;
+    for (cstr c = id_name; *c; ++c)
+        hash = (hash ^ (u8)*c) * 16777619u;
+
+    return hash;
+}
+
+static void _vtk_copy_debug_message_string(char *dest, cstr src, u32 dest_size) {
+    strncpy(dest, src, dest_size - 1);
+    dest[dest_size - 1] = '\0';
+}
+
+static void _vtk_log_debug_message(VkDebugUtilsMessageSeverityFlagBitsEXT severity, cstr message) {
+    if (severity & VK_DEBUG_UTILS_MESSAGE_SEVERITY_ERROR_BIT_EXT)
+        ctk_error("%s", message);
+    else if (severity & VK_DEBUG_UTILS_MESSAGE_SEVERITY_WARNING_BIT_EXT)
+        ctk_warning("%s", message);
+    else
+        ctk_info("%s", message);
+}
+
+static void _vtk_flush_debug_messages(VTK_DebugMessageAggregator *aggregator) {
+    // Snapshot under the lock, log outside it so message producers never wait on output.
+    _VTK_FlushedDebugMessage *flushed = aggregator->flushed;
+    u32 flushed_count = 0;
+    u64 dropped_count = 0;
+    {
+        std::lock_guard<std::mutex> lock(aggregator->mutex);
+        for (u32 i = 0; i < VTK_DEBUG_MESSAGE_MAX_ENTRIES; ++i) {
+            _VTK_DebugMessageEntry *entry = aggregator->entries + i;
+            if (!entry->used || entry->count == entry->flushed_count)
+                continue;
+
+            if (!(entry->severity & aggregator->policy.log_severities)) {
+                entry->flushed_count = entry->count;
+                continue;
+            }
+
+            _VTK_FlushedDebugMessage *message = flushed + flushed_count++;
+            memcpy(message->id_name, entry->id_name, sizeof(message->id_name));
+            message->severity = entry->severity;
+            message->new_count = entry->count - entry->flushed_count;
+            message->total_count = entry->count;
+            message->entry_index = i;
+            message->log_text = entry->text_log_count < aggregator->policy.max_text_logs;
+            entry->text_log_count += message->log_text ? 1 : 0;
+            entry->flushed_count = entry->count;
+        }
+
+        dropped_count = aggregator->dropped_count;
+        aggregator->dropped_count = 0;
+    }
+
+    // Entry text is written once on insert and never changes, so it's safe to read without the lock.
+    char line[VTK_DEBUG_MESSAGE_MAX_ID_NAME_SIZE + VTK_DEBUG_MESSAGE_MAX_TEXT_SIZE + 64];
+    for (u32 i = 0; i < flushed_count; ++i) {
+        _VTK_FlushedDebugMessage *message = flushed + i;
+        if (message->log_text) {
+            snprintf(line, sizeof(line), "VALIDATION LAYER [%s] x%llu (%llu total): %s", message->id_name,
+                     (unsigned long long)message->new_count, (unsigned long long)message->total_count,
+                     aggregator->entries[message->entry_index].text);
+        }
+        else {
+            snprintf(line, sizeof(line), "VALIDATION LAYER [%s] x%llu (%llu total)", message->id_name,
+                     (unsigned long long)message->new_count, (unsigned long long)message->total_count);
+        }
+
+        _vtk_log_debug_message(message->severity, line);
+    }
+
+    if (dropped_count > 0)
+        ctk_warning("debug message aggregator full; %llu messages dropped", (unsigned long long)dropped_count);
+}
+
+static void _vtk_debug_message_flush_loop(VTK_DebugMessageAggregator *aggregator) {
+    std::unique_lock<std::mutex> lock(aggregator->mutex);
+    while (aggregator->running) {
+        aggregator->flush_condition.wait_for(lock, std::chrono::milliseconds(aggregator->policy.flush_interval_ms));
+        lock.unlock();
+        _vtk_flush_debug_messages(aggregator);
+        lock.lock();
+    }
+}
+
+////////////////////////////////////////////////////////////
+/// Interface
+////////////////////////////////////////////////////////////
+static VTK_DebugMessagePolicy vtk_default_debug_message_policy() {
+    VTK_DebugMessagePolicy policy = {};
+    policy.abort_severities = VK_DEBUG_UTILS_MESSAGE_SEVERITY_ERROR_BIT_EXT;
+    policy.log_severities = VK_DEBUG_UTILS_MESSAGE_SEVERITY_WARNING_BIT_EXT |
+                            VK_DEBUG_UTILS_MESSAGE_SEVERITY_ERROR_BIT_EXT;
+    policy.max_text_logs = 1;
+    policy.flush_interval_ms = 1000;
+    return policy;
+}
+
+static void vtk_init_debug_message_aggregator(VTK_DebugMessageAggregator *aggregator, VTK_DebugMessagePolicy policy) {
+    CTK_ASSERT(policy.flush_interval_ms > 0);
+    aggregator->policy = policy;
+    memset(aggregator->entries, 0, sizeof(aggregator->entries));
+    aggregator->entry_count = 0;
+    aggregator->dropped_count = 0;
+    aggregator->running = true;
+    aggregator->flush_thread = std::thread(_vtk_debug_message_flush_loop, aggregator);
+}
+
+// Stops the flush thread and flushes anything still pending. The messenger using this aggregator must be destroyed first.
+static void vtk_shutdown_debug_message_aggregator(VTK_DebugMessageAggregator *aggregator) {
+    {
+        std::lock_guard<std::mutex> lock(aggregator->mutex);
+        aggregator->running = false;
+    }
+    aggregator->flush_condition.notify_one();
+    aggregator->flush_thread.join();
+    _vtk_flush_debug_messages(aggregator);
+}
+
+// pfnUserCallback for a messenger whose pUserData is a VTK_DebugMessageAggregator.
+static VKAPI_ATTR VkBool32 VKAPI_CALL
+vtk_aggregating_debug_callback(VkDebugUtilsMessageSeverityFlagBitsEXT message_severity_flag_bit,
+                               VkDebugUtilsMessageTypeFlagsEXT message_type_flags,
+                               VkDebugUtilsMessengerCallbackDataEXT const *callback_data,
+                               void *user_data) {
+    auto aggregator = (VTK_DebugMessageAggregator *)user_data;
+    cstr message_id = callback_data->pMessageIdName ? callback_data->pMessageIdName : "";
+
+    if (aggregator->policy.abort_severities & message_severity_flag_bit)
+        CTK_FATAL("VALIDATION LAYER [%s]: %s\n", message_id, callback_data->pMessage)
+
+    u32 hash = _vtk_debug_message_hash(callback_data->messageIdNumber, message_id);
+    std::lock_guard<std::mutex> lock(aggregator->mutex);
+    for (u32 probe = 0; probe < VTK_DEBUG_MESSAGE_MAX_ENTRIES; ++probe) {
+        _VTK_DebugMessageEntry *entry = aggregator->entries + ((hash + probe) % VTK_DEBUG_MESSAGE_MAX_ENTRIES);
+        if (!entry->used) {
+            entry->used = true;
+            entry->id_number = callback_data->messageIdNumber;
+            _vtk_copy_debug_message_string(entry->id_name, message_id, VTK_DEBUG_MESSAGE_MAX_ID_NAME_SIZE);
+            _vtk_copy_debug_message_string(entry->text, callback_data->pMessage, VTK_DEBUG_MESSAGE_MAX_TEXT_SIZE);
+            entry->severity = message_severity_flag_bit;
+            ++aggregator->entry_count;
+        }
+        else if (entry->id_number != callback_data->messageIdNumber ||
+                 strncmp(entry->id_name, message_id, VTK_DEBUG_MESSAGE_MAX_ID_NAME_SIZE - 1) != 0) {
+            continue;
+        }
+
+        entry->types |= message_type_flags;
+        ++entry->count;
+        return VK_FALSE;
+    }
+
+    ++aggregator->dropped_count;
+    return VK_FALSE;
+}
+
+// dispatch must be loaded from instance with vtk_load_instance_dispatch(), and the instance created with
+// VK_EXT_debug_utils enabled.
+static VkDebugUtilsMessengerEXT vtk_create_aggregating_debug_messenger(VTK_InstanceDispatch *dispatch,
+                                                                       VkInstance instance,
+                                                                       VTK_DebugMessageAggregator *aggregator) {
+    VkDebugUtilsMessengerCreateInfoEXT info = {};
+    info.sType = VK_STRUCTURE_TYPE_DEBUG_UTILS_MESSENGER_CREATE_INFO_EXT;
+    info.messageSeverity = VK_DEBUG_UTILS_MESSAGE_SEVERITY_VERBOSE_BIT_EXT |
+                           VK_DEBUG_UTILS_MESSAGE_SEVERITY_INFO_BIT_EXT |
+                           VK_DEBUG_UTILS_MESSAGE_SEVERITY_WARNING_BIT_EXT |
+                           VK_DEBUG_UTILS_MESSAGE_SEVERITY_ERROR_BIT_EXT;
+    info.messageType = VK_DEBUG_UTILS_MESSAGE_TYPE_GENERAL_BIT_EXT |
+                       VK_DEBUG_UTILS_MESSAGE_TYPE_VALIDATION_BIT_EXT |
+                       VK_DEBUG_UTILS_MESSAGE_TYPE_PERFORMANCE_BIT_EXT;
+    info.pfnUserCallback = vtk_aggregating_debug_callback;
+    info.pUserData = aggregator;
+
+    if (dispatch->vkCreateDebugUtilsMessengerEXT == NULL)
+        CTK_FATAL("VK_EXT_debug_utils not enabled on instance")
+
+    VkDebugUtilsMessengerEXT debug_messenger = VK_NULL_HANDLE;
+    vtk_validate_result(dispatch->vkCreateDebugUtilsMessengerEXT(instance, &info, vtk_allocation_callbacks(),
+                                                                 &debug_messenger),
+                        "failed to create debug messenger");
+    return debug_messenger;
+}
+
+static void vtk_destroy_aggregating_debug_messenger(VTK_InstanceDispatch *dispatch, VkInstance instance,
+                                                    VkDebugUtilsMessengerEXT debug_messenger) {
+    dispatch->vkDestroyDebugUtilsMessengerEXT(instance, debug_messenger, vtk_allocation_callbacks());
+}
+
+static void vtk_log_debug_message_summary(VTK_DebugMessageAggregator *aggregator) {
+    std::lock_guard<std::mutex> lock(aggregator->mutex);
+    ctk_info("debug messages: %u unique", aggregator->entry_count);
+    for (u32 i = 0; i < VTK_DEBUG_MESSAGE_MAX_ENTRIES; ++i) {
+        _VTK_DebugMessageEntry *entry = aggregator->entries + i;
+        if (entry->used)
+            ctk_info("    [%s] (%d): %llu", entry->id_name, entry->id_number, (unsigned long long)entry->count);
+    }
+}
@@ -0,0 +1,103 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include "ctk/ctk.h"
+#include "vtk/vtk.h"
+#include "vtk/dispatch.h"
+
+////////////////////////////////////////////////////////////
+/// Macros
+////////////////////////////////////////////////////////////
+
+// Object names and command buffer labels only exist when VTK_DEBUG_UTILS is defined (the instance must also enable
+// VK_EXT_debug_utils); otherwise these expand to nothing and their arguments aren't evaluated.
+#ifdef VTK_DEBUG_UTILS
+    #define VTK_SET_DEBUG_NAME(LOGICAL_DEVICE, OBJECT_TYPE, HANDLE, NAME)\
+        _vtk_set_debug_name(LOGICAL_DEVICE, OBJECT_TYPE, (u64)(HANDLE), NAME)
+    #define VTK_BEGIN_DEBUG_LABEL(COMMAND_BUFFER, NAME) _vtk_begin_debug_label(COMMAND_BUFFER, NAME)
+    #define VTK_END_DEBUG_LABEL(COMMAND_BUFFER) _vtk_end_debug_label(COMMAND_BUFFER)
+    #define VTK_INSERT_DEBUG_LABEL(COMMAND_BUFFER, NAME) _vtk_insert_debug_label(COMMAND_BUFFER, NAME)
+#else
+    #define VTK_SET_DEBUG_NAME(LOGICAL_DEVICE, OBJECT_TYPE, HANDLE, NAME)
+    #define VTK_BEGIN_DEBUG_LABEL(COMMAND_BUFFER, NAME)
+    #define VTK_END_DEBUG_LABEL(COMMAND_BUFFER)
+    #define VTK_INSERT_DEBUG_LABEL(COMMAND_BUFFER, NAME)
+#endif
+
+#ifdef VTK_DEBUG_UTILS
+
+////////////////////////////////////////////////////////////
+/// Data
+////////////////////////////////////////////////////////////
+struct _VTK_DebugUtils {
+    PFN_vkSetDebugUtilsObjectNameEXT vkSetDebugUtilsObjectNameEXT;
+    PFN_vkCmdBeginDebugUtilsLabelEXT vkCmdBeginDebugUtilsLabelEXT;
+    PFN_vkCmdEndDebugUtilsLabelEXT vkCmdEndDebugUtilsLabelEXT;
+    PFN_vkCmdInsertDebugUtilsLabelEXT vkCmdInsertDebugUtilsLabelEXT;
+};
+
+static _VTK_DebugUtils _vtk_debug_utils;
+
+////////////////////////////////////////////////////////////
+/// Internal
+////////////////////////////////////////////////////////////
+
+// All no-ops until vtk_init_debug_utils() finds the extension functions, so naming is safe to leave in place when
+// VK_EXT_debug_utils isn't enabled at runtime.
+static void _vtk_set_debug_name(VkDevice logical_device, VkObjectType object_type, u64 handle, cstr name) {
+    if (_vtk_debug_utils.vkSetDebugUtilsObjectNameEXT == NULL || name == NULL || handle == 0)
+        return;
+
+    VkDebugUtilsObjectNameInfoEXT info = {};
+    info.sType = VK_STRUCTURE_TYPE_DEBUG_UTILS_OBJECT_NAME_INFO_EXT;
+    info.objectType = object_type;
+    info.objectHandle = handle;
+    info.pObjectName = name;
+    vtk_validate_result(_vtk_debug_utils.vkSetDebugUtilsObjectNameEXT(logical_device, &info),
+                        "failed to set debug name \"%s\"", name);
+}
+
+static void _vtk_begin_debug_label(VkCommandBuffer command_buffer, cstr name) {
+    if (_vtk_debug_utils.vkCmdBeginDebugUtilsLabelEXT == NULL)
+        return;
+
+    VkDebugUtilsLabelEXT label = {};
+    label.sType = VK_STRUCTURE_TYPE_DEBUG_UTILS_LABEL_EXT;
+    label.pLabelName = name;
+    _vtk_debug_utils.vkCmdBeginDebugUtilsLabelEXT(command_buffer, &label);
+}
+
+static void _vtk_end_debug_label(VkCommandBuffer command_buffer) {
+    if (_vtk_debug_utils.vkCmdEndDebugUtilsLabelEXT == NULL)
+        return;
+
+    _vtk_debug_utils.vkCmdEndDebugUtilsLabelEXT(command_buffer);
+}
+
+static void _vtk_insert_debug_label(VkCommandBuffer command_buffer, cstr name) {
+    if (_vtk_debug_utils.vkCmdInsertDebugUtilsLabelEXT == NULL)
+        return;
+
+    VkDebugUtilsLabelEXT label = {};
+    label.sType = VK_STRUCTURE_TYPE_DEBUG_UTILS_LABEL_EXT;
+    label.pLabelName = name;
+    _vtk_debug_utils.vkCmdInsertDebugUtilsLabelEXT(command_buffer, &label);
+}
+
+#endif
+
+////////////////////////////////////////////////////////////
+/// Interface
+////////////////////////////////////////////////////////////
+
+// Called by vtk_create_device(); only needed directly for devices created some other way.
+static void vtk_init_debug_utils(VTK_DeviceDispatch *dispatch) {
+#ifdef VTK_DEBUG_UTILS
+    _vtk_debug_utils.vkSetDebugUtilsObjectNameEXT = dispatch->vkSetDebugUtilsObjectNameEXT;
+    _vtk_debug_utils.vkCmdBeginDebugUtilsLabelEXT = dispatch->vkCmdBeginDebugUtilsLabelEXT;
+    _vtk_debug_utils.vkCmdEndDebugUtilsLabelEXT = dispatch->vkCmdEndDebugUtilsLabelEXT;
+    _vtk_debug_utils.vkCmdInsertDebugUtilsLabelEXT = dispatch->vkCmdInsertDebugUtilsLabelEXT;
+    if (_vtk_debug_utils.vkSetDebugUtilsObjectNameEXT == NULL)
+        ctk_warning("VK_EXT_debug_utils not available; debug names and labels disabled");
+#endif
+}
@@ -0,0 +1,847 @@
+#pragma once
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vulkan/vulkan.h>
+#include "ctk/ctk.h"
+#include "ctk/memory.h"
+#include "ctk/containers.h"
+#include "vtk/vtk.h"
+#include "vtk/device_features.h"
+#include "vtk/dispatch.h"
+#include "vtk/debug_utils.h"
+
+////////////////////////////////////////////////////////////
+/// Data
+////////////////////////////////////////////////////////////
+static u32 const VTK_MAX_REQUIRED_DEVICE_EXTENSIONS = 16;
+static u32 const VTK_MAX_OPTIONAL_DEVICE_EXTENSIONS = 16;
+
+// Required and optional extensions plus one per extended feature enabled through its extension.
+static u32 const VTK_MAX_DEVICE_EXTENSIONS =
+    VTK_MAX_REQUIRED_DEVICE_EXTENSIONS + VTK_MAX_OPTIONAL_DEVICE_EXTENSIONS + VTK_EXTENDED_FEATURE_COUNT;
+
+struct VTK_QueueFamilyIndexes {
+    u32 graphics;
+    u32 present;
+    u32 compute;  // Dedicated compute family if one exists, graphics otherwise.
+    u32 transfer; // Dedicated transfer family if one exists, graphics otherwise.
+};
+
+// Snapshot of everything vtk queries from a physical device, captured once per device into allocator memory.
+struct VTK_PhysicalDeviceQuery {
+    VkPhysicalDevice handle;
+    VkPhysicalDeviceProperties properties;
+    VkPhysicalDeviceFeatures features;
+    VkPhysicalDeviceMemoryProperties memory_properties;
+    VkQueueFamilyProperties *queue_families;
+    VkExtensionProperties *extensions;
+    u32 queue_family_count;
+    u32 extension_count;
+
+    // Surface state; only queried when a surface is given.
+    VkBool32 *queue_family_present_support;
+    VkSurfaceFormatKHR *surface_formats;
+    VkPresentModeKHR *surface_present_modes;
+    u32 surface_format_count;
+    u32 surface_present_mode_count;
+    VkSurfaceCapabilitiesKHR surface_capabilities;
+
+    // Vulkan 1.1+ feature structs; always queried, never cached (the chain holds self-referencing pointers).
+    VTK_FeatureChain *extended_features;
+
+    // min(instance, device) apiVersion: the version vtk may actually use with this device.
+    u32 api_version;
+
+    bool from_cache;
+};
+
+struct VTK_DeviceInfo {
+    // Device is rejected if it doesn't support every feature set in required_features.
+    VkPhysicalDeviceFeatures required_features;
+
+    // Device scores higher for every supported feature set in optional_features; supported ones get enabled.
+    VkPhysicalDeviceFeatures optional_features;
+
+    // Same as above for Vulkan 1.1/1.2/1.3 and extension features, as VTK_EXTENDED_FEATURE_BIT() masks. Extensions
+    // needed for features the device only exposes through an extension are enabled automatically.
+    u64 required_extended_features;
+    u64 optional_extended_features;
+
+    CTK_StaticArray<cstr, VTK_MAX_REQUIRED_DEVICE_EXTENSIONS> required_extensions;
+
+    // Enabled when supported; check with vtk_device_extension_enabled().
+    CTK_StaticArray<cstr, VTK_MAX_OPTIONAL_DEVICE_EXTENSIONS> optional_extensions;
+
+    // VK_NULL_HANDLE for headless devices; presentation support and surface formats are only checked against a surface.
+    VkSurfaceKHR surface;
+
+    // Score added per VkPhysicalDeviceType (indexed by type).
+    s32 type_weights[5];
+
+    // Overrides scoring if a suitable device matches. If both are unset, the VTK_PHYSICAL_DEVICE environment variable is
+    // used instead, matched against the device name or the hex-encoded pipelineCacheUUID.
+    cstr name_override;
+    u8 uuid_override[VK_UUID_SIZE];
+    bool use_uuid_override;
+
+    // Optional path of a disk cache for surface-independent query results, keyed by device and driver version.
+    cstr query_cache_path;
+
+    // Log the full limits of every candidate device.
+    bool log_limits;
+
+    // VkApplicationInfo::apiVersion the instance was created with. Device functionality beyond it can't be used even
+    // if the device reports a newer apiVersion; on a 1.0 instance only VkPhysicalDeviceFeatures are queried.
+    u32 instance_api_version;
+};
+
+struct VTK_PhysicalDeviceCandidate {
+    VTK_PhysicalDeviceQuery *query;
+    VTK_QueueFamilyIndexes queue_family_indexes;
+    VkDeviceSize device_local_bytes;
+    s32 score;
+    bool suitable;
+    bool overridden;
+};
+
+struct VTK_Device {
+    VkPhysicalDevice physical;
+    VkDevice logical;
+    VTK_QueueFamilyIndexes queue_family_indexes;
+    struct {
+        VkQueue graphics;
+        VkQueue present;
+        VkQueue compute;
+        VkQueue transfer;
+    } queues;
+    VkPhysicalDeviceProperties properties;
+    VkPhysicalDeviceMemoryProperties memory_properties;
+    VkPhysicalDeviceFeatures enabled_features;
+    u64 enabled_extended_features;
+    CTK_StaticArray<cstr, VTK_MAX_DEVICE_EXTENSIONS> enabled_extensions;
+    VkFormat depth_image_format;
+
+    // min(instance, device) apiVersion; check this rather than properties.apiVersion before using 1.1+ functionality.
+    u32 api_version;
+
+    // Query snapshot of the selected device, kept for swapchain creation and feature checks.
+    VTK_PhysicalDeviceQuery *query;
+
+    // Direct device-level function pointers; prefer these over loader symbols for per-frame calls.
+    VTK_DeviceDispatch dispatch;
+};
+
+struct _VTK_QueryCacheHeader {
+    u32 magic;
+    u32 version;
+    u32 record_count;
+};
+
+struct _VTK_QueryCacheRecord {
+    u32 vendor_id;
+    u32 device_id;
+    u32 driver_version;
+    u8 pipeline_cache_uuid[VK_UUID_SIZE];
+    u32 queue_family_count;
+    u32 extension_count;
+    // Followed by features, memory properties, queue families and extensions.
+};
+
+static u32 const _VTK_QUERY_CACHE_MAGIC = 0x51544B56; // "VKTQ"
+static u32 const _VTK_QUERY_CACHE_VERSION = 1;
+
+////////////////////////////////////////////////////////////
+/// Declarations
+////////////////////////////////////////////////////////////
+static bool vtk_device_extension_supported(VTK_PhysicalDeviceQuery *query, cstr extension);
+
+////////////////////////////////////////////////////////////
+/// Internal
+////////////////////////////////////////////////////////////
+static cstr _vtk_physical_device_type_name(VkPhysicalDeviceType type) {
+    switch (type) {
+        case VK_PHYSICAL_DEVICE_TYPE_INTEGRATED_GPU: return "integrated";
+        case VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU:   return "discrete";
+        case VK_PHYSICAL_DEVICE_TYPE_VIRTUAL_GPU:    return "virtual";
+        case VK_PHYSICAL_DEVICE_TYPE_CPU:            return "cpu";
+        default:                                     return "other";
+    }
+}
+
+static void _vtk_uuid_to_hex(u8 const *uuid, char *hex) {
+    static char const DIGITS[] = "0123456789abcdef";
+    for (u32 i = 0; i < VK_UUID_SIZE; ++i) {
+        hex[i * 2] = DIGITS[uuid[i] >> 4];
+        hex[i * 2 + 1] = DIGITS[uuid[i] & 0xF];
+    }
+    hex[VK_UUID_SIZE * 2] = '\0';
+}
+
+// Enumerates into a single allocation from allocator; count is 0 and the result NULL if there's nothing to enumerate.
+template<typename Object, typename Loader, typename ...Args>
+static Object *_vtk_enumerate(CTK_Allocator *allocator, u32 *count, Loader loader, Args... args) {
+    Object *objects = vtk_enumerate_vk_objects((Object *)NULL, 0, allocator, count, loader, args...);
+    return *count > 0 ? objects : NULL;
+}
+
+////////////////////////////////////////////////////////////
+/// Query Cache
+////////////////////////////////////////////////////////////
+static u8 *_vtk_read_query_cache(cstr path, CTK_Allocator *allocator, u32 *size) {
+    *size = 0;
+    FILE *file = fopen(path, "rb");
+    if (!file)
+        return NULL;
+
+    fseek(file, 0, SEEK_END);
+    long file_size = ftell(file);
+    fseek(file, 0, SEEK_SET);
+    u8 *data = NULL;
+    if (file_size > (long)sizeof(_VTK_QueryCacheHeader)) {
+        data = ctk_alloc<u8>(allocator, (u32)file_size);
+        *size = (u32)fread(data, 1, (size_t)file_size, file);
+    }
+
+    fclose(file);
+
+    auto header = (_VTK_QueryCacheHeader *)data;
+    if (!data || *size != (u32)file_size || header->magic != _VTK_QUERY_CACHE_MAGIC ||
+        header->version != _VTK_QUERY_CACHE_VERSION) {
+        *size = 0;
+        return NULL;
+    }
+
+    return data;
+}
+
+// Fills the surface-independent part of query from the cache if an entry with matching device and driver version
+// exists. Cached arrays are referenced in place, so a hit costs no additional allocations.
+static bool _vtk_load_cached_query(VTK_PhysicalDeviceQuery *query, u8 *cache, u32 cache_size) {
+    if (!cache)
+        return false;
+
+    auto header = (_VTK_QueryCacheHeader *)cache;
+    u8 *it = cache + sizeof(_VTK_QueryCacheHeader);
+    u8 *end = cache + cache_size;
+    for (u32 i = 0; i < header->record_count; ++i) {
+        if (it + sizeof(_VTK_QueryCacheRecord) > end)
+            return false;
+
+        auto record = (_VTK_QueryCacheRecord *)it;
+        u8 *features = it + sizeof(_VTK_QueryCacheRecord);
+        u8 *memory_properties = features + sizeof(VkPhysicalDeviceFeatures);
+        u8 *queue_families = memory_properties + sizeof(VkPhysicalDeviceMemoryProperties);
+        u8 *extensions = queue_families + sizeof(VkQueueFamilyProperties) * record->queue_family_count;
+        u8 *next = extensions + sizeof(VkExtensionProperties) * record->extension_count;
+        if (next > end)
+            return false;
+
+        VkPhysicalDeviceProperties *props = &query->properties;
+        if (record->vendor_id == props->vendorID && record->device_id == props->deviceID &&
+            record->driver_version == props->driverVersion &&
+            memcmp(record->pipeline_cache_uuid, props->pipelineCacheUUID, VK_UUID_SIZE) == 0) {
+            memcpy(&query->features, features, sizeof(VkPhysicalDeviceFeatures));
+            memcpy(&query->memory_properties, memory_properties, sizeof(VkPhysicalDeviceMemoryProperties));
+            query->queue_families = (VkQueueFamilyProperties *)queue_families;
+            query->queue_family_count = record->queue_family_count;
+            query->extensions = (VkExtensionProperties *)extensions;
+            query->extension_count = record->extension_count;
+            query->from_cache = true;
+            return true;
+        }
+
+        it = next;
+    }
+
+    return false;
+}
+
+static void _vtk_write_query_cache(cstr path, VTK_PhysicalDeviceQuery **queries, u32 query_count) {
+    FILE *file = fopen(path, "wb");
+    if (!file) {
+        ctk_warning("failed to open physical device query cache \"%s\" for writing", path);
+        return;
+    }
+
+    _VTK_QueryCacheHeader header = {};
+    header.magic = _VTK_QUERY_CACHE_MAGIC;
+    header.version = _VTK_QUERY_CACHE_VERSION;
+    header.record_count = query_count;
+    fwrite(&header, sizeof(header), 1, file);
+    for (u32 i = 0; i < query_count; ++i) {
+        VTK_PhysicalDeviceQuery *query = queries[i];
+        _VTK_QueryCacheRecord record = {};
+        record.vendor_id = query->properties.vendorID;
+        record.device_id = query->properties.deviceID;
+        record.driver_version = query->properties.driverVersion;
+        memcpy(record.pipeline_cache_uuid, query->properties.pipelineCacheUUID, VK_UUID_SIZE);
+        record.queue_family_count = query->queue_family_count;
+        record.extension_count = query->extension_count;
+        fwrite(&record, sizeof(record), 1, file);
+        fwrite(&query->features, sizeof(query->features), 1, file);
+        fwrite(&query->memory_properties, sizeof(query->memory_properties), 1, file);
+        fwrite(query->queue_families, sizeof(VkQueueFamilyProperties), query->queue_family_count, file);
+        fwrite(query->extensions, sizeof(VkExtensionProperties), query->extension_count, file);
+    }
+
+    fclose(file);
+}
+
+////////////////////////////////////////////////////////////
+/// Selection
+////////////////////////////////////////////////////////////
+static bool _vtk_matches_override(VTK_DeviceInfo *info, VTK_PhysicalDeviceQuery *query) {
+    if (info->use_uuid_override)
+        return memcmp(info->uuid_override, query->properties.pipelineCacheUUID, VK_UUID_SIZE) == 0;
+
+    if (info->name_override)
+        return strcmp(info->name_override, query->properties.deviceName) == 0;
+
+    cstr env_override = getenv("VTK_PHYSICAL_DEVICE");
+    if (!env_override || !env_override[0])
+        return false;
+
+    char uuid_hex[VK_UUID_SIZE * 2 + 1] = {};
+    _vtk_uuid_to_hex(query->properties.pipelineCacheUUID, uuid_hex);
+    return strcmp(env_override, query->properties.deviceName) == 0 || strcmp(env_override, uuid_hex) == 0;
+}
+
+static void _vtk_find_queue_family_indexes(VTK_PhysicalDeviceCandidate *candidate) {
+    VTK_PhysicalDeviceQuery *query = candidate->query;
+    VTK_QueueFamilyIndexes *indexes = &candidate->queue_family_indexes;
+    indexes->graphics = CTK_U32_MAX;
+    indexes->present = CTK_U32_MAX;
+    indexes->compute = CTK_U32_MAX;
+    indexes->transfer = CTK_U32_MAX;
+
+    for (u32 i = 0; i < query->queue_family_count; ++i) {
+        VkQueueFlags flags = query->queue_families[i].queueFlags;
+        if ((flags & VK_QUEUE_GRAPHICS_BIT) && indexes->graphics == CTK_U32_MAX)
+            indexes->graphics = i;
+
+        if ((flags & VK_QUEUE_COMPUTE_BIT) && !(flags & VK_QUEUE_GRAPHICS_BIT) && indexes->compute == CTK_U32_MAX)
+            indexes->compute = i;
+
+        if ((flags & VK_QUEUE_TRANSFER_BIT) && !(flags & (VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT)) &&
+            indexes->transfer == CTK_U32_MAX) {
+            indexes->transfer = i;
+        }
+
+        // Prefer presenting from the graphics family to avoid cross-family ownership transfers.
+        if (query->queue_family_present_support && query->queue_family_present_support[i] == VK_TRUE &&
+            (indexes->present == CTK_U32_MAX || i == indexes->graphics)) {
+            indexes->present = i;
+        }
+    }
+}
+
+static bool _vtk_extensions_supported(VTK_PhysicalDeviceQuery *query, VTK_DeviceInfo *info) {
+    bool all_supported = true;
+    for (u32 i = 0; i < info->required_extensions.count; ++i) {
+        cstr required_extension = info->required_extensions[i];
+        if (!vtk_device_extension_supported(query, required_extension)) {
+            ctk_info("physical device \"%s\" does not support extension \"%s\"", query->properties.deviceName,
+                     required_extension);
+            all_supported = false;
+        }
+    }
+
+    return all_supported;
+}
+
+static void _vtk_score_physical_device(VTK_PhysicalDeviceCandidate *candidate, VTK_DeviceInfo *info) {
+    VTK_PhysicalDeviceQuery *query = candidate->query;
+    _vtk_find_queue_family_indexes(candidate);
+    candidate->overridden = _vtk_matches_override(info, query);
+    cstr name = query->properties.deviceName;
+
+    ////////////////////////////////////////////////////////////
+    /// Requirements
+    ////////////////////////////////////////////////////////////
+    candidate->suitable = true;
+    if (candidate->queue_family_indexes.graphics == CTK_U32_MAX) {
+        ctk_info("physical device \"%s\" has no graphics queue family", name);
+        candidate->suitable = false;
+    }
+
+    if (info->surface != VK_NULL_HANDLE &&
+        (candidate->queue_family_indexes.present == CTK_U32_MAX || query->surface_format_count == 0 ||
+         query->surface_present_mode_count == 0)) {
+        ctk_info("physical device \"%s\" cannot present to surface", name);
+        candidate->suitable = false;
+    }
+
+    for (s32 feature = 0; feature < VTK_PHYSICAL_DEVICE_FEATURE_COUNT; ++feature) {
+        if (vtk_physical_device_feature_supported(feature, &info->required_features) &&
+            !vtk_physical_device_feature_supported(feature, &query->features)) {
+            ctk_info("physical device \"%s\" does not support feature \"%s\"", name,
+                     vtk_physical_device_feature_name(feature));
+            candidate->suitable = false;
+        }
+    }
+
+    for (s32 feature = 0; feature < VTK_EXTENDED_FEATURE_COUNT; ++feature) {
+        if ((info->required_extended_features & (1ull << feature)) &&
+            !vtk_extended_feature_supported(query->extended_features, feature)) {
+            ctk_info("physical device \"%s\" does not support feature \"%s\"", name,
+                     vtk_extended_feature_name(feature));
+            candidate->suitable = false;
+        }
+    }
+
+    if (!_vtk_extensions_supported(query, info))
+        candidate->suitable = false;
+
+    ////////////////////////////////////////////////////////////
+    /// Scoring
+    ////////////////////////////////////////////////////////////
+    s32 score = 0;
+    u32 type = (u32)query->properties.deviceType;
+    score += type < CTK_ARRAY_SIZE(info->type_weights) ? info->type_weights[type] : 0;
+
+    // +8 per GiB of device-local memory, capped so heap size can't outweigh device type.
+    for (u32 i = 0; i < query->memory_properties.memoryHeapCount; ++i) {
+        VkMemoryHeap *heap = query->memory_properties.memoryHeaps + i;
+        if (heap->flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT)
+            candidate->device_local_bytes += heap->size;
+    }
+    s32 heap_score = (s32)(candidate->device_local_bytes >> 27);
+    score += heap_score < 256 ? heap_score : 256;
+
+    // Queue capabilities: async compute/transfer families and presenting from the graphics family.
+    VTK_QueueFamilyIndexes *indexes = &candidate->queue_family_indexes;
+    if (indexes->compute != CTK_U32_MAX)
+        score += 25;
+
+    if (indexes->transfer != CTK_U32_MAX)
+        score += 25;
+
+    if (info->surface != VK_NULL_HANDLE && indexes->present == indexes->graphics)
+        score += 50;
+
+    for (s32 feature = 0; feature < VTK_PHYSICAL_DEVICE_FEATURE_COUNT; ++feature) {
+        if (vtk_physical_device_feature_supported(feature, &info->optional_features) &&
+            vtk_physical_device_feature_supported(feature, &query->features)) {
+            score += 10;
+        }
+    }
+
+    for (s32 feature = 0; feature < VTK_EXTENDED_FEATURE_COUNT; ++feature) {
+        if ((info->optional_extended_features & (1ull << feature)) &&
+            vtk_extended_feature_supported(query->extended_features, feature)) {
+            score += 10;
+        }
+    }
+
+    candidate->score = score;
+
+    // Unset dedicated families fall back to graphics so callers can always use them.
+    if (indexes->compute == CTK_U32_MAX)
+        indexes->compute = indexes->graphics;
+
+    if (indexes->transfer == CTK_U32_MAX)
+        indexes->transfer = indexes->graphics;
+}
+
+////////////////////////////////////////////////////////////
+/// Interface
+////////////////////////////////////////////////////////////
+static bool vtk_device_extension_supported(VTK_PhysicalDeviceQuery *query, cstr extension) {
+    for (u32 i = 0; i < query->extension_count; ++i) {
+        if (strcmp(extension, query->extensions[i].extensionName) == 0)
+            return true;
+    }
+
+    return false;
+}
+
+static bool vtk_device_extension_enabled(VTK_Device *device, cstr extension) {
+    for (u32 i = 0; i < device->enabled_extensions.count; ++i) {
+        if (strcmp(extension, device->enabled_extensions[i]) == 0)
+            return true;
+    }
+
+    return false;
+}
+
+// Captures everything vtk needs from physical_device in one pass. If cache holds an entry for the same device and
+// driver version, only properties and the surface-dependent state are queried.
+static VTK_PhysicalDeviceQuery *vtk_query_physical_device(VkPhysicalDevice physical_device, u32 instance_api_version,
+                                                          VkSurfaceKHR surface, u8 *cache, u32 cache_size,
+                                                          CTK_Allocator *allocator) {
+    auto query = ctk_alloc<VTK_PhysicalDeviceQuery>(allocator, 1);
+    *query = {};
+    query->handle = physical_device;
+    vkGetPhysicalDeviceProperties(physical_device, &query->properties);
+    query->api_version = instance_api_version < query->properties.apiVersion ? instance_api_version
+                                                                             : query->properties.apiVersion;
+
+    if (!_vtk_load_cached_query(query, cache, cache_size)) {
+        vkGetPhysicalDeviceFeatures(physical_device, &query->features);
+        vkGetPhysicalDeviceMemoryProperties(physical_device, &query->memory_properties);
+        query->queue_families =
+            _vtk_enumerate<VkQueueFamilyProperties>(allocator, &query->queue_family_count,
+                                                    vkGetPhysicalDeviceQueueFamilyProperties, physical_device);
+        query->extensions =
+            _vtk_enumerate<VkExtensionProperties>(allocator, &query->extension_count,
+                                                  vkEnumerateDeviceExtensionProperties, physical_device, (cstr)NULL);
+    }
+
+    query->extended_features = ctk_alloc<VTK_FeatureChain>(allocator, 1);
+    vtk_init_feature_chain(query->extended_features, query->api_version, query->extensions, query->extension_count);
+    if (query->api_version >= VK_API_VERSION_1_1)
+        vkGetPhysicalDeviceFeatures2(physical_device, &query->extended_features->features2);
+
+    if (surface != VK_NULL_HANDLE) {
+        query->queue_family_present_support = ctk_alloc<VkBool32>(allocator, query->queue_family_count);
+        for (u32 i = 0; i < query->queue_family_count; ++i) {
+            query->queue_family_present_support[i] = VK_FALSE;
+            vkGetPhysicalDeviceSurfaceSupportKHR(physical_device, i, surface, query->queue_family_present_support + i);
+        }
+
+        vkGetPhysicalDeviceSurfaceCapabilitiesKHR(physical_device, surface, &query->surface_capabilities);
+        query->surface_formats =
+            _vtk_enumerate<VkSurfaceFormatKHR>(allocator, &query->surface_format_count,
+                                               vkGetPhysicalDeviceSurfaceFormatsKHR, physical_device, surface);
+        query->surface_present_modes =
+            _vtk_enumerate<VkPresentModeKHR>(allocator, &query->surface_present_mode_count,
+                                             vkGetPhysicalDeviceSurfacePresentModesKHR, physical_device, surface);
+    }
+
+    return query;
+}
+
+static void vtk_log_device_limits(VkPhysicalDeviceLimits *limits) {
+    #define _VTK_LOG_LIMIT(FORMAT, NAME) ctk_info("    " #NAME ": " FORMAT, limits->NAME)
+    #define _VTK_LOG_LIMIT_2(FORMAT, NAME) \
+        ctk_info("    " #NAME ": { " FORMAT ", " FORMAT " }", limits->NAME[0], limits->NAME[1])
+    #define _VTK_LOG_LIMIT_3(FORMAT, NAME) \
+        ctk_info("    " #NAME ": { " FORMAT ", " FORMAT ", " FORMAT " }", limits->NAME[0], limits->NAME[1], \
+                 limits->NAME[2])
+
+    ctk_info("device limits:");
+    _VTK_LOG_LIMIT("%u", maxImageDimension1D);
+    _VTK_LOG_LIMIT("%u", maxImageDimension2D);
+    _VTK_LOG_LIMIT("%u", maxImageDimension3D);
+    _VTK_LOG_LIMIT("%u", maxImageDimensionCube);
+    _VTK_LOG_LIMIT("%u", maxImageArrayLayers);
+    _VTK_LOG_LIMIT("%u", maxTexelBufferElements);
+    _VTK_LOG_LIMIT("%u", maxUniformBufferRange);
+    _VTK_LOG_LIMIT("%u", maxStorageBufferRange);
+    _VTK_LOG_LIMIT("%u", maxPushConstantsSize);
+    _VTK_LOG_LIMIT("%u", maxMemoryAllocationCount);
+    _VTK_LOG_LIMIT("%u", maxSamplerAllocationCount);
+    _VTK_LOG_LIMIT("%llu", bufferImageGranularity);
+    _VTK_LOG_LIMIT("%llu", sparseAddressSpaceSize);
+    _VTK_LOG_LIMIT("%u", maxBoundDescriptorSets);
+    _VTK_LOG_LIMIT("%u", maxPerStageDescriptorSamplers);
+    _VTK_LOG_LIMIT("%u", maxPerStageDescriptorUniformBuffers);
+    _VTK_LOG_LIMIT("%u", maxPerStageDescriptorStorageBuffers);
+    _VTK_LOG_LIMIT("%u", maxPerStageDescriptorSampledImages);
+    _VTK_LOG_LIMIT("%u", maxPerStageDescriptorStorageImages);
+    _VTK_LOG_LIMIT("%u", maxPerStageDescriptorInputAttachments);
+    _VTK_LOG_LIMIT("%u", maxPerStageResources);
+    _VTK_LOG_LIMIT("%u", maxDescriptorSetSamplers);
+    _VTK_LOG_LIMIT("%u", maxDescriptorSetUniformBuffers);
+    _VTK_LOG_LIMIT("%u", maxDescriptorSetUniformBuffersDynamic);
+    _VTK_LOG_LIMIT("%u", maxDescriptorSetStorageBuffers);
+    _VTK_LOG_LIMIT("%u", maxDescriptorSetStorageBuffersDynamic);
+    _VTK_LOG_LIMIT("%u", maxDescriptorSetSampledImages);
+    _VTK_LOG_LIMIT("%u", maxDescriptorSetStorageImages);
+    _VTK_LOG_LIMIT("%u", maxDescriptorSetInputAttachments);
+    _VTK_LOG_LIMIT("%u", maxVertexInputAttributes);
+    _VTK_LOG_LIMIT("%u", maxVertexInputBindings);
+    _VTK_LOG_LIMIT("%u", maxVertexInputAttributeOffset);
+    _VTK_LOG_LIMIT("%u", maxVertexInputBindingStride);
+    _VTK_LOG_LIMIT("%u", maxVertexOutputComponents);
+    _VTK_LOG_LIMIT("%u", maxTessellationGenerationLevel);
+    _VTK_LOG_LIMIT("%u", maxTessellationPatchSize);
+    _VTK_LOG_LIMIT("%u", maxTessellationControlPerVertexInputComponents);
+    _VTK_LOG_LIMIT("%u", maxTessellationControlPerVertexOutputComponents);
+    _VTK_LOG_LIMIT("%u", maxTessellationControlPerPatchOutputComponents);
+    _VTK_LOG_LIMIT("%u", maxTessellationControlTotalOutputComponents);
+    _VTK_LOG_LIMIT("%u", maxTessellationEvaluationInputComponents);
+    _VTK_LOG_LIMIT("%u", maxTessellationEvaluationOutputComponents);
+    _VTK_LOG_LIMIT("%u", maxGeometryShaderInvocations);
+    _VTK_LOG_LIMIT("%u", maxGeometryInputComponents);
+    _VTK_LOG_LIMIT("%u", maxGeometryOutputComponents);
+    _VTK_LOG_LIMIT("%u", maxGeometryOutputVertices);
+    _VTK_LOG_LIMIT("%u", maxGeometryTotalOutputComponents);
+    _VTK_LOG_LIMIT("%u", maxFragmentInputComponents);
+    _VTK_LOG_LIMIT("%u", maxFragmentOutputAttachments);
+    _VTK_LOG_LIMIT("%u", maxFragmentDualSrcAttachments);
+    _VTK_LOG_LIMIT("%u", maxFragmentCombinedOutputResources);
+    _VTK_LOG_LIMIT("%u", maxComputeSharedMemorySize);
+    _VTK_LOG_LIMIT_3("%u", maxComputeWorkGroupCount);
+    _VTK_LOG_LIMIT("%u", maxComputeWorkGroupInvocations);
+    _VTK_LOG_LIMIT_3("%u", maxComputeWorkGroupSize);
+    _VTK_LOG_LIMIT("%u", subPixelPrecisionBits);
+    _VTK_LOG_LIMIT("%u", subTexelPrecisionBits);
+    _VTK_LOG_LIMIT("%u", mipmapPrecisionBits);
+    _VTK_LOG_LIMIT("%u", maxDrawIndexedIndexValue);
+    _VTK_LOG_LIMIT("%u", maxDrawIndirectCount);
+    _VTK_LOG_LIMIT("%f", maxSamplerLodBias);
+    _VTK_LOG_LIMIT("%f", maxSamplerAnisotropy);
+    _VTK_LOG_LIMIT("%u", maxViewports);
+    _VTK_LOG_LIMIT_2("%u", maxViewportDimensions);
+    _VTK_LOG_LIMIT_2("%f", viewportBoundsRange);
+    _VTK_LOG_LIMIT("%u", viewportSubPixelBits);
+    _VTK_LOG_LIMIT("%zu", minMemoryMapAlignment);
+    _VTK_LOG_LIMIT("%llu", minTexelBufferOffsetAlignment);
+    _VTK_LOG_LIMIT("%llu", minUniformBufferOffsetAlignment);
+    _VTK_LOG_LIMIT("%llu", minStorageBufferOffsetAlignment);
+    _VTK_LOG_LIMIT("%i", minTexelOffset);
+    _VTK_LOG_LIMIT("%u", maxTexelOffset);
+    _VTK_LOG_LIMIT("%i", minTexelGatherOffset);
+    _VTK_LOG_LIMIT("%u", maxTexelGatherOffset);
+    _VTK_LOG_LIMIT("%f", minInterpolationOffset);
+    _VTK_LOG_LIMIT("%f", maxInterpolationOffset);
+    _VTK_LOG_LIMIT("%u", subPixelInterpolationOffsetBits);
+    _VTK_LOG_LIMIT("%u", maxFramebufferWidth);
+    _VTK_LOG_LIMIT("%u", maxFramebufferHeight);
+    _VTK_LOG_LIMIT("%u", maxFramebufferLayers);
+    _VTK_LOG_LIMIT("%u", maxColorAttachments);
+    _VTK_LOG_LIMIT("%u", maxSampleMaskWords);
+    _VTK_LOG_LIMIT("%u", timestampComputeAndGraphics);
+    _VTK_LOG_LIMIT("%f", timestampPeriod);
+    _VTK_LOG_LIMIT("%u", maxClipDistances);
+    _VTK_LOG_LIMIT("%u", maxCullDistances);
+    _VTK_LOG_LIMIT("%u", maxCombinedClipAndCullDistances);
+    _VTK_LOG_LIMIT("%u", discreteQueuePriorities);
+    _VTK_LOG_LIMIT_2("%f", pointSizeRange);
+    _VTK_LOG_LIMIT_2("%f", lineWidthRange);
+    _VTK_LOG_LIMIT("%f", pointSizeGranularity);
+    _VTK_LOG_LIMIT("%f", lineWidthGranularity);
+    _VTK_LOG_LIMIT("%u", strictLines);
+    _VTK_LOG_LIMIT("%u", standardSampleLocations);
+    _VTK_LOG_LIMIT("%llu", optimalBufferCopyOffsetAlignment);
+    _VTK_LOG_LIMIT("%llu", optimalBufferCopyRowPitchAlignment);
+    _VTK_LOG_LIMIT("%llu", nonCoherentAtomSize);
+
+    #undef _VTK_LOG_LIMIT
+    #undef _VTK_LOG_LIMIT_2
+    #undef _VTK_LOG_LIMIT_3
+}
+
+static VTK_DeviceInfo vtk_default_device_info(VkSurfaceKHR surface) {
+    VTK_DeviceInfo info = {};
+    info.surface = surface;
+    info.type_weights[VK_PHYSICAL_DEVICE_TYPE_OTHER] = 10;
+    info.type_weights[VK_PHYSICAL_DEVICE_TYPE_INTEGRATED_GPU] = 500;
+    info.type_weights[VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU] = 1000;
+    info.type_weights[VK_PHYSICAL_DEVICE_TYPE_VIRTUAL_GPU] = 250;
+    info.type_weights[VK_PHYSICAL_DEVICE_TYPE_CPU] = 100;
+    info.instance_api_version = VK_API_VERSION_1_0;
+    info.optional_features.pipelineStatisticsQuery = VK_TRUE;
+    info.optional_features.textureCompressionBC = VK_TRUE;
+    info.optional_features.textureCompressionASTC_LDR = VK_TRUE;
+    info.optional_features.textureCompressionETC2 = VK_TRUE;
+    if (surface != VK_NULL_HANDLE)
+        ctk_push(&info.required_extensions, VK_KHR_SWAPCHAIN_EXTENSION_NAME);
+
+    ctk_push(&info.optional_extensions, VK_EXT_EXTERNAL_MEMORY_HOST_EXTENSION_NAME);
+    return info;
+}
+
+// Scores every physical device, logs the ranking and returns the best suitable one (or an override match). Software
+// rasterizers and integrated GPUs are valid picks; they just rank below discrete GPUs with the default weights. Query
+// snapshots are allocated from allocator and the selected one stays valid for as long as allocator does.
+static VTK_PhysicalDeviceCandidate vtk_select_physical_device(VkInstance instance, VTK_DeviceInfo *info,
+                                                              CTK_Allocator *allocator) {
+    u32 physical_device_count = 0;
+    CTK_StaticArray<VkPhysicalDevice, 8> physical_device_buffer = {};
+    VkPhysicalDevice *physical_devices = vtk_enumerate_vk_objects(&physical_device_buffer, allocator,
+                                                                  &physical_device_count, vkEnumeratePhysicalDevices,
+                                                                  instance);
+    if (physical_device_count == 0)
+        CTK_FATAL("failed to find any physical devices")
+
+    u32 cache_size = 0;
+    u8 *cache = info->query_cache_path ? _vtk_read_query_cache(info->query_cache_path, allocator, &cache_size) : NULL;
+    bool cache_dirty = false;
+
+    // Sized by the enumerated count, so no device is ever left out of the ranking.
+    auto queries = ctk_alloc<VTK_PhysicalDeviceQuery *>(allocator, physical_device_count);
+    auto candidates = ctk_alloc<VTK_PhysicalDeviceCandidate>(allocator, physical_device_count);
+    auto ranking = ctk_alloc<u32>(allocator, physical_device_count);
+    for (u32 i = 0; i < physical_device_count; ++i) {
+        VTK_PhysicalDeviceCandidate candidate = {};
+        candidate.query = vtk_query_physical_device(physical_devices[i], info->instance_api_version, info->surface,
+                                                    cache, cache_size, allocator);
+        cache_dirty |= !candidate.query->from_cache;
+        _vtk_score_physical_device(&candidate, info);
+        queries[i] = candidate.query;
+        candidates[i] = candidate;
+
+        if (info->log_limits) {
+            ctk_info("physical device \"%s\":", candidate.query->properties.deviceName);
+            vtk_log_device_limits(&candidate.query->properties.limits);
+        }
+
+        // Insertion sort: overrides first, then suitable devices by descending score.
+        u32 rank = i;
+        ranking[rank] = i;
+        while (rank > 0) {
+            VTK_PhysicalDeviceCandidate *prev = candidates + ranking[rank - 1];
+            VTK_PhysicalDeviceCandidate *curr = candidates + i;
+            s32 prev_key = (prev->suitable ? 1 : 0) * 2 + (prev->suitable && prev->overridden ? 1 : 0);
+            s32 curr_key = (curr->suitable ? 1 : 0) * 2 + (curr->suitable && curr->overridden ? 1 : 0);
+            if (prev_key > curr_key || (prev_key == curr_key && prev->score >= curr->score))
+                break;
+
+            ranking[rank] = ranking[rank - 1];
+            ranking[rank - 1] = i;
+            --rank;
+        }
+    }
+
+    if (info->query_cache_path && cache_dirty)
+        _vtk_write_query_cache(info->query_cache_path, queries, physical_device_count);
+
+    ctk_info("physical device ranking:");
+    for (u32 rank = 0; rank < physical_device_count; ++rank) {
+        VTK_PhysicalDeviceCandidate *candidate = candidates + ranking[rank];
+        ctk_info("    %u. \"%s\" (%s, %llu MiB local) score=%d%s%s%s", rank + 1, candidate->query->properties.deviceName,
+                 _vtk_physical_device_type_name(candidate->query->properties.deviceType),
+                 (unsigned long long)(candidate->device_local_bytes >> 20), candidate->score,
+                 candidate->suitable ? "" : " [unsuitable]", candidate->overridden ? " [override]" : "",
+                 candidate->query->from_cache ? " [cached]" : "");
+    }
+
+    if (!candidates[ranking[0]].suitable)
+        CTK_FATAL("failed to find suitable physical device")
+
+    VTK_PhysicalDeviceCandidate *selected = candidates + ranking[0];
+    if ((info->name_override || info->use_uuid_override) && !selected->overridden)
+        ctk_warning("no suitable physical device matched override, falling back to highest score");
+
+    ctk_info("selected physical device \"%s\"", selected->query->properties.deviceName);
+    return *selected;
+}
+
+static VTK_Device vtk_create_device(VkInstance instance, VTK_DeviceInfo *info, CTK_Allocator *allocator) {
+    VTK_CPU_ZONE("vtk_create_device");
+    VTK_Device device = {};
+
+    ////////////////////////////////////////////////////////////
+    /// Physical
+    ////////////////////////////////////////////////////////////
+    VTK_PhysicalDeviceCandidate selected = vtk_select_physical_device(instance, info, allocator);
+    device.query = selected.query;
+    device.physical = selected.query->handle;
+    device.properties = selected.query->properties;
+    device.api_version = selected.query->api_version;
+    device.memory_properties = selected.query->memory_properties;
+    device.queue_family_indexes = selected.queue_family_indexes;
+    device.depth_image_format = vtk_find_depth_image_format(device.physical);
+
+    // Enable required features plus whichever optional features are supported.
+    device.enabled_features = info->required_features;
+    for (s32 feature = 0; feature < VTK_PHYSICAL_DEVICE_FEATURE_COUNT; ++feature) {
+        if (vtk_physical_device_feature_supported(feature, &info->optional_features) &&
+            vtk_physical_device_feature_supported(feature, &selected.query->features)) {
+            ((VkBool32 *)&device.enabled_features)[feature] = VK_TRUE;
+        }
+    }
+
+    // Same for extended features, collecting the extensions they come from on pre-promotion devices.
+    bool all_required_supported = false;
+    VTK_FeatureChain enabled_extended_features = {};
+    vtk_init_feature_chain(&enabled_extended_features, device.api_version, device.query->extensions,
+                           device.query->extension_count);
+    enabled_extended_features.features2.features = device.enabled_features;
+    device.enabled_extended_features =
+        vtk_negotiate_extended_features(device.query->extended_features, info->required_extended_features,
+                                        info->optional_extended_features, &enabled_extended_features,
+                                        &all_required_supported);
+    vtk_trim_feature_chain(&enabled_extended_features);
+    CTK_ASSERT(all_required_supported);
+
+    CTK_StaticArray<cstr, VTK_MAX_DEVICE_EXTENSIONS> *extensions = &device.enabled_extensions;
+    for (u32 i = 0; i < info->required_extensions.count; ++i)
+        ctk_push(extensions, info->required_extensions[i]);
+
+    for (u32 i = 0; i < info->optional_extensions.count; ++i) {
+        // VK_EXT_external_memory_host depends on VK_KHR_external_memory, which is only core from 1.1.
+        cstr extension = info->optional_extensions[i];
+        if (strcmp(extension, VK_EXT_EXTERNAL_MEMORY_HOST_EXTENSION_NAME) == 0 &&
+            device.api_version < VK_API_VERSION_1_1) {
+            continue;
+        }
+
+        if (vtk_device_extension_supported(device.query, extension) &&
+            !vtk_device_extension_enabled(&device, extension)) {
+            ctk_push(extensions, extension);
+        }
+    }
+
+    for (s32 feature = 0; feature < VTK_EXTENDED_FEATURE_COUNT; ++feature) {
+        cstr extension = vtk_extended_feature_extension(device.query->extended_features, feature);
+        if (!(device.enabled_extended_features & (1ull << feature)) || !extension)
+            continue;
+
+        if (!vtk_device_extension_enabled(&device, extension))
+            ctk_push(extensions, extension);
+    }
+
+    ////////////////////////////////////////////////////////////
+    /// Logical
+    ////////////////////////////////////////////////////////////
+    VTK_QueueFamilyIndexes *indexes = &device.queue_family_indexes;
+    u32 const queue_family_idxs[] = { indexes->graphics, indexes->present, indexes->compute, indexes->transfer };
+    CTK_StaticArray<VkDeviceQueueCreateInfo, 4> queue_infos = {};
+    for (u32 i = 0; i < CTK_ARRAY_SIZE(queue_family_idxs); ++i) {
+        u32 queue_family_idx = queue_family_idxs[i];
+        bool duplicate = queue_family_idx == CTK_U32_MAX;
+        for (u32 j = 0; j < queue_infos.count && !duplicate; ++j)
+            duplicate = queue_infos[j].queueFamilyIndex == queue_family_idx;
+
+        if (!duplicate)
+            ctk_push(&queue_infos, vtk_default_queue_info(queue_family_idx));
+    }
+
+    VkDeviceCreateInfo logical_device_info = {};
+    logical_device_info.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
+    logical_device_info.flags = 0;
+    logical_device_info.queueCreateInfoCount = queue_infos.count;
+    logical_device_info.pQueueCreateInfos = queue_infos.data;
+    logical_device_info.enabledLayerCount = 0;
+    logical_device_info.ppEnabledLayerNames = NULL;
+    logical_device_info.enabledExtensionCount = extensions->count;
+    logical_device_info.ppEnabledExtensionNames = extensions->data;
+
+    // VkPhysicalDeviceFeatures2 carries the 1.0 features when the extended chain is used.
+    if (device.api_version >= VK_API_VERSION_1_1) {
+        logical_device_info.pNext = &enabled_extended_features.features2;
+        logical_device_info.pEnabledFeatures = NULL;
+    }
+    else {
+        logical_device_info.pNext = NULL;
+        logical_device_info.pEnabledFeatures = &device.enabled_features;
+    }
+
+    vtk_validate_result(vkCreateDevice(device.physical, &logical_device_info,
+                                       vtk_allocation_callbacks(), &device.logical),
+                        "failed to create logical device");
+
+    device.dispatch = vtk_load_device_dispatch(device.logical);
+    vtk_init_debug_utils(&device.dispatch);
+
+    // Get logical device queues.
+    device.dispatch.vkGetDeviceQueue(device.logical, indexes->graphics, 0, &device.queues.graphics);
+    device.dispatch.vkGetDeviceQueue(device.logical, indexes->compute, 0, &device.queues.compute);
+    device.dispatch.vkGetDeviceQueue(device.logical, indexes->transfer, 0, &device.queues.transfer);
+    if (indexes->present != CTK_U32_MAX)
+        device.dispatch.vkGetDeviceQueue(device.logical, indexes->present, 0, &device.queues.present);
+
+    // Queues may alias each other; graphics is named last so a shared queue shows up under its most general role.
+    VTK_SET_DEBUG_NAME(device.logical, VK_OBJECT_TYPE_QUEUE, device.queues.present, "present queue");
+    VTK_SET_DEBUG_NAME(device.logical, VK_OBJECT_TYPE_QUEUE, device.queues.transfer, "transfer queue");
+    VTK_SET_DEBUG_NAME(device.logical, VK_OBJECT_TYPE_QUEUE, device.queues.compute, "compute queue");
+    VTK_SET_DEBUG_NAME(device.logical, VK_OBJECT_TYPE_QUEUE, device.queues.graphics, "graphics queue");
+    VTK_SET_DEBUG_NAME(device.logical, VK_OBJECT_TYPE_DEVICE, device.logical, device.properties.deviceName);
+
+    return device;
+}
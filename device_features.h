@@ -1,5 +1,7 @@
 #pragma once
 
+#include <stddef.h>
+#include <string.h>
 #include <vulkan/vulkan.h>
 #include "ctk/ctk.h"
 
@@ -135,3 +137,265 @@ static bool vtk_physical_device_feature_supported(s32 device_feature, VkPhysical
     CTK_ASSERT(device_feature < VTK_PHYSICAL_DEVICE_FEATURE_COUNT);
     return ((VkBool32 *)physical_device_features)[device_feature];
 }
+
+////////////////////////////////////////////////////////////
+/// Extended Features
+////////////////////////////////////////////////////////////
+
+// Features beyond VkPhysicalDeviceFeatures: X(FEATURE, CORE_STRUCT, EXTENSION_STRUCT, EXTENSION_NAME). Each feature is
+// read from the VkPhysicalDeviceVulkan1XFeatures struct when the device's API version includes it, and from the
+// extension's own feature struct otherwise.
+#define VTK_EXTENDED_FEATURES(X)\
+    X(storageBuffer16BitAccess, vulkan11, storage_16bit, VK_KHR_16BIT_STORAGE_EXTENSION_NAME)\
+    X(multiview, vulkan11, multiview, VK_KHR_MULTIVIEW_EXTENSION_NAME)\
+    X(shaderSampledImageArrayNonUniformIndexing, vulkan12, descriptor_indexing, VK_EXT_DESCRIPTOR_INDEXING_EXTENSION_NAME)\
+    X(descriptorBindingSampledImageUpdateAfterBind, vulkan12, descriptor_indexing, VK_EXT_DESCRIPTOR_INDEXING_EXTENSION_NAME)\
+    X(descriptorBindingPartiallyBound, vulkan12, descriptor_indexing, VK_EXT_DESCRIPTOR_INDEXING_EXTENSION_NAME)\
+    X(descriptorBindingVariableDescriptorCount, vulkan12, descriptor_indexing, VK_EXT_DESCRIPTOR_INDEXING_EXTENSION_NAME)\
+    X(runtimeDescriptorArray, vulkan12, descriptor_indexing, VK_EXT_DESCRIPTOR_INDEXING_EXTENSION_NAME)\
+    X(scalarBlockLayout, vulkan12, scalar_block_layout, VK_EXT_SCALAR_BLOCK_LAYOUT_EXTENSION_NAME)\
+    X(hostQueryReset, vulkan12, host_query_reset, VK_EXT_HOST_QUERY_RESET_EXTENSION_NAME)\
+    X(timelineSemaphore, vulkan12, timeline_semaphore, VK_KHR_TIMELINE_SEMAPHORE_EXTENSION_NAME)\
+    X(bufferDeviceAddress, vulkan12, buffer_device_address, VK_KHR_BUFFER_DEVICE_ADDRESS_EXTENSION_NAME)\
+    X(synchronization2, vulkan13, synchronization2, VK_KHR_SYNCHRONIZATION_2_EXTENSION_NAME)\
+    X(dynamicRendering, vulkan13, dynamic_rendering, VK_KHR_DYNAMIC_RENDERING_EXTENSION_NAME)\
+    X(maintenance4, vulkan13, maintenance4, VK_KHR_MAINTENANCE_4_EXTENSION_NAME)
+
+#define _VTK_EXTENDED_FEATURE_ENUM(FEATURE, CORE, EXT, EXTENSION_NAME) VTK_EXTENDED_FEATURE_ ## FEATURE,
+
+enum {
+    VTK_EXTENDED_FEATURES(_VTK_EXTENDED_FEATURE_ENUM)
+    VTK_EXTENDED_FEATURE_COUNT,
+};
+
+#define VTK_EXTENDED_FEATURE_BIT(FEATURE) (1ull << VTK_EXTENDED_FEATURE_ ## FEATURE)
+
+// All feature structs vtk knows about. Only structs that apply to the device (by API version or supported extension) are
+// linked into the pNext chain; unlinked structs keep sType == 0. The chain points into itself, so it must not be copied
+// once initialized.
+struct VTK_FeatureChain {
+    VkPhysicalDeviceFeatures2 features2;
+    VkPhysicalDeviceVulkan11Features vulkan11;
+    VkPhysicalDeviceVulkan12Features vulkan12;
+    VkPhysicalDeviceVulkan13Features vulkan13;
+    VkPhysicalDevice16BitStorageFeatures storage_16bit;
+    VkPhysicalDeviceMultiviewFeatures multiview;
+    VkPhysicalDeviceDescriptorIndexingFeatures descriptor_indexing;
+    VkPhysicalDeviceScalarBlockLayoutFeatures scalar_block_layout;
+    VkPhysicalDeviceHostQueryResetFeatures host_query_reset;
+    VkPhysicalDeviceTimelineSemaphoreFeatures timeline_semaphore;
+    VkPhysicalDeviceBufferDeviceAddressFeatures buffer_device_address;
+    VkPhysicalDeviceSynchronization2Features synchronization2;
+    VkPhysicalDeviceDynamicRenderingFeatures dynamic_rendering;
+    VkPhysicalDeviceMaintenance4Features maintenance4;
+
+    // Version the chain was initialized for; features promoted at or below it need no extension.
+    u32 api_version;
+};
+
+struct _VTK_ExtendedFeatureInfo {
+    cstr name;
+    cstr extension_name;
+    u32 core_version;
+    u32 core_struct_offset;
+    u32 core_member_offset;
+    u32 ext_struct_offset;
+    u32 ext_member_offset;
+};
+
+#define _VTK_CORE_VERSION_vulkan11 VK_API_VERSION_1_1
+#define _VTK_CORE_VERSION_vulkan12 VK_API_VERSION_1_2
+#define _VTK_CORE_VERSION_vulkan13 VK_API_VERSION_1_3
+
+#define _VTK_EXTENDED_FEATURE_INFO(FEATURE, CORE, EXT, EXTENSION_NAME)\
+    {\
+        #FEATURE,\
+        EXTENSION_NAME,\
+        _VTK_CORE_VERSION_ ## CORE,\
+        offsetof(VTK_FeatureChain, CORE),\
+        offsetof(VTK_FeatureChain, CORE.FEATURE),\
+        offsetof(VTK_FeatureChain, EXT),\
+        offsetof(VTK_FeatureChain, EXT.FEATURE),\
+    },
+
+static _VTK_ExtendedFeatureInfo const _VTK_EXTENDED_FEATURE_INFOS[] = {
+    VTK_EXTENDED_FEATURES(_VTK_EXTENDED_FEATURE_INFO)
+};
+
+////////////////////////////////////////////////////////////
+/// Extended Features Internal
+////////////////////////////////////////////////////////////
+static bool _vtk_extension_listed(cstr extension_name, VkExtensionProperties *extensions, u32 extension_count) {
+    for (u32 i = 0; i < extension_count; ++i) {
+        if (strcmp(extension_name, extensions[i].extensionName) == 0)
+            return true;
+    }
+
+    return false;
+}
+
+static void _vtk_link_feature_struct(void **tail, void *feature_struct, VkStructureType type) {
+    auto base = (VkBaseOutStructure *)feature_struct;
+    base->sType = type;
+    base->pNext = NULL;
+    ((VkBaseOutStructure *)*tail)->pNext = base;
+    *tail = base;
+}
+
+static bool _vtk_feature_struct_linked(VTK_FeatureChain *chain, u32 struct_offset) {
+    return ((VkBaseOutStructure *)((u8 *)chain + struct_offset))->sType != 0;
+}
+
+////////////////////////////////////////////////////////////
+/// Extended Features Interface
+////////////////////////////////////////////////////////////
+static cstr vtk_extended_feature_name(s32 extended_feature) {
+    CTK_ASSERT(extended_feature < VTK_EXTENDED_FEATURE_COUNT);
+    return _VTK_EXTENDED_FEATURE_INFOS[extended_feature].name;
+}
+
+// Links the structs that apply to api_version and the given extensions. api_version must already be clamped to the
+// instance's version: the chain may only be queried with vkGetPhysicalDeviceFeatures2 when it is 1.1 or later. Core
+// VkPhysicalDeviceVulkan1XFeatures structs are used when the version includes them; the spec forbids chaining them
+// alongside the promoted extension structs, so those are only linked for versions that predate promotion.
+// VkPhysicalDeviceVulkan11Features only exists from 1.2, so 1.1 links the promoted 1.1 structs as core structs instead.
+static void vtk_init_feature_chain(VTK_FeatureChain *chain, u32 api_version, VkExtensionProperties *extensions,
+                                   u32 extension_count) {
+    *chain = {};
+    chain->api_version = api_version;
+    chain->features2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+    void *tail = &chain->features2;
+
+    #define _VTK_LINK_EXTENSION_STRUCT(MEMBER, TYPE, EXTENSION_NAME)\
+        if (_vtk_extension_listed(EXTENSION_NAME, extensions, extension_count))\
+            _vtk_link_feature_struct(&tail, &chain->MEMBER, TYPE);
+
+    if (api_version >= VK_API_VERSION_1_2) {
+        _vtk_link_feature_struct(&tail, &chain->vulkan11, VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_1_FEATURES);
+    }
+    else if (api_version >= VK_API_VERSION_1_1) {
+        _vtk_link_feature_struct(&tail, &chain->storage_16bit,
+                                 VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_16BIT_STORAGE_FEATURES);
+        _vtk_link_feature_struct(&tail, &chain->multiview, VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MULTIVIEW_FEATURES);
+    }
+    else {
+        _VTK_LINK_EXTENSION_STRUCT(storage_16bit, VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_16BIT_STORAGE_FEATURES,
+                                   VK_KHR_16BIT_STORAGE_EXTENSION_NAME)
+        _VTK_LINK_EXTENSION_STRUCT(multiview, VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MULTIVIEW_FEATURES,
+                                   VK_KHR_MULTIVIEW_EXTENSION_NAME)
+    }
+
+    if (api_version >= VK_API_VERSION_1_2) {
+        _vtk_link_feature_struct(&tail, &chain->vulkan12, VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES);
+    }
+    else {
+        _VTK_LINK_EXTENSION_STRUCT(descriptor_indexing, VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_FEATURES,
+                                   VK_EXT_DESCRIPTOR_INDEXING_EXTENSION_NAME)
+        _VTK_LINK_EXTENSION_STRUCT(scalar_block_layout, VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_SCALAR_BLOCK_LAYOUT_FEATURES,
+                                   VK_EXT_SCALAR_BLOCK_LAYOUT_EXTENSION_NAME)
+        _VTK_LINK_EXTENSION_STRUCT(host_query_reset, VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_HOST_QUERY_RESET_FEATURES,
+                                   VK_EXT_HOST_QUERY_RESET_EXTENSION_NAME)
+        _VTK_LINK_EXTENSION_STRUCT(timeline_semaphore, VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_TIMELINE_SEMAPHORE_FEATURES,
+                                   VK_KHR_TIMELINE_SEMAPHORE_EXTENSION_NAME)
+        _VTK_LINK_EXTENSION_STRUCT(buffer_device_address,
+                                   VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_BUFFER_DEVICE_ADDRESS_FEATURES,
+                                   VK_KHR_BUFFER_DEVICE_ADDRESS_EXTENSION_NAME)
+    }
+
+    if (api_version >= VK_API_VERSION_1_3) {
+        _vtk_link_feature_struct(&tail, &chain->vulkan13, VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_3_FEATURES);
+    }
+    else {
+        _VTK_LINK_EXTENSION_STRUCT(synchronization2, VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_SYNCHRONIZATION_2_FEATURES,
+                                   VK_KHR_SYNCHRONIZATION_2_EXTENSION_NAME)
+        // VK_KHR_dynamic_rendering depends on VK_KHR_depth_stencil_resolve and VK_KHR_create_renderpass2, which are
+        // only core from 1.2, so it isn't offered below that. The other extensions here only depend on 1.1
+        // functionality.
+        if (api_version >= VK_API_VERSION_1_2) {
+            _VTK_LINK_EXTENSION_STRUCT(dynamic_rendering, VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DYNAMIC_RENDERING_FEATURES,
+                                       VK_KHR_DYNAMIC_RENDERING_EXTENSION_NAME)
+        }
+
+        _VTK_LINK_EXTENSION_STRUCT(maintenance4, VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MAINTENANCE_4_FEATURES,
+                                   VK_KHR_MAINTENANCE_4_EXTENSION_NAME)
+    }
+
+    #undef _VTK_LINK_EXTENSION_STRUCT
+}
+
+// Returns the feature's VkBool32 in whichever linked struct provides it, or NULL if the device can't expose it.
+static VkBool32 *vtk_extended_feature(VTK_FeatureChain *chain, s32 extended_feature) {
+    CTK_ASSERT(extended_feature < VTK_EXTENDED_FEATURE_COUNT);
+    _VTK_ExtendedFeatureInfo const *info = _VTK_EXTENDED_FEATURE_INFOS + extended_feature;
+    if (_vtk_feature_struct_linked(chain, info->core_struct_offset))
+        return (VkBool32 *)((u8 *)chain + info->core_member_offset);
+
+    if (_vtk_feature_struct_linked(chain, info->ext_struct_offset))
+        return (VkBool32 *)((u8 *)chain + info->ext_member_offset);
+
+    return NULL;
+}
+
+static bool vtk_extended_feature_supported(VTK_FeatureChain *chain, s32 extended_feature) {
+    VkBool32 *feature = vtk_extended_feature(chain, extended_feature);
+    return feature && *feature;
+}
+
+// Extension that must be enabled for extended_feature on this chain, or NULL if the chain's version includes it.
+static cstr vtk_extended_feature_extension(VTK_FeatureChain *chain, s32 extended_feature) {
+    CTK_ASSERT(extended_feature < VTK_EXTENDED_FEATURE_COUNT);
+    _VTK_ExtendedFeatureInfo const *info = _VTK_EXTENDED_FEATURE_INFOS + extended_feature;
+    return chain->api_version >= info->core_version ? NULL : info->extension_name;
+}
+
+// Unlinks extension feature structs with no feature enabled, so a chain passed to vkCreateDevice only references
+// extensions that are actually being enabled. Core VkPhysicalDeviceVulkan1XFeatures structs are always kept.
+static void vtk_trim_feature_chain(VTK_FeatureChain *chain) {
+    auto prev = (VkBaseOutStructure *)&chain->features2;
+    while (prev->pNext) {
+        VkBaseOutStructure *curr = prev->pNext;
+        bool core = curr == (VkBaseOutStructure *)&chain->vulkan11 ||
+                    curr == (VkBaseOutStructure *)&chain->vulkan12 ||
+                    curr == (VkBaseOutStructure *)&chain->vulkan13;
+        bool any_enabled = false;
+        for (s32 feature = 0; feature < VTK_EXTENDED_FEATURE_COUNT && !core && !any_enabled; ++feature) {
+            _VTK_ExtendedFeatureInfo const *info = _VTK_EXTENDED_FEATURE_INFOS + feature;
+            if ((u8 *)chain + info->ext_struct_offset == (u8 *)curr)
+                any_enabled = *(VkBool32 *)((u8 *)chain + info->ext_member_offset) == VK_TRUE;
+        }
+
+        if (core || any_enabled) {
+            prev = curr;
+        }
+        else {
+            prev->pNext = curr->pNext;
+            curr->sType = (VkStructureType)0;
+            curr->pNext = NULL;
+        }
+    }
+}
+
+// Diffs required/optional feature masks (VTK_EXTENDED_FEATURE_BIT) against supported and writes the features to enable
+// into enabled, which must have been initialized with the same version and extensions as supported. Returns the
+// enabled mask; missing required features are logged and reported through all_required_supported.
+static u64 vtk_negotiate_extended_features(VTK_FeatureChain *supported, u64 required, u64 optional,
+                                           VTK_FeatureChain *enabled, bool *all_required_supported) {
+    *all_required_supported = true;
+    u64 enabled_mask = 0;
+    for (s32 feature = 0; feature < VTK_EXTENDED_FEATURE_COUNT; ++feature) {
+        u64 bit = 1ull << feature;
+        if (!((required | optional) & bit))
+            continue;
+
+        if (vtk_extended_feature_supported(supported, feature)) {
+            *vtk_extended_feature(enabled, feature) = VK_TRUE;
+            enabled_mask |= bit;
+        }
+        else if (required & bit) {
+            ctk_error("required device feature \"%s\" not supported", vtk_extended_feature_name(feature));
+            *all_required_supported = false;
+        }
+    }
+
+    return enabled_mask;
+}
@@ -0,0 +1,766 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include "ctk/ctk.h"
+#include "vtk/vtk.h"
+#include "vtk/device.h"
+#include "vtk/memory_budget.h"
+#include "vtk/memory_types.h"
+#include "vtk/debug_utils.h"
+
+////////////////////////////////////////////////////////////
+/// Data
+////////////////////////////////////////////////////////////
+static u32 const VTK_MAX_MEMORY_BLOCKS = 256;
+static u32 const VTK_MAX_DEVICE_ALLOCATIONS = 8192;
+static u32 const VTK_MAX_BLOCK_ALLOCATIONS = 512;
+static u32 const VTK_MAX_DESCRIPTOR_REFERENCES = 4096;
+static u32 const VTK_NULL_ALLOCATION = CTK_U32_MAX;
+
+// Sub-allocated VkDeviceMemory. Buffers and optimal-tiling images never share a block, so bufferImageGranularity
+// doesn't need to be considered when placing allocations.
+struct VTK_MemoryBlock {
+    VkDeviceMemory memory;
+    VkDeviceSize size;
+    VkDeviceSize used;
+    u32 memory_type_index;
+    u8 *mapped; // Persistently mapped if the memory type is host-visible.
+    bool optimal;
+    bool dedicated; // Holds exactly one allocation; never shared or used as a defragmentation target.
+
+    // Sorted by offset.
+    CTK_StaticArray<u32, VTK_MAX_BLOCK_ALLOCATIONS> allocations;
+};
+
+struct VTK_DeviceAllocation {
+    u32 block_index;
+    VkDeviceSize offset;
+    VkDeviceSize size;
+    VkDeviceSize alignment;
+    u32 memory_type_index;
+    u8 *mapped;
+
+    // Set for buffers created through vtk_create_allocated_buffer(); only these can be moved by the defragmenter.
+    VkBuffer buffer;
+    VkBufferCreateInfo buffer_info;
+    VkImage image; // Set for images created through vtk_create_allocated_image().
+    cstr debug_name;
+
+    bool used;
+    bool movable;
+    u32 next_free;
+};
+
+// Descriptor writes that reference an allocation's buffer; re-written when the defragmenter moves it.
+struct VTK_DescriptorReference {
+    u32 allocation;
+    VkDescriptorSet set;
+    u32 binding;
+    u32 array_element;
+    VkDescriptorType type;
+    VkDeviceSize offset;
+    VkDeviceSize range;
+};
+
+// Called after an allocation has moved (new buffer, offset and mapping already in place) for owners that cache any of
+// them outside of registered descriptor references.
+typedef void (*VTK_AllocationMoveCallback)(void *user_data, u32 allocation, VTK_DeviceAllocation *moved);
+
+struct VTK_DeviceMemoryAllocator {
+    VkDevice logical_device;
+    VkPhysicalDeviceMemoryProperties memory_properties;
+    VTK_MemoryBudget *budget;
+    VkDeviceSize block_size;
+    bool dedicated_allocation; // VkMemoryDedicatedAllocateInfo available (Vulkan 1.1).
+    CTK_StaticArray<VTK_MemoryBlock, VTK_MAX_MEMORY_BLOCKS> blocks;
+    VTK_DeviceAllocation allocations[VTK_MAX_DEVICE_ALLOCATIONS];
+    u32 allocation_count;
+    u32 free_allocation;
+    CTK_StaticArray<VTK_DescriptorReference, VTK_MAX_DESCRIPTOR_REFERENCES> descriptor_references;
+    VTK_AllocationMoveCallback move_callback;
+    void *move_user_data;
+};
+
+////////////////////////////////////////////////////////////
+/// Internal
+////////////////////////////////////////////////////////////
+static VkDeviceSize _vtk_align_up(VkDeviceSize value, VkDeviceSize alignment) {
+    return (value + alignment - 1) & ~(alignment - 1);
+}
+
+static u32 _vtk_new_allocation(VTK_DeviceMemoryAllocator *allocator) {
+    u32 allocation_index = allocator->free_allocation;
+    if (allocation_index != VTK_NULL_ALLOCATION) {
+        allocator->free_allocation = allocator->allocations[allocation_index].next_free;
+    }
+    else {
+        if (allocator->allocation_count == VTK_MAX_DEVICE_ALLOCATIONS)
+            CTK_FATAL("device memory allocator cannot track more than %u allocations", VTK_MAX_DEVICE_ALLOCATIONS)
+
+        allocation_index = allocator->allocation_count++;
+    }
+
+    allocator->allocations[allocation_index] = {};
+    allocator->allocations[allocation_index].used = true;
+    allocator->allocations[allocation_index].next_free = VTK_NULL_ALLOCATION;
+    return allocation_index;
+}
+
+static void _vtk_release_allocation(VTK_DeviceMemoryAllocator *allocator, u32 allocation_index) {
+    VTK_DeviceAllocation *allocation = allocator->allocations + allocation_index;
+    allocation->used = false;
+    allocation->next_free = allocator->free_allocation;
+    allocator->free_allocation = allocation_index;
+}
+
+// First fit; returns CTK_U32_MAX if there's no gap large enough, otherwise the insertion index in block->allocations.
+static u32 _vtk_find_block_gap(VTK_DeviceMemoryAllocator *allocator, VTK_MemoryBlock *block, VkDeviceSize size,
+                               VkDeviceSize alignment, VkDeviceSize *offset) {
+    if (block->allocations.count == VTK_MAX_BLOCK_ALLOCATIONS || block->size - block->used < size)
+        return CTK_U32_MAX;
+
+    VkDeviceSize gap_start = 0;
+    for (u32 i = 0; i <= block->allocations.count; ++i) {
+        VkDeviceSize gap_end = block->size;
+        if (i < block->allocations.count)
+            gap_end = allocator->allocations[block->allocations[i]].offset;
+
+        VkDeviceSize aligned_start = _vtk_align_up(gap_start, alignment);
+        if (aligned_start + size <= gap_end) {
+            *offset = aligned_start;
+            return i;
+        }
+
+        if (i < block->allocations.count) {
+            VTK_DeviceAllocation *allocation = allocator->allocations + block->allocations[i];
+            gap_start = allocation->offset + allocation->size;
+        }
+    }
+
+    return CTK_U32_MAX;
+}
+
+static void _vtk_place_allocation(VTK_DeviceMemoryAllocator *allocator, u32 block_index, u32 insert_index,
+                                  u32 allocation_index, VkDeviceSize offset) {
+    VTK_MemoryBlock *block = allocator->blocks + block_index;
+    VTK_DeviceAllocation *allocation = allocator->allocations + allocation_index;
+    allocation->block_index = block_index;
+    allocation->offset = offset;
+    allocation->memory_type_index = block->memory_type_index;
+    allocation->mapped = block->mapped ? block->mapped + offset : NULL;
+
+    for (u32 i = block->allocations.count; i > insert_index; --i)
+        block->allocations[i] = block->allocations[i - 1];
+
+    block->allocations[insert_index] = allocation_index;
+    ++block->allocations.count;
+    block->used += allocation->size;
+}
+
+static void _vtk_remove_from_block(VTK_DeviceMemoryAllocator *allocator, u32 allocation_index) {
+    VTK_DeviceAllocation *allocation = allocator->allocations + allocation_index;
+    VTK_MemoryBlock *block = allocator->blocks + allocation->block_index;
+    u32 i = 0;
+    while (block->allocations[i] != allocation_index)
+        ++i;
+
+    for (; i + 1 < block->allocations.count; ++i)
+        block->allocations[i] = block->allocations[i + 1];
+
+    --block->allocations.count;
+    block->used -= allocation->size;
+}
+
+// dedicated_image/dedicated_buffer (at most one) are only given for dedicated blocks.
+static u32 _vtk_create_memory_block(VTK_DeviceMemoryAllocator *allocator, u32 memory_type_index, VkDeviceSize size,
+                                    bool optimal, bool dedicated = false, VkImage dedicated_image = VK_NULL_HANDLE,
+                                    VkBuffer dedicated_buffer = VK_NULL_HANDLE) {
+    // Reuse a released slot before growing.
+    u32 block_index = 0;
+    while (block_index < allocator->blocks.count && allocator->blocks[block_index].memory != VK_NULL_HANDLE)
+        ++block_index;
+
+    if (block_index == VTK_MAX_MEMORY_BLOCKS)
+        CTK_FATAL("device memory allocator cannot create more than %u blocks", VTK_MAX_MEMORY_BLOCKS)
+
+    VkMemoryAllocateInfo info = {};
+    info.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+    info.allocationSize = size;
+    info.memoryTypeIndex = memory_type_index;
+    VkMemoryDedicatedAllocateInfo dedicated_info = {};
+    dedicated_info.sType = VK_STRUCTURE_TYPE_MEMORY_DEDICATED_ALLOCATE_INFO;
+    dedicated_info.image = dedicated_image;
+    dedicated_info.buffer = dedicated_buffer;
+    if (dedicated && allocator->dedicated_allocation)
+        info.pNext = &dedicated_info;
+
+    VkDeviceMemory memory = VK_NULL_HANDLE;
+    VkResult result = allocator->budget
+                      ? vtk_allocate_device_memory(allocator->budget, allocator->logical_device, &info, &memory)
+                      : vkAllocateMemory(allocator->logical_device, &info, vtk_allocation_callbacks(), &memory);
+    if (result != VK_SUCCESS)
+        return CTK_U32_MAX;
+
+    if (block_index == allocator->blocks.count)
+        ++allocator->blocks.count;
+
+    VTK_MemoryBlock *block = allocator->blocks + block_index;
+    *block = {};
+    block->memory = memory;
+    block->size = size;
+    block->memory_type_index = memory_type_index;
+    block->optimal = optimal;
+    block->dedicated = dedicated;
+    VkMemoryPropertyFlags property_flags = allocator->memory_properties.memoryTypes[memory_type_index].propertyFlags;
+    if (property_flags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) {
+        vtk_validate_result(vkMapMemory(allocator->logical_device, memory, 0, VK_WHOLE_SIZE, 0,
+                                        (void **)&block->mapped),
+                            "failed to map device memory block");
+    }
+
+    return block_index;
+}
+
+static void _vtk_destroy_memory_block(VTK_DeviceMemoryAllocator *allocator, u32 block_index) {
+    VTK_MemoryBlock *block = allocator->blocks + block_index;
+    if (block->mapped)
+        vkUnmapMemory(allocator->logical_device, block->memory);
+
+    if (allocator->budget) {
+        vtk_free_device_memory(allocator->budget, allocator->logical_device, block->memory, block->memory_type_index,
+                               block->size);
+    }
+    else {
+        vkFreeMemory(allocator->logical_device, block->memory, vtk_allocation_callbacks());
+    }
+
+    *block = {};
+}
+
+////////////////////////////////////////////////////////////
+/// Interface
+////////////////////////////////////////////////////////////
+
+// budget is optional; when given, blocks are allocated through it so they're tracked and can trigger eviction.
+static void vtk_init_device_memory_allocator(VTK_DeviceMemoryAllocator *allocator, VTK_Device *device,
+                                             VTK_MemoryBudget *budget, VkDeviceSize block_size) {
+    allocator->logical_device = device->logical;
+    allocator->memory_properties = device->memory_properties;
+    allocator->budget = budget;
+    allocator->block_size = block_size;
+    allocator->dedicated_allocation = device->api_version >= VK_API_VERSION_1_1;
+    allocator->blocks.count = 0;
+    allocator->allocation_count = 0;
+    allocator->free_allocation = VTK_NULL_ALLOCATION;
+    allocator->descriptor_references.count = 0;
+    allocator->move_callback = NULL;
+    allocator->move_user_data = NULL;
+}
+
+static void vtk_destroy_device_memory_allocator(VTK_DeviceMemoryAllocator *allocator) {
+    for (u32 i = 0; i < allocator->allocation_count; ++i) {
+        VTK_DeviceAllocation *allocation = allocator->allocations + i;
+        if (!allocation->used)
+            continue;
+
+        if (allocation->buffer != VK_NULL_HANDLE)
+            vkDestroyBuffer(allocator->logical_device, allocation->buffer, vtk_allocation_callbacks());
+
+        if (allocation->image != VK_NULL_HANDLE)
+            vkDestroyImage(allocator->logical_device, allocation->image, vtk_allocation_callbacks());
+    }
+
+    for (u32 i = 0; i < allocator->blocks.count; ++i) {
+        if (allocator->blocks[i].memory != VK_NULL_HANDLE)
+            _vtk_destroy_memory_block(allocator, i);
+    }
+}
+
+// Sub-allocates from an existing block of memory_type_index or a new one. optimal must be set for optimal-tiling
+// images. Returns VTK_NULL_ALLOCATION if device memory is exhausted.
+static u32 vtk_allocate_device_region(VTK_DeviceMemoryAllocator *allocator, VkMemoryRequirements requirements,
+                                      u32 memory_type_index, bool optimal) {
+    CTK_ASSERT(requirements.memoryTypeBits & (1u << memory_type_index));
+    u32 allocation_index = _vtk_new_allocation(allocator);
+    VTK_DeviceAllocation *allocation = allocator->allocations + allocation_index;
+    allocation->size = requirements.size;
+    allocation->alignment = requirements.alignment;
+
+    for (u32 block_index = 0; block_index < allocator->blocks.count; ++block_index) {
+        VTK_MemoryBlock *block = allocator->blocks + block_index;
+        if (block->memory == VK_NULL_HANDLE || block->dedicated || block->memory_type_index != memory_type_index ||
+            block->optimal != optimal) {
+            continue;
+        }
+
+        VkDeviceSize offset = 0;
+        u32 insert_index = _vtk_find_block_gap(allocator, block, requirements.size, requirements.alignment, &offset);
+        if (insert_index != CTK_U32_MAX) {
+            _vtk_place_allocation(allocator, block_index, insert_index, allocation_index, offset);
+            return allocation_index;
+        }
+    }
+
+    VkDeviceSize block_size = requirements.size > allocator->block_size ? requirements.size : allocator->block_size;
+    u32 block_index = _vtk_create_memory_block(allocator, memory_type_index, block_size, optimal);
+    if (block_index == CTK_U32_MAX) {
+        _vtk_release_allocation(allocator, allocation_index);
+        return VTK_NULL_ALLOCATION;
+    }
+
+    _vtk_place_allocation(allocator, block_index, 0, allocation_index, 0);
+    return allocation_index;
+}
+
+// Gives the resource its own VkDeviceMemory. image or buffer (at most one) is the resource that will be bound, passed
+// to the driver through VkMemoryDedicatedAllocateInfo. Returns VTK_NULL_ALLOCATION if device memory is exhausted.
+static u32 vtk_allocate_dedicated_device_region(VTK_DeviceMemoryAllocator *allocator,
+                                                VkMemoryRequirements requirements, u32 memory_type_index,
+                                                bool optimal, VkImage image, VkBuffer buffer) {
+    CTK_ASSERT(requirements.memoryTypeBits & (1u << memory_type_index));
+    CTK_ASSERT(image == VK_NULL_HANDLE || buffer == VK_NULL_HANDLE);
+    u32 block_index = _vtk_create_memory_block(allocator, memory_type_index, requirements.size, optimal, true, image,
+                                               buffer);
+    if (block_index == CTK_U32_MAX)
+        return VTK_NULL_ALLOCATION;
+
+    u32 allocation_index = _vtk_new_allocation(allocator);
+    VTK_DeviceAllocation *allocation = allocator->allocations + allocation_index;
+    allocation->size = requirements.size;
+    allocation->alignment = requirements.alignment;
+    _vtk_place_allocation(allocator, block_index, 0, allocation_index, 0);
+    return allocation_index;
+}
+
+// Releases the region (and the buffer or image, for allocations made through vtk_create_allocated_buffer() or
+// vtk_create_allocated_image()). Returns the size
+// of the block that was released if this emptied it, otherwise 0. The caller must ensure the GPU is done with it.
+static VkDeviceSize vtk_free_device_region(VTK_DeviceMemoryAllocator *allocator, u32 allocation_index) {
+    VTK_DeviceAllocation *allocation = allocator->allocations + allocation_index;
+    CTK_ASSERT(allocation->used);
+    if (allocation->buffer != VK_NULL_HANDLE)
+        vkDestroyBuffer(allocator->logical_device, allocation->buffer, vtk_allocation_callbacks());
+
+    if (allocation->image != VK_NULL_HANDLE)
+        vkDestroyImage(allocator->logical_device, allocation->image, vtk_allocation_callbacks());
+
+    // Drop descriptor references to it.
+    for (u32 i = 0; i < allocator->descriptor_references.count;) {
+        if (allocator->descriptor_references[i].allocation == allocation_index)
+            allocator->descriptor_references[i] =
+                allocator->descriptor_references[--allocator->descriptor_references.count];
+        else
+            ++i;
+    }
+
+    u32 block_index = allocation->block_index;
+    _vtk_remove_from_block(allocator, allocation_index);
+    _vtk_release_allocation(allocator, allocation_index);
+
+    VTK_MemoryBlock *block = allocator->blocks + block_index;
+    if (block->allocations.count > 0)
+        return 0;
+
+    VkDeviceSize block_size = block->size;
+    _vtk_destroy_memory_block(allocator, block_index);
+    return block_size;
+}
+
+// Tries the best memory type for intent first, then the rest in rank order, so an exhausted heap falls back to the next
+// suitable one (e.g. BAR to plain host-visible memory for DYNAMIC data).
+static u32 _vtk_allocate_for_intent(VTK_DeviceMemoryAllocator *allocator, VTK_MemoryTypeSelector *selector,
+                                    VTK_MemoryRequirements *requirements, s32 intent, bool optimal, bool dedicated,
+                                    VkImage image, VkBuffer buffer) {
+    u32 memory_type_bits = requirements->requirements.memoryTypeBits;
+    u32 best_type_index = vtk_select_memory_type(selector, memory_type_bits, intent);
+    if (best_type_index == CTK_U32_MAX)
+        CTK_FATAL("no memory type in 0x%x satisfies memory intent %d", memory_type_bits, intent)
+
+    for (u32 i = 0; i <= selector->ranked_type_counts[intent]; ++i) {
+        u32 type_index = i == 0 ? best_type_index : selector->ranked_types[intent][i - 1];
+        if ((i > 0 && type_index == best_type_index) || !(memory_type_bits & (1u << type_index)))
+            continue;
+
+        u32 allocation_index = dedicated
+                               ? vtk_allocate_dedicated_device_region(allocator, requirements->requirements,
+                                                                      type_index, optimal, image, buffer)
+                               : vtk_allocate_device_region(allocator, requirements->requirements, type_index,
+                                                            optimal);
+        if (allocation_index != VTK_NULL_ALLOCATION)
+            return allocation_index;
+    }
+
+    return VTK_NULL_ALLOCATION;
+}
+
+static VkBuffer _vtk_create_buffer(VTK_DeviceMemoryAllocator *allocator, VkBufferCreateInfo *info, bool movable,
+                                   VkBufferCreateInfo *buffer_info) {
+    *buffer_info = *info;
+    if (movable) {
+        CTK_ASSERT(buffer_info->sharingMode == VK_SHARING_MODE_EXCLUSIVE && buffer_info->pNext == NULL);
+        buffer_info->usage |= VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+    }
+
+    VkBuffer buffer = VK_NULL_HANDLE;
+    vtk_validate_result(vkCreateBuffer(allocator->logical_device, buffer_info, vtk_allocation_callbacks(), &buffer),
+                        "failed to create buffer");
+    return buffer;
+}
+
+static void _vtk_bind_buffer_allocation(VTK_DeviceMemoryAllocator *allocator, u32 allocation_index, VkBuffer buffer,
+                                        VkBufferCreateInfo *buffer_info, bool movable, cstr debug_name) {
+    VTK_DeviceAllocation *allocation = allocator->allocations + allocation_index;
+    vtk_validate_result(vkBindBufferMemory(allocator->logical_device, buffer,
+                                           allocator->blocks[allocation->block_index].memory, allocation->offset),
+                        "failed to bind buffer memory");
+    allocation->buffer = buffer;
+    allocation->buffer_info = *buffer_info;
+    allocation->movable = movable;
+    allocation->debug_name = debug_name;
+    VTK_SET_DEBUG_NAME(allocator->logical_device, VK_OBJECT_TYPE_BUFFER, buffer, debug_name);
+}
+
+// movable buffers get TRANSFER_SRC/DST usage added so the defragmenter can copy them; they must use exclusive sharing.
+static u32 vtk_create_allocated_buffer(VTK_DeviceMemoryAllocator *allocator, VkBufferCreateInfo *info,
+                                       u32 memory_type_index, bool movable, cstr debug_name = NULL) {
+    VkBufferCreateInfo buffer_info = {};
+    VkBuffer buffer = _vtk_create_buffer(allocator, info, movable, &buffer_info);
+    VkMemoryRequirements requirements = {};
+    vkGetBufferMemoryRequirements(allocator->logical_device, buffer, &requirements);
+    u32 allocation_index = vtk_allocate_device_region(allocator, requirements, memory_type_index, false);
+    if (allocation_index == VTK_NULL_ALLOCATION) {
+        vkDestroyBuffer(allocator->logical_device, buffer, vtk_allocation_callbacks());
+        return VTK_NULL_ALLOCATION;
+    }
+
+    _vtk_bind_buffer_allocation(allocator, allocation_index, buffer, &buffer_info, movable, debug_name);
+    return allocation_index;
+}
+
+// Same as above with the memory type chosen by selector for intent. Buffers the driver wants dedicated memory for (or
+// that are large enough) get their own allocation and are never movable. DYNAMIC buffers land in BAR memory when the
+// device has it; check vtk_memory_type_needs_staging() on the allocation's memory type before writing directly.
+static u32 vtk_create_allocated_buffer(VTK_DeviceMemoryAllocator *allocator, VTK_MemoryTypeSelector *selector,
+                                       VkBufferCreateInfo *info, s32 intent, bool movable, cstr debug_name = NULL) {
+    VkBufferCreateInfo buffer_info = {};
+    VkBuffer buffer = _vtk_create_buffer(allocator, info, movable, &buffer_info);
+    VTK_MemoryRequirements requirements =
+        vtk_get_buffer_memory_requirements(selector, allocator->logical_device, buffer);
+    bool dedicated = vtk_use_dedicated_allocation(&requirements, false);
+    u32 allocation_index = _vtk_allocate_for_intent(allocator, selector, &requirements, intent, false, dedicated,
+                                                    VK_NULL_HANDLE, buffer);
+    if (allocation_index == VTK_NULL_ALLOCATION) {
+        vkDestroyBuffer(allocator->logical_device, buffer, vtk_allocation_callbacks());
+        return VTK_NULL_ALLOCATION;
+    }
+
+    _vtk_bind_buffer_allocation(allocator, allocation_index, buffer, &buffer_info, movable && !dedicated, debug_name);
+    return allocation_index;
+}
+
+// Images are never moved. Color/depth attachments above VTK_DEDICATED_RENDER_TARGET_THRESHOLD get dedicated memory.
+static u32 vtk_create_allocated_image(VTK_DeviceMemoryAllocator *allocator, VTK_MemoryTypeSelector *selector,
+                                      VkImageCreateInfo *info, s32 intent, cstr debug_name = NULL) {
+    VkImage image = VK_NULL_HANDLE;
+    vtk_validate_result(vkCreateImage(allocator->logical_device, info, vtk_allocation_callbacks(), &image),
+                        "failed to create image");
+    VTK_MemoryRequirements requirements = vtk_get_image_memory_requirements(selector, allocator->logical_device, image);
+    bool render_target =
+        info->usage & (VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT);
+    bool dedicated = vtk_use_dedicated_allocation(&requirements, render_target);
+    bool optimal = info->tiling == VK_IMAGE_TILING_OPTIMAL;
+    u32 allocation_index = _vtk_allocate_for_intent(allocator, selector, &requirements, intent, optimal, dedicated,
+                                                    image, VK_NULL_HANDLE);
+    if (allocation_index == VTK_NULL_ALLOCATION) {
+        vkDestroyImage(allocator->logical_device, image, vtk_allocation_callbacks());
+        return VTK_NULL_ALLOCATION;
+    }
+
+    VTK_DeviceAllocation *allocation = allocator->allocations + allocation_index;
+    vtk_validate_result(vkBindImageMemory(allocator->logical_device, image,
+                                          allocator->blocks[allocation->block_index].memory, allocation->offset),
+                        "failed to bind image memory");
+    allocation->image = image;
+    allocation->debug_name = debug_name;
+    VTK_SET_DEBUG_NAME(allocator->logical_device, VK_OBJECT_TYPE_IMAGE, image, debug_name);
+    return allocation_index;
+}
+
+static VTK_DeviceAllocation *vtk_device_allocation(VTK_DeviceMemoryAllocator *allocator, u32 allocation_index) {
+    return allocator->allocations + allocation_index;
+}
+
+static VkDeviceMemory vtk_device_allocation_memory(VTK_DeviceMemoryAllocator *allocator, u32 allocation_index) {
+    return allocator->blocks[allocator->allocations[allocation_index].block_index].memory;
+}
+
+// Records a descriptor write against a buffer allocation so it's re-written if the allocation moves. The caller still
+// performs the initial vkUpdateDescriptorSets.
+static void vtk_register_descriptor_reference(VTK_DeviceMemoryAllocator *allocator, u32 allocation_index,
+                                              VkDescriptorSet set, u32 binding, u32 array_element,
+                                              VkDescriptorType type, VkDeviceSize offset, VkDeviceSize range) {
+    CTK_ASSERT(allocator->allocations[allocation_index].buffer != VK_NULL_HANDLE);
+    VTK_DescriptorReference reference = {};
+    reference.allocation = allocation_index;
+    reference.set = set;
+    reference.binding = binding;
+    reference.array_element = array_element;
+    reference.type = type;
+    reference.offset = offset;
+    reference.range = range;
+    ctk_push(&allocator->descriptor_references, reference);
+}
+
+static void vtk_set_allocation_move_callback(VTK_DeviceMemoryAllocator *allocator, VTK_AllocationMoveCallback callback,
+                                             void *user_data) {
+    allocator->move_callback = callback;
+    allocator->move_user_data = user_data;
+}
+
+////////////////////////////////////////////////////////////
+/// Defragmentation
+////////////////////////////////////////////////////////////
+static u32 const VTK_MAX_PENDING_MOVES = 256;
+
+struct _VTK_PendingMove {
+    u32 old_region;  // Placeholder allocation keeping the old range reserved until the GPU is done with it.
+    VkBuffer old_buffer;
+    u64 retire_frame;
+};
+
+struct VTK_DefragmentationStats {
+    u64 moves;
+    VkDeviceSize bytes_moved;
+    VkDeviceSize bytes_reclaimed;
+    u32 blocks_released;
+};
+
+struct VTK_Defragmenter {
+    // Blocks less occupied than this are emptied into denser blocks of the same memory type.
+    f32 sparse_occupancy;
+    u32 frames_in_flight;
+    u64 frame;
+    CTK_StaticArray<_VTK_PendingMove, VTK_MAX_PENDING_MOVES> pending_moves;
+    VTK_DefragmentationStats stats;
+};
+
+static VTK_Defragmenter vtk_create_defragmenter(u32 frames_in_flight) {
+    VTK_Defragmenter defragmenter = {};
+    defragmenter.sparse_occupancy = 0.5f;
+    defragmenter.frames_in_flight = frames_in_flight;
+    return defragmenter;
+}
+
+static void _vtk_retire_moves(VTK_DeviceMemoryAllocator *allocator, VTK_Defragmenter *defragmenter, bool all) {
+    for (u32 i = 0; i < defragmenter->pending_moves.count;) {
+        _VTK_PendingMove *move = defragmenter->pending_moves + i;
+        if (!all && move->retire_frame > defragmenter->frame) {
+            ++i;
+            continue;
+        }
+
+        vkDestroyBuffer(allocator->logical_device, move->old_buffer, vtk_allocation_callbacks());
+        VkDeviceSize released = vtk_free_device_region(allocator, move->old_region);
+        if (released > 0) {
+            defragmenter->stats.bytes_reclaimed += released;
+            ++defragmenter->stats.blocks_released;
+        }
+
+        *move = defragmenter->pending_moves[--defragmenter->pending_moves.count];
+    }
+}
+
+static void _vtk_rewrite_descriptor_references(VTK_DeviceMemoryAllocator *allocator, u32 allocation_index) {
+    static u32 const BATCH_SIZE = 64;
+    VkWriteDescriptorSet writes[BATCH_SIZE];
+    VkDescriptorBufferInfo buffer_infos[BATCH_SIZE];
+    u32 write_count = 0;
+    VkBuffer buffer = allocator->allocations[allocation_index].buffer;
+    for (u32 i = 0; i < allocator->descriptor_references.count; ++i) {
+        VTK_DescriptorReference *reference = allocator->descriptor_references + i;
+        if (reference->allocation != allocation_index)
+            continue;
+
+        buffer_infos[write_count] = { buffer, reference->offset, reference->range };
+        VkWriteDescriptorSet *write = writes + write_count;
+        *write = {};
+        write->sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        write->dstSet = reference->set;
+        write->dstBinding = reference->binding;
+        write->dstArrayElement = reference->array_element;
+        write->descriptorCount = 1;
+        write->descriptorType = reference->type;
+        write->pBufferInfo = buffer_infos + write_count;
+        if (++write_count == BATCH_SIZE) {
+            vkUpdateDescriptorSets(allocator->logical_device, write_count, writes, 0, NULL);
+            write_count = 0;
+        }
+    }
+
+    if (write_count > 0)
+        vkUpdateDescriptorSets(allocator->logical_device, write_count, writes, 0, NULL);
+}
+
+// Moves allocation into block target_block_index, recording the copy into command_buffer. The first move recorded
+// (tracked by copies_recorded) is preceded by a barrier that makes earlier writes to the source buffers visible to
+// the copies. Returns false if it doesn't fit.
+static bool _vtk_move_allocation(VTK_DeviceMemoryAllocator *allocator, VTK_Defragmenter *defragmenter,
+                                 VkCommandBuffer command_buffer, u32 allocation_index, u32 target_block_index,
+                                 bool *copies_recorded) {
+    VTK_DeviceAllocation *allocation = allocator->allocations + allocation_index;
+    VTK_MemoryBlock *target = allocator->blocks + target_block_index;
+    VkDeviceSize offset = 0;
+    u32 insert_index = _vtk_find_block_gap(allocator, target, allocation->size, allocation->alignment, &offset);
+    if (insert_index == CTK_U32_MAX)
+        return false;
+
+    VkBuffer new_buffer = VK_NULL_HANDLE;
+    vtk_validate_result(vkCreateBuffer(allocator->logical_device, &allocation->buffer_info, vtk_allocation_callbacks(),
+                                       &new_buffer),
+                        "failed to create buffer for defragmentation move");
+    vtk_validate_result(vkBindBufferMemory(allocator->logical_device, new_buffer, target->memory, offset),
+                        "failed to bind buffer memory for defragmentation move");
+    VTK_SET_DEBUG_NAME(allocator->logical_device, VK_OBJECT_TYPE_BUFFER, new_buffer, allocation->debug_name);
+
+    if (!*copies_recorded) {
+        VkMemoryBarrier barrier = {};
+        barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+        barrier.srcAccessMask = VK_ACCESS_MEMORY_WRITE_BIT;
+        barrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+        vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0,
+                             1, &barrier, 0, NULL, 0, NULL);
+        *copies_recorded = true;
+    }
+
+    VkBufferCopy copy = { 0, 0, allocation->buffer_info.size };
+    vkCmdCopyBuffer(command_buffer, allocation->buffer, new_buffer, 1, &copy);
+
+    // The old range stays reserved by a placeholder until in-flight frames that may still read it have retired.
+    u32 old_region = _vtk_new_allocation(allocator);
+    allocation = allocator->allocations + allocation_index;
+    VTK_DeviceAllocation *placeholder = allocator->allocations + old_region;
+    placeholder->block_index = allocation->block_index;
+    placeholder->offset = allocation->offset;
+    placeholder->size = allocation->size;
+    placeholder->alignment = allocation->alignment;
+    placeholder->memory_type_index = allocation->memory_type_index;
+    VTK_MemoryBlock *source = allocator->blocks + allocation->block_index;
+    for (u32 i = 0; i < source->allocations.count; ++i) {
+        if (source->allocations[i] == allocation_index)
+            source->allocations[i] = old_region;
+    }
+
+    _VTK_PendingMove move = {};
+    move.old_region = old_region;
+    move.old_buffer = allocation->buffer;
+    move.retire_frame = defragmenter->frame + defragmenter->frames_in_flight;
+    ctk_push(&defragmenter->pending_moves, move);
+
+    // source->used is unchanged (the placeholder holds the range); the target gains the allocation.
+    allocation->buffer = new_buffer;
+    _vtk_place_allocation(allocator, target_block_index, insert_index, allocation_index, offset);
+    _vtk_rewrite_descriptor_references(allocator, allocation_index);
+    if (allocator->move_callback)
+        allocator->move_callback(allocator->move_user_data, allocation_index, allocation);
+
+    ++defragmenter->stats.moves;
+    defragmenter->stats.bytes_moved += allocation->size;
+    return true;
+}
+
+// Runs one incremental step: retires moves whose frames have completed, then moves movable buffers out of the sparsest
+// blocks into denser blocks of the same memory type until max_ns of CPU time or max_bytes of copies is spent. Copies
+// are recorded into command_buffer between a barrier waiting on all earlier writes and one making them visible to all
+// later commands; record it before any work using the moved buffers. Descriptor sets referencing moved buffers are
+// re-written immediately, so they must not be in use by frames still in flight (e.g. per-frame sets, or sets created
+// with UPDATE_AFTER_BIND). Call once per frame, after that frame's fence has been waited on.
+static void vtk_defragment(VTK_DeviceMemoryAllocator *allocator, VTK_Defragmenter *defragmenter,
+                           VkCommandBuffer command_buffer, u64 max_ns, VkDeviceSize max_bytes) {
+    VTK_CPU_ZONE("vtk_defragment");
+    u64 start_ns = _vtk_now_ns();
+    ++defragmenter->frame;
+    _vtk_retire_moves(allocator, defragmenter, false);
+
+    // Sparse source blocks, sparsest first.
+    CTK_StaticArray<u32, VTK_MAX_MEMORY_BLOCKS> sources = {};
+    bool is_source[VTK_MAX_MEMORY_BLOCKS] = {};
+    for (u32 i = 0; i < allocator->blocks.count; ++i) {
+        VTK_MemoryBlock *block = allocator->blocks + i;
+        if (block->memory == VK_NULL_HANDLE || block->optimal || block->dedicated || block->allocations.count == 0 ||
+            (f64)block->used >= (f64)block->size * defragmenter->sparse_occupancy) {
+            continue;
+        }
+
+        u32 j = sources.count++;
+        for (; j > 0 && allocator->blocks[sources[j - 1]].used > block->used; --j)
+            sources[j] = sources[j - 1];
+
+        sources[j] = i;
+        is_source[i] = true;
+    }
+
+    VkDeviceSize bytes_moved = 0;
+    u32 moves = 0;
+    bool copies_recorded = false;
+    bool budget_spent = false;
+    for (u32 source_index = 0; source_index < sources.count && !budget_spent; ++source_index) {
+        VTK_MemoryBlock *source = allocator->blocks + sources[source_index];
+        for (u32 i = 0; i < source->allocations.count; ++i) {
+            budget_spent = _vtk_now_ns() - start_ns >= max_ns || bytes_moved >= max_bytes ||
+                           defragmenter->pending_moves.count == VTK_MAX_PENDING_MOVES;
+            if (budget_spent)
+                break;
+
+            u32 allocation_index = source->allocations[i];
+            VTK_DeviceAllocation *allocation = allocator->allocations + allocation_index;
+            if (!allocation->movable)
+                continue;
+
+            // Densest target first, so allocations pack into as few blocks as possible.
+            u32 target_block_index = CTK_U32_MAX;
+            for (u32 block_index = 0; block_index < allocator->blocks.count; ++block_index) {
+                VTK_MemoryBlock *target = allocator->blocks + block_index;
+                if (is_source[block_index] || target->memory == VK_NULL_HANDLE || target->optimal ||
+                    target->dedicated || target->memory_type_index != source->memory_type_index ||
+                    target->size - target->used < allocation->size) {
+                    continue;
+                }
+
+                if (target_block_index == CTK_U32_MAX || target->used > allocator->blocks[target_block_index].used)
+                    target_block_index = block_index;
+            }
+
+            if (target_block_index == CTK_U32_MAX)
+                continue;
+
+            VkDeviceSize size = allocation->size;
+            if (_vtk_move_allocation(allocator, defragmenter, command_buffer, allocation_index, target_block_index,
+                                     &copies_recorded)) {
+                bytes_moved += size;
+                ++moves;
+            }
+        }
+    }
+
+    if (moves > 0) {
+        VkMemoryBarrier barrier = {};
+        barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+        barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        barrier.dstAccessMask = VK_ACCESS_MEMORY_READ_BIT | VK_ACCESS_MEMORY_WRITE_BIT;
+        vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, 0,
+                             1, &barrier, 0, NULL, 0, NULL);
+    }
+}
+
+// Waits for nothing; only call once the device is idle (e.g. at shutdown) to release every pending move.
+static void vtk_flush_defragmenter(VTK_DeviceMemoryAllocator *allocator, VTK_Defragmenter *defragmenter) {
+    _vtk_retire_moves(allocator, defragmenter, true);
+}
+
+static void vtk_log_defragmentation_stats(VTK_Defragmenter *defragmenter) {
+    VTK_DefragmentationStats *stats = &defragmenter->stats;
+    ctk_info("defragmentation: %llu moves, %llu MiB moved, %llu MiB reclaimed (%u blocks), %u moves pending",
+             (unsigned long long)stats->moves, (unsigned long long)(stats->bytes_moved >> 20),
+             (unsigned long long)(stats->bytes_reclaimed >> 20), stats->blocks_released,
+             defragmenter->pending_moves.count);
+}
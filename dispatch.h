@@ -0,0 +1,283 @@
+#pragma once
+
+#include <chrono>
+#include <vulkan/vulkan.h>
+#include "ctk/ctk.h"
+#include "vtk/vtk.h"
+
+////////////////////////////////////////////////////////////
+/// Macros
+////////////////////////////////////////////////////////////
+
+// Core Vulkan 1.0 device-level functions; loading fails if any are missing.
+#define VTK_DEVICE_CORE_FUNCTIONS(X)\
+    X(vkGetDeviceQueue)\
+    X(vkQueueSubmit)\
+    X(vkQueueWaitIdle)\
+    X(vkDeviceWaitIdle)\
+    X(vkAllocateMemory)\
+    X(vkFreeMemory)\
+    X(vkMapMemory)\
+    X(vkUnmapMemory)\
+    X(vkFlushMappedMemoryRanges)\
+    X(vkInvalidateMappedMemoryRanges)\
+    X(vkBindBufferMemory)\
+    X(vkBindImageMemory)\
+    X(vkGetBufferMemoryRequirements)\
+    X(vkGetImageMemoryRequirements)\
+    X(vkCreateFence)\
+    X(vkDestroyFence)\
+    X(vkResetFences)\
+    X(vkGetFenceStatus)\
+    X(vkWaitForFences)\
+    X(vkCreateSemaphore)\
+    X(vkDestroySemaphore)\
+    X(vkCreateQueryPool)\
+    X(vkDestroyQueryPool)\
+    X(vkGetQueryPoolResults)\
+    X(vkCreateBuffer)\
+    X(vkDestroyBuffer)\
+    X(vkCreateImage)\
+    X(vkDestroyImage)\
+    X(vkCreateImageView)\
+    X(vkDestroyImageView)\
+    X(vkCreateShaderModule)\
+    X(vkDestroyShaderModule)\
+    X(vkCreatePipelineCache)\
+    X(vkDestroyPipelineCache)\
+    X(vkCreateGraphicsPipelines)\
+    X(vkCreateComputePipelines)\
+    X(vkDestroyPipeline)\
+    X(vkCreatePipelineLayout)\
+    X(vkDestroyPipelineLayout)\
+    X(vkCreateSampler)\
+    X(vkDestroySampler)\
+    X(vkCreateDescriptorSetLayout)\
+    X(vkDestroyDescriptorSetLayout)\
+    X(vkCreateDescriptorPool)\
+    X(vkDestroyDescriptorPool)\
+    X(vkResetDescriptorPool)\
+    X(vkAllocateDescriptorSets)\
+    X(vkFreeDescriptorSets)\
+    X(vkUpdateDescriptorSets)\
+    X(vkCreateFramebuffer)\
+    X(vkDestroyFramebuffer)\
+    X(vkCreateRenderPass)\
+    X(vkDestroyRenderPass)\
+    X(vkCreateCommandPool)\
+    X(vkDestroyCommandPool)\
+    X(vkResetCommandPool)\
+    X(vkAllocateCommandBuffers)\
+    X(vkFreeCommandBuffers)\
+    X(vkBeginCommandBuffer)\
+    X(vkEndCommandBuffer)\
+    X(vkResetCommandBuffer)\
+    X(vkCmdBindPipeline)\
+    X(vkCmdSetViewport)\
+    X(vkCmdSetScissor)\
+    X(vkCmdSetBlendConstants)\
+    X(vkCmdBindDescriptorSets)\
+    X(vkCmdBindIndexBuffer)\
+    X(vkCmdBindVertexBuffers)\
+    X(vkCmdDraw)\
+    X(vkCmdDrawIndexed)\
+    X(vkCmdDrawIndirect)\
+    X(vkCmdDrawIndexedIndirect)\
+    X(vkCmdDispatch)\
+    X(vkCmdDispatchIndirect)\
+    X(vkCmdCopyBuffer)\
+    X(vkCmdCopyImage)\
+    X(vkCmdBlitImage)\
+    X(vkCmdCopyBufferToImage)\
+    X(vkCmdCopyImageToBuffer)\
+    X(vkCmdFillBuffer)\
+    X(vkCmdClearColorImage)\
+    X(vkCmdPipelineBarrier)\
+    X(vkCmdBeginQuery)\
+    X(vkCmdEndQuery)\
+    X(vkCmdResetQueryPool)\
+    X(vkCmdWriteTimestamp)\
+    X(vkCmdCopyQueryPoolResults)\
+    X(vkCmdPushConstants)\
+    X(vkCmdBeginRenderPass)\
+    X(vkCmdNextSubpass)\
+    X(vkCmdEndRenderPass)\
+    X(vkCmdExecuteCommands)
+
+// Extension functions; left NULL if the extension isn't enabled on the device/instance.
+#define VTK_DEVICE_EXTENSION_FUNCTIONS(X)\
+    X(vkCreateSwapchainKHR)\
+    X(vkDestroySwapchainKHR)\
+    X(vkGetSwapchainImagesKHR)\
+    X(vkAcquireNextImageKHR)\
+    X(vkQueuePresentKHR)\
+    X(vkSetDebugUtilsObjectNameEXT)\
+    X(vkCmdBeginDebugUtilsLabelEXT)\
+    X(vkCmdEndDebugUtilsLabelEXT)\
+    X(vkCmdInsertDebugUtilsLabelEXT)\
+    X(vkGetMemoryHostPointerPropertiesEXT)
+
+// Instance-level extension functions vtk calls; left NULL if the extension isn't enabled on the instance.
+#define VTK_INSTANCE_EXTENSION_FUNCTIONS(X)\
+    X(vkCreateDebugUtilsMessengerEXT)\
+    X(vkDestroyDebugUtilsMessengerEXT)\
+    X(vkCreateHeadlessSurfaceEXT)
+
+#define _VTK_DISPATCH_MEMBER(FUNC_NAME) PFN_ ## FUNC_NAME FUNC_NAME;
+
+////////////////////////////////////////////////////////////
+/// Data
+////////////////////////////////////////////////////////////
+
+// Device-level function pointers fetched once through vkGetDeviceProcAddr. Calls through this table go straight to the
+// driver instead of through the loader's trampoline and per-call dispatch lookup.
+struct VTK_DeviceDispatch {
+    VTK_DEVICE_CORE_FUNCTIONS(_VTK_DISPATCH_MEMBER)
+    VTK_DEVICE_EXTENSION_FUNCTIONS(_VTK_DISPATCH_MEMBER)
+};
+
+// Instance-level extension function pointers fetched once through vkGetInstanceProcAddr, instead of looking them up at
+// every use with VTK_LOAD_INSTANCE_EXTENSION_FUNCTION.
+struct VTK_InstanceDispatch {
+    VTK_INSTANCE_EXTENSION_FUNCTIONS(_VTK_DISPATCH_MEMBER)
+};
+
+////////////////////////////////////////////////////////////
+/// Interface
+////////////////////////////////////////////////////////////
+static VTK_DeviceDispatch vtk_load_device_dispatch(VkDevice logical_device) {
+    VTK_DeviceDispatch dispatch = {};
+
+    #define _VTK_LOAD_CORE_FUNCTION(FUNC_NAME)\
+        dispatch.FUNC_NAME = (PFN_ ## FUNC_NAME)vkGetDeviceProcAddr(logical_device, #FUNC_NAME);\
+        if (dispatch.FUNC_NAME == NULL)\
+            CTK_FATAL("failed to load device function \"%s\"", #FUNC_NAME)
+
+    #define _VTK_LOAD_EXTENSION_FUNCTION(FUNC_NAME)\
+        dispatch.FUNC_NAME = (PFN_ ## FUNC_NAME)vkGetDeviceProcAddr(logical_device, #FUNC_NAME);
+
+    VTK_DEVICE_CORE_FUNCTIONS(_VTK_LOAD_CORE_FUNCTION)
+    VTK_DEVICE_EXTENSION_FUNCTIONS(_VTK_LOAD_EXTENSION_FUNCTION)
+
+    #undef _VTK_LOAD_CORE_FUNCTION
+    #undef _VTK_LOAD_EXTENSION_FUNCTION
+
+    return dispatch;
+}
+
+static VTK_InstanceDispatch vtk_load_instance_dispatch(VkInstance instance) {
+    VTK_InstanceDispatch dispatch = {};
+
+    #define _VTK_LOAD_INSTANCE_FUNCTION(FUNC_NAME)\
+        dispatch.FUNC_NAME = (PFN_ ## FUNC_NAME)vkGetInstanceProcAddr(instance, #FUNC_NAME);
+
+    VTK_INSTANCE_EXTENSION_FUNCTIONS(_VTK_LOAD_INSTANCE_FUNCTION)
+
+    #undef _VTK_LOAD_INSTANCE_FUNCTION
+
+    return dispatch;
+}
+
+// vtk_begin_temp_commands() through dispatch, for command buffers begun every frame.
+static void vtk_begin_temp_commands(VTK_DeviceDispatch *dispatch, VkCommandBuffer command_buffer) {
+    VkCommandBufferBeginInfo info = {};
+    info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+    info.pInheritanceInfo = NULL;
+    dispatch->vkBeginCommandBuffer(command_buffer, &info);
+}
+
+////////////////////////////////////////////////////////////
+/// Benchmark
+////////////////////////////////////////////////////////////
+struct VTK_RecordingBenchmarkResult {
+    f64 loader_ns_per_command;
+    f64 dispatch_ns_per_command;
+};
+
+static u64 _vtk_time_loader_recording(VkCommandBuffer command_buffer, VkCommandBufferBeginInfo *begin_info,
+                                     u32 command_count) {
+    static VkViewport const VIEWPORT = { 0.0f, 0.0f, 1280.0f, 720.0f, 0.0f, 1.0f };
+    static VkRect2D const SCISSOR = { { 0, 0 }, { 1280, 720 } };
+    static f32 const BLEND_CONSTANTS[] = { 1.0f, 1.0f, 1.0f, 1.0f };
+
+    vkBeginCommandBuffer(command_buffer, begin_info);
+    auto start = std::chrono::steady_clock::now();
+    for (u32 i = 0; i < command_count; i += 3) {
+        vkCmdSetViewport(command_buffer, 0, 1, &VIEWPORT);
+        vkCmdSetScissor(command_buffer, 0, 1, &SCISSOR);
+        vkCmdSetBlendConstants(command_buffer, BLEND_CONSTANTS);
+    }
+    auto end = std::chrono::steady_clock::now();
+    vkEndCommandBuffer(command_buffer);
+    vkResetCommandBuffer(command_buffer, 0);
+    return (u64)std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count();
+}
+
+static u64 _vtk_time_dispatch_recording(VTK_DeviceDispatch *dispatch, VkCommandBuffer command_buffer,
+                                       VkCommandBufferBeginInfo *begin_info, u32 command_count) {
+    static VkViewport const VIEWPORT = { 0.0f, 0.0f, 1280.0f, 720.0f, 0.0f, 1.0f };
+    static VkRect2D const SCISSOR = { { 0, 0 }, { 1280, 720 } };
+    static f32 const BLEND_CONSTANTS[] = { 1.0f, 1.0f, 1.0f, 1.0f };
+
+    dispatch->vkBeginCommandBuffer(command_buffer, begin_info);
+    auto start = std::chrono::steady_clock::now();
+    for (u32 i = 0; i < command_count; i += 3) {
+        dispatch->vkCmdSetViewport(command_buffer, 0, 1, &VIEWPORT);
+        dispatch->vkCmdSetScissor(command_buffer, 0, 1, &SCISSOR);
+        dispatch->vkCmdSetBlendConstants(command_buffer, BLEND_CONSTANTS);
+    }
+    auto end = std::chrono::steady_clock::now();
+    dispatch->vkEndCommandBuffer(command_buffer);
+    dispatch->vkResetCommandBuffer(command_buffer, 0);
+    return (u64)std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count();
+}
+
+// Records command_count state-setting commands into command_buffer, through the loader's exported symbols and through
+// dispatch, and reports the per-command recording cost of each. A discarded warm-up round of both comes first, then the
+// measured rounds alternate which path goes first and the fastest round of each is kept, so neither path pays for cold
+// caches or driver pool growth. Only dynamic state commands are recorded, so no pipeline, render pass or resources are
+// needed: the result is the per-call trampoline overhead the dispatch table removes, not the cost of draws, descriptor
+// binds or submits, whose driver-side work dominates either way. The command buffer is reset between runs and never
+// submitted, so its pool must be created with VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT.
+static VTK_RecordingBenchmarkResult vtk_benchmark_command_recording(VTK_DeviceDispatch *dispatch,
+                                                                    VkCommandBuffer command_buffer,
+                                                                    u32 command_count) {
+    static u32 const MEASURED_ROUNDS = 4;
+    CTK_ASSERT(command_count > 0);
+
+    VkCommandBufferBeginInfo begin_info = {};
+    begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    begin_info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+    begin_info.pInheritanceInfo = NULL;
+
+    // Warm-up
+    _vtk_time_loader_recording(command_buffer, &begin_info, command_count);
+    _vtk_time_dispatch_recording(dispatch, command_buffer, &begin_info, command_count);
+
+    u64 loader_ns = CTK_U64_MAX;
+    u64 dispatch_ns = CTK_U64_MAX;
+    for (u32 round = 0; round < MEASURED_ROUNDS; ++round) {
+        u64 round_loader_ns = 0;
+        u64 round_dispatch_ns = 0;
+        if (round % 2 == 0) {
+            round_loader_ns = _vtk_time_loader_recording(command_buffer, &begin_info, command_count);
+            round_dispatch_ns = _vtk_time_dispatch_recording(dispatch, command_buffer, &begin_info, command_count);
+        }
+        else {
+            round_dispatch_ns = _vtk_time_dispatch_recording(dispatch, command_buffer, &begin_info, command_count);
+            round_loader_ns = _vtk_time_loader_recording(command_buffer, &begin_info, command_count);
+        }
+
+        loader_ns = round_loader_ns < loader_ns ? round_loader_ns : loader_ns;
+        dispatch_ns = round_dispatch_ns < dispatch_ns ? round_dispatch_ns : dispatch_ns;
+    }
+
+    u32 recorded_count = (command_count + 2) / 3 * 3;
+    VTK_RecordingBenchmarkResult result = {};
+    result.loader_ns_per_command = (f64)loader_ns / recorded_count;
+    result.dispatch_ns_per_command = (f64)dispatch_ns / recorded_count;
+    ctk_info("dynamic state recording: loader %.2fns/cmd, dispatch table %.2fns/cmd (%u commands, best of %u rounds)",
+             result.loader_ns_per_command, result.dispatch_ns_per_command, recorded_count, MEASURED_ROUNDS);
+    return result;
+}
@@ -0,0 +1,369 @@
+#pragma once
+
+#include <stdio.h>
+#include <string.h>
+#include <vulkan/vulkan.h>
+#include "ctk/ctk.h"
+#include "vtk/vtk.h"
+#include "vtk/debug_utils.h"
+
+////////////////////////////////////////////////////////////
+/// Data
+////////////////////////////////////////////////////////////
+static u32 const VTK_GPU_PROFILER_MAX_FRAMES = 4;
+static u32 const VTK_GPU_PROFILER_MAX_SCOPES = 64;
+static u32 const VTK_GPU_PROFILER_MAX_SCOPE_NAMES = 128;
+static u32 const VTK_GPU_PROFILER_HISTORY_SIZE = 128;
+static u32 const VTK_GPU_PROFILER_TRACE_SIZE = 4096; // Must be a power of 2.
+
+struct VTK_GpuScope {
+    u32 name_index;
+    u32 depth;
+    u32 begin_query;
+    u32 end_query;
+};
+
+struct VTK_GpuProfilerFrame {
+    VkQueryPool query_pool;
+    CTK_StaticArray<VTK_GpuScope, VTK_GPU_PROFILER_MAX_SCOPES> scopes;
+    CTK_StaticArray<u32, VTK_GPU_PROFILER_MAX_SCOPES> open_scopes;
+    u32 query_count;
+    bool pending;
+};
+
+// Rolling statistics over the last VTK_GPU_PROFILER_HISTORY_SIZE resolved samples of a scope. mean/p95/max are only
+// summarized when read through vtk_gpu_scope_stats(), vtk_log_gpu_profiler() or vtk_write_gpu_profiler_json().
+struct VTK_GpuScopeStats {
+    cstr name;
+    f64 history_ms[VTK_GPU_PROFILER_HISTORY_SIZE];
+    u32 history_count;
+    u32 history_next;
+    f64 last_ms;
+    f64 mean_ms;
+    f64 p95_ms;
+    f64 max_ms;
+    bool summary_stale;
+};
+
+// Resolved sample in device timestamp ticks, for aligning with CPU traces.
+struct _VTK_GpuTraceEvent {
+    u32 name_index;
+    u64 begin_ticks;
+    u64 end_ticks;
+};
+
+struct VTK_GpuProfiler {
+    VTK_GpuProfilerFrame frames[VTK_GPU_PROFILER_MAX_FRAMES];
+    u32 frame_count;
+    u32 frame_index;
+    f64 timestamp_period_ns;
+    u64 timestamp_mask;
+    CTK_StaticArray<VTK_GpuScopeStats, VTK_GPU_PROFILER_MAX_SCOPE_NAMES> stats;
+    bool enabled;
+
+    // Every resolved sample, oldest overwritten first, for vtk_write_gpu_trace_events().
+    _VTK_GpuTraceEvent trace_events[VTK_GPU_PROFILER_TRACE_SIZE];
+    u64 trace_write_index;
+
+    // Set by vtk_calibrate_gpu_profiler(); maps device timestamps onto the _vtk_now_ns() clock for trace export.
+    s64 gpu_to_cpu_offset_ns;
+    bool calibrated;
+};
+
+////////////////////////////////////////////////////////////
+/// Internal
+////////////////////////////////////////////////////////////
+static u32 _vtk_gpu_scope_name_index(VTK_GpuProfiler *profiler, cstr name) {
+    // Scope names are expected to be string literals, so pointer equality is tried before comparing contents.
+    for (u32 i = 0; i < profiler->stats.count; ++i) {
+        if (profiler->stats[i].name == name || strcmp(profiler->stats[i].name, name) == 0)
+            return i;
+    }
+
+    if (profiler->stats.count == VTK_GPU_PROFILER_MAX_SCOPE_NAMES)
+        CTK_FATAL("gpu profiler cannot track more than %u scope names", VTK_GPU_PROFILER_MAX_SCOPE_NAMES)
+
+    VTK_GpuScopeStats stats = {};
+    stats.name = name;
+    ctk_push(&profiler->stats, stats);
+    return profiler->stats.count - 1;
+}
+
+static void _vtk_update_gpu_scope_stats(VTK_GpuScopeStats *stats, f64 ms) {
+    stats->last_ms = ms;
+    stats->history_ms[stats->history_next] = ms;
+    stats->history_next = (stats->history_next + 1) % VTK_GPU_PROFILER_HISTORY_SIZE;
+    if (stats->history_count < VTK_GPU_PROFILER_HISTORY_SIZE)
+        ++stats->history_count;
+
+    stats->summary_stale = true;
+}
+
+static void _vtk_summarize_gpu_scope_stats(VTK_GpuScopeStats *stats) {
+    if (!stats->summary_stale)
+        return;
+
+    // Insertion sort a copy of the history for p95; history is small enough that this is cheaper than anything fancier.
+    f64 sorted[VTK_GPU_PROFILER_HISTORY_SIZE];
+    f64 total = 0.0;
+    stats->max_ms = 0.0;
+    for (u32 i = 0; i < stats->history_count; ++i) {
+        f64 sample = stats->history_ms[i];
+        total += sample;
+        stats->max_ms = sample > stats->max_ms ? sample : stats->max_ms;
+
+        u32 j = i;
+        for (; j > 0 && sorted[j - 1] > sample; --j)
+            sorted[j] = sorted[j - 1];
+
+        sorted[j] = sample;
+    }
+
+    stats->mean_ms = total / stats->history_count;
+    stats->p95_ms = sorted[(stats->history_count - 1) * 95 / 100];
+    stats->summary_stale = false;
+}
+
+// Reads back frame's timestamps without waiting; returns false if the GPU hasn't finished the frame yet.
+static bool _vtk_resolve_gpu_profiler_frame(VTK_GpuProfiler *profiler, VkDevice logical_device,
+                                            VTK_GpuProfilerFrame *frame) {
+    if (!frame->pending)
+        return true;
+
+    if (frame->query_count > 0) {
+        u64 results[VTK_GPU_PROFILER_MAX_SCOPES * 2] = {};
+        VkResult result =
+            VTK_RECORD_RESULT(vkGetQueryPoolResults(logical_device, frame->query_pool, 0, frame->query_count,
+                                                    sizeof(results), results, sizeof(u64), VK_QUERY_RESULT_64_BIT));
+        if (result == VK_NOT_READY)
+            return false;
+
+        _vtk_validate_result(result, "failed to get gpu profiler query results");
+        for (u32 i = 0; i < frame->scopes.count; ++i) {
+            // Scopes left open when the frame was submitted have no end timestamp.
+            VTK_GpuScope *scope = frame->scopes + i;
+            if (scope->end_query == CTK_U32_MAX)
+                continue;
+
+            u64 begin = results[scope->begin_query] & profiler->timestamp_mask;
+            u64 end = results[scope->end_query] & profiler->timestamp_mask;
+            _VTK_GpuTraceEvent *event =
+                profiler->trace_events + (profiler->trace_write_index++ & (VTK_GPU_PROFILER_TRACE_SIZE - 1));
+            event->name_index = scope->name_index;
+            event->begin_ticks = begin;
+            event->end_ticks = end;
+            _vtk_update_gpu_scope_stats(profiler->stats + scope->name_index,
+                                        (f64)((end - begin) & profiler->timestamp_mask) *
+                                        profiler->timestamp_period_ns / 1000000.0);
+        }
+    }
+
+    frame->pending = false;
+    return true;
+}
+
+////////////////////////////////////////////////////////////
+/// Interface
+////////////////////////////////////////////////////////////
+
+// frame_count is the number of frames in flight; results are read back frame_count frames after they're recorded, so
+// resolving never stalls on the GPU. timestamp_valid_bits comes from the properties of the queue family scopes are
+// recorded on; profiling is disabled if it's 0.
+static VTK_GpuProfiler vtk_create_gpu_profiler(VkDevice logical_device, VkPhysicalDeviceLimits *limits,
+                                               u32 timestamp_valid_bits, u32 frame_count) {
+    VTK_GpuProfiler profiler = {};
+    CTK_ASSERT(frame_count > 0 && frame_count <= VTK_GPU_PROFILER_MAX_FRAMES);
+    profiler.frame_count = frame_count;
+    profiler.timestamp_period_ns = (f64)limits->timestampPeriod;
+    profiler.timestamp_mask = timestamp_valid_bits >= 64 ? CTK_U64_MAX : (1ull << timestamp_valid_bits) - 1;
+    profiler.enabled = timestamp_valid_bits > 0;
+    if (!profiler.enabled) {
+        ctk_warning("gpu timestamps not supported; gpu profiler disabled");
+        return profiler;
+    }
+
+    for (u32 i = 0; i < frame_count; ++i) {
+        VkQueryPoolCreateInfo info = {};
+        info.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+        info.flags = 0;
+        info.queryType = VK_QUERY_TYPE_TIMESTAMP;
+        info.queryCount = VTK_GPU_PROFILER_MAX_SCOPES * 2;
+        info.pipelineStatistics = 0;
+        vtk_validate_result(vkCreateQueryPool(logical_device, &info,
+                                              vtk_allocation_callbacks(), &profiler.frames[i].query_pool),
+                            "failed to create gpu profiler query pool");
+        VTK_SET_DEBUG_NAME(logical_device, VK_OBJECT_TYPE_QUERY_POOL, profiler.frames[i].query_pool, "gpu profiler");
+    }
+
+    return profiler;
+}
+
+static void vtk_destroy_gpu_profiler(VTK_GpuProfiler *profiler, VkDevice logical_device) {
+    for (u32 i = 0; i < profiler->frame_count; ++i)
+        vkDestroyQueryPool(logical_device, profiler->frames[i].query_pool, vtk_allocation_callbacks());
+
+    *profiler = {};
+}
+
+// Call once per frame, before recording any scopes, with the command buffer that will be submitted first. Resolves the
+// results of the frame this slot was last used for (frame_count frames ago) and resets its queries.
+static void vtk_begin_gpu_profiler_frame(VTK_GpuProfiler *profiler, VkDevice logical_device,
+                                         VkCommandBuffer command_buffer) {
+    if (!profiler->enabled)
+        return;
+
+    CTK_ASSERT(profiler->frames[profiler->frame_index].open_scopes.count == 0);
+    profiler->frame_index = (profiler->frame_index + 1) % profiler->frame_count;
+    VTK_GpuProfilerFrame *frame = profiler->frames + profiler->frame_index;
+
+    // Frames in flight are normally fenced before their slot is reused, so this only fails if the caller doesn't; the
+    // stale results are dropped rather than stalling.
+    if (!_vtk_resolve_gpu_profiler_frame(profiler, logical_device, frame))
+        ctk_warning("gpu profiler frame not ready when reused; dropping its results");
+
+    vkCmdResetQueryPool(command_buffer, frame->query_pool, 0, VTK_GPU_PROFILER_MAX_SCOPES * 2);
+    frame->scopes.count = 0;
+    frame->open_scopes.count = 0;
+    frame->query_count = 0;
+    frame->pending = true;
+}
+
+// Scope names must outlive the profiler (string literals in practice). Scopes also open a debug utils label of the same
+// name, even when timestamps aren't supported.
+static void vtk_begin_gpu_scope(VTK_GpuProfiler *profiler, VkCommandBuffer command_buffer, cstr name,
+                                VkPipelineStageFlagBits stage = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT) {
+    VTK_BEGIN_DEBUG_LABEL(command_buffer, name);
+    if (!profiler->enabled)
+        return;
+
+    VTK_GpuProfilerFrame *frame = profiler->frames + profiler->frame_index;
+    if (frame->scopes.count == VTK_GPU_PROFILER_MAX_SCOPES) {
+        ctk_warning("gpu profiler scope limit (%u) reached; ignoring scope \"%s\"", VTK_GPU_PROFILER_MAX_SCOPES, name);
+        ctk_push(&frame->open_scopes, CTK_U32_MAX);
+        return;
+    }
+
+    VTK_GpuScope scope = {};
+    scope.name_index = _vtk_gpu_scope_name_index(profiler, name);
+    scope.depth = frame->open_scopes.count;
+    scope.begin_query = frame->query_count++;
+    scope.end_query = CTK_U32_MAX;
+    vkCmdWriteTimestamp(command_buffer, stage, frame->query_pool, scope.begin_query);
+    ctk_push(&frame->open_scopes, frame->scopes.count);
+    ctk_push(&frame->scopes, scope);
+}
+
+static void vtk_end_gpu_scope(VTK_GpuProfiler *profiler, VkCommandBuffer command_buffer,
+                              VkPipelineStageFlagBits stage = VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT) {
+    VTK_END_DEBUG_LABEL(command_buffer);
+    if (!profiler->enabled)
+        return;
+
+    VTK_GpuProfilerFrame *frame = profiler->frames + profiler->frame_index;
+    CTK_ASSERT(frame->open_scopes.count > 0);
+    u32 scope_index = frame->open_scopes[--frame->open_scopes.count];
+    if (scope_index == CTK_U32_MAX)
+        return;
+
+    VTK_GpuScope *scope = frame->scopes + scope_index;
+    scope->end_query = frame->query_count++;
+    vkCmdWriteTimestamp(command_buffer, stage, frame->query_pool, scope->end_query);
+}
+
+static VTK_GpuScopeStats *vtk_gpu_scope_stats(VTK_GpuProfiler *profiler, cstr name) {
+    for (u32 i = 0; i < profiler->stats.count; ++i) {
+        if (strcmp(profiler->stats[i].name, name) == 0) {
+            _vtk_summarize_gpu_scope_stats(profiler->stats + i);
+            return profiler->stats + i;
+        }
+    }
+
+    return NULL;
+}
+
+static void vtk_log_gpu_profiler(VTK_GpuProfiler *profiler) {
+    ctk_info("gpu profiler (ms):      last      mean       p95       max");
+    for (u32 i = 0; i < profiler->stats.count; ++i) {
+        VTK_GpuScopeStats *stats = profiler->stats + i;
+        _vtk_summarize_gpu_scope_stats(stats);
+        ctk_info("    %-16s %9.3f %9.3f %9.3f %9.3f", stats->name, stats->last_ms, stats->mean_ms, stats->p95_ms,
+                 stats->max_ms);
+    }
+}
+
+static void vtk_write_gpu_profiler_json(VTK_GpuProfiler *profiler, FILE *file) {
+    fprintf(file, "{\n    \"scopes\": [");
+    for (u32 i = 0; i < profiler->stats.count; ++i) {
+        VTK_GpuScopeStats *stats = profiler->stats + i;
+        _vtk_summarize_gpu_scope_stats(stats);
+        fprintf(file, "%s\n        { \"name\": ", i == 0 ? "" : ",");
+        _vtk_write_json_string(file, stats->name);
+        fprintf(file, ", \"samples\": %u, \"last_ms\": %.4f, \"mean_ms\": %.4f, \"p95_ms\": %.4f, \"max_ms\": %.4f }",
+                stats->history_count, stats->last_ms, stats->mean_ms, stats->p95_ms, stats->max_ms);
+    }
+    fprintf(file, "\n    ]\n}\n");
+}
+
+// Estimates the offset between device timestamps and _vtk_now_ns() by writing a single timestamp and waiting for it.
+// The estimate is biased by submit latency, which is well under the scale of frame-level traces. command_buffer must be
+// in the initial state; it's recorded and submitted via vtk_begin/submit_temp_commands.
+static void vtk_calibrate_gpu_profiler(VTK_GpuProfiler *profiler, VkDevice logical_device, VkQueue queue,
+                                       VkCommandBuffer command_buffer) {
+    if (!profiler->enabled)
+        return;
+
+    VkQueryPoolCreateInfo info = {};
+    info.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+    info.flags = 0;
+    info.queryType = VK_QUERY_TYPE_TIMESTAMP;
+    info.queryCount = 1;
+    info.pipelineStatistics = 0;
+    VkQueryPool query_pool = VK_NULL_HANDLE;
+    vtk_validate_result(vkCreateQueryPool(logical_device, &info, vtk_allocation_callbacks(), &query_pool),
+                        "failed to create gpu profiler calibration query pool");
+
+    vtk_begin_temp_commands(command_buffer);
+    vkCmdResetQueryPool(command_buffer, query_pool, 0, 1);
+    vkCmdWriteTimestamp(command_buffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, query_pool, 0);
+    u64 submit_ns = _vtk_now_ns();
+    vtk_submit_temp_commands(command_buffer, queue);
+    u64 complete_ns = _vtk_now_ns();
+
+    u64 ticks = 0;
+    vtk_validate_result(vkGetQueryPoolResults(logical_device, query_pool, 0, 1, sizeof(ticks), &ticks, sizeof(ticks),
+                                              VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WAIT_BIT),
+                        "failed to get gpu profiler calibration timestamp");
+    vkDestroyQueryPool(logical_device, query_pool, vtk_allocation_callbacks());
+
+    f64 gpu_ns = (f64)(ticks & profiler->timestamp_mask) * profiler->timestamp_period_ns;
+    profiler->gpu_to_cpu_offset_ns = (s64)((submit_ns + complete_ns) / 2) - (s64)gpu_ns;
+    profiler->calibrated = true;
+}
+
+#ifdef VTK_CPU_PROFILER
+// Writes every resolved sample still held in the trace ring (the last VTK_GPU_PROFILER_TRACE_SIZE) as Chrome trace
+// events (pid 1), on the same timeline as vtk_write_cpu_trace_events(). Requires vtk_calibrate_gpu_profiler().
+static void vtk_write_gpu_trace_events(VTK_GpuProfiler *profiler, FILE *file) {
+    if (!profiler->enabled)
+        return;
+
+    if (!profiler->calibrated) {
+        ctk_warning("gpu profiler not calibrated; skipping gpu trace events");
+        return;
+    }
+
+    fprintf(file, ",\n{ \"ph\": \"M\", \"pid\": 1, \"name\": \"process_name\", \"args\": { \"name\": \"GPU\" } }");
+    s64 start_ns = (s64)vtk_chrome_trace_start_ns();
+    u64 end = profiler->trace_write_index;
+    u64 begin = end > VTK_GPU_PROFILER_TRACE_SIZE ? end - VTK_GPU_PROFILER_TRACE_SIZE : 0;
+    for (u64 i = begin; i < end; ++i) {
+        _VTK_GpuTraceEvent *event = profiler->trace_events + (i & (VTK_GPU_PROFILER_TRACE_SIZE - 1));
+        s64 begin_ns = (s64)((f64)event->begin_ticks * profiler->timestamp_period_ns) + profiler->gpu_to_cpu_offset_ns;
+        f64 duration_ns = (f64)((event->end_ticks - event->begin_ticks) & profiler->timestamp_mask) *
+                          profiler->timestamp_period_ns;
+        fprintf(file, ",\n{ \"ph\": \"X\", \"pid\": 1, \"tid\": 0, \"name\": ");
+        _vtk_write_json_string(file, profiler->stats[event->name_index].name);
+        fprintf(file, ", \"ts\": %.3f, \"dur\": %.3f }", (f64)(begin_ns - start_ns) / 1000.0, duration_ns / 1000.0);
+    }
+}
+#endif
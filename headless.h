@@ -0,0 +1,263 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include "ctk/ctk.h"
+#include "ctk/containers.h"
+#include "vtk/vtk.h"
+#include "vtk/dispatch.h"
+#include "vtk/debug_utils.h"
+
+////////////////////////////////////////////////////////////
+/// Data
+////////////////////////////////////////////////////////////
+struct VTK_OffscreenImage {
+    VkImage handle;
+    VkDeviceMemory memory;
+    VkImageView view;
+
+    // Signaled when the frame rendered into this image has been "presented", i.e. all work submitted against it has
+    // completed. Acquire waits on it, which gives the same back-pressure a FIFO swapchain would. Only present signals
+    // it, so every acquired image must be presented before the ring comes back around to it.
+    VkFence present_fence;
+    bool acquired; // Between acquire and present; present_fence is unsignaled and nothing else will signal it.
+};
+
+struct VTK_OffscreenSwapchainInfo {
+    VkExtent2D extent;
+    VkFormat image_format;
+    VkImageUsageFlags image_usage;
+    u32 image_count;
+    cstr debug_name; // Optional; applied to every image, view, memory and fence in the ring.
+};
+
+struct VTK_OffscreenSwapchainStats {
+    u64 frame_count;
+    u64 total_frame_ns;
+    u64 min_frame_ns;
+    u64 max_frame_ns;
+    u64 total_acquire_wait_ns;
+};
+
+struct VTK_OffscreenSwapchain {
+    CTK_StaticArray<VTK_OffscreenImage, 4> images;
+    VkFormat image_format;
+    VkExtent2D extent;
+    u32 next_image_index;
+    u64 last_present_ns;
+    VTK_OffscreenSwapchainStats stats;
+};
+
+////////////////////////////////////////////////////////////
+/// Internal
+////////////////////////////////////////////////////////////
+static void _vtk_submit_sync_only(VkQueue queue, VkSemaphore wait_semaphore, VkSemaphore signal_semaphore,
+                                  VkFence fence) {
+    static VkPipelineStageFlags const WAIT_STAGE = VK_PIPELINE_STAGE_ALL_COMMANDS_BIT;
+
+    // Zero command buffer submissions are valid and are the cheapest way to move semaphore/fence state on the queue.
+    VkSubmitInfo info = {};
+    info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    info.waitSemaphoreCount = wait_semaphore != VK_NULL_HANDLE ? 1 : 0;
+    info.pWaitSemaphores = &wait_semaphore;
+    info.pWaitDstStageMask = &WAIT_STAGE;
+    info.commandBufferCount = 0;
+    info.pCommandBuffers = NULL;
+    info.signalSemaphoreCount = signal_semaphore != VK_NULL_HANDLE ? 1 : 0;
+    info.pSignalSemaphores = &signal_semaphore;
+    vtk_validate_result(vkQueueSubmit(queue, 1, &info, fence), "failed to submit offscreen swapchain sync batch");
+}
+
+////////////////////////////////////////////////////////////
+/// Interface
+////////////////////////////////////////////////////////////
+
+// Creates a surface through VK_EXT_headless_surface, so the regular swapchain path can run without a window. The
+// instance must have been created with VK_EXT_HEADLESS_SURFACE_EXTENSION_NAME and VK_KHR_SURFACE_EXTENSION_NAME, and
+// dispatch loaded from it with vtk_load_instance_dispatch().
+static VkSurfaceKHR vtk_create_headless_surface(VTK_InstanceDispatch *dispatch, VkInstance instance) {
+    if (dispatch->vkCreateHeadlessSurfaceEXT == NULL)
+        CTK_FATAL("VK_EXT_headless_surface not enabled on instance")
+
+    VkHeadlessSurfaceCreateInfoEXT info = {};
+    info.sType = VK_STRUCTURE_TYPE_HEADLESS_SURFACE_CREATE_INFO_EXT;
+    info.flags = 0;
+    VkSurfaceKHR surface = VK_NULL_HANDLE;
+    vtk_validate_result(dispatch->vkCreateHeadlessSurfaceEXT(instance, &info, vtk_allocation_callbacks(), &surface),
+                        "failed to create headless surface");
+    return surface;
+}
+
+static VTK_OffscreenSwapchainInfo vtk_default_offscreen_swapchain_info(u32 width, u32 height) {
+    VTK_OffscreenSwapchainInfo info = {};
+    info.extent = { width, height };
+    info.image_format = VK_FORMAT_B8G8R8A8_UNORM;
+    info.image_usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT |
+                       VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+    info.image_count = 3;
+    return info;
+}
+
+// Pure offscreen image ring emulating swapchain acquire/present semantics. Needs no surface, no presentation queue and
+// no WSI extensions, so it runs on any implementation (e.g. lavapipe on display-less CI machines).
+static VTK_OffscreenSwapchain vtk_create_offscreen_swapchain(VkDevice logical_device,
+                                                             VkPhysicalDeviceMemoryProperties mem_props,
+                                                             VTK_OffscreenSwapchainInfo *info) {
+    VTK_OffscreenSwapchain swapchain = {};
+    swapchain.image_format = info->image_format;
+    swapchain.extent = info->extent;
+    swapchain.stats.min_frame_ns = CTK_U64_MAX;
+
+    if (info->image_count == 0 || info->image_count > CTK_ARRAY_SIZE(swapchain.images.data))
+        CTK_FATAL("offscreen swapchain image count %u must be in range [1, %u]", info->image_count,
+                  CTK_ARRAY_SIZE(swapchain.images.data))
+
+    for (u32 i = 0; i < info->image_count; ++i) {
+        VTK_OffscreenImage image = {};
+
+        VkImageCreateInfo image_info = {};
+        image_info.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+        image_info.flags = 0;
+        image_info.imageType = VK_IMAGE_TYPE_2D;
+        image_info.format = info->image_format;
+        image_info.extent = { info->extent.width, info->extent.height, 1 };
+        image_info.mipLevels = 1;
+        image_info.arrayLayers = 1;
+        image_info.samples = VK_SAMPLE_COUNT_1_BIT;
+        image_info.tiling = VK_IMAGE_TILING_OPTIMAL;
+        image_info.usage = info->image_usage;
+        image_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+        image_info.queueFamilyIndexCount = 0;
+        image_info.pQueueFamilyIndices = NULL; // Ignored if sharingMode is not VK_SHARING_MODE_CONCURRENT.
+        image_info.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+        vtk_validate_result(vkCreateImage(logical_device, &image_info, vtk_allocation_callbacks(), &image.handle),
+                            "failed to create offscreen swapchain image");
+
+        // Allocate / Bind Memory
+        VkMemoryRequirements mem_reqs = {};
+        vkGetImageMemoryRequirements(logical_device, image.handle, &mem_reqs);
+        VkMemoryAllocateInfo alloc_info = {};
+        alloc_info.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+        alloc_info.allocationSize = mem_reqs.size;
+        alloc_info.memoryTypeIndex = vtk_find_memory_type_index(mem_props, mem_reqs,
+                                                                VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+        vtk_validate_result(vkAllocateMemory(logical_device, &alloc_info, vtk_allocation_callbacks(), &image.memory),
+                            "failed to allocate offscreen swapchain image memory");
+        vtk_validate_result(vkBindImageMemory(logical_device, image.handle, image.memory, 0),
+                            "failed to bind offscreen swapchain image memory");
+
+        VkImageViewCreateInfo view_info = {};
+        view_info.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+        view_info.image = image.handle;
+        view_info.flags = 0;
+        view_info.viewType = VK_IMAGE_VIEW_TYPE_2D;
+        view_info.format = info->image_format;
+        view_info.components.r = VK_COMPONENT_SWIZZLE_IDENTITY;
+        view_info.components.g = VK_COMPONENT_SWIZZLE_IDENTITY;
+        view_info.components.b = VK_COMPONENT_SWIZZLE_IDENTITY;
+        view_info.components.a = VK_COMPONENT_SWIZZLE_IDENTITY;
+        view_info.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        view_info.subresourceRange.baseMipLevel = 0;
+        view_info.subresourceRange.levelCount = 1;
+        view_info.subresourceRange.baseArrayLayer = 0;
+        view_info.subresourceRange.layerCount = 1;
+        vtk_validate_result(vkCreateImageView(logical_device, &view_info, vtk_allocation_callbacks(), &image.view),
+                            "failed to create offscreen swapchain image view");
+
+        // Fences start signaled so the first acquire of each image doesn't block.
+        VkFenceCreateInfo fence_info = {};
+        fence_info.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+        fence_info.flags = VK_FENCE_CREATE_SIGNALED_BIT;
+        vtk_validate_result(vkCreateFence(logical_device, &fence_info,
+                                          vtk_allocation_callbacks(), &image.present_fence),
+                            "failed to create offscreen swapchain present fence");
+
+        VTK_SET_DEBUG_NAME(logical_device, VK_OBJECT_TYPE_IMAGE, image.handle, info->debug_name);
+        VTK_SET_DEBUG_NAME(logical_device, VK_OBJECT_TYPE_DEVICE_MEMORY, image.memory, info->debug_name);
+        VTK_SET_DEBUG_NAME(logical_device, VK_OBJECT_TYPE_IMAGE_VIEW, image.view, info->debug_name);
+        VTK_SET_DEBUG_NAME(logical_device, VK_OBJECT_TYPE_FENCE, image.present_fence, info->debug_name);
+        ctk_push(&swapchain.images, image);
+    }
+
+    return swapchain;
+}
+
+// Waits for every presented image to retire. An image still acquired (never presented) has no fence to wait on, so
+// work recorded against it must already be complete, e.g. after vkDeviceWaitIdle().
+static void vtk_destroy_offscreen_swapchain(VTK_OffscreenSwapchain *swapchain, VkDevice logical_device) {
+    for (u32 i = 0; i < swapchain->images.count; ++i) {
+        VTK_OffscreenImage *image = swapchain->images + i;
+        if (!image->acquired)
+            vkWaitForFences(logical_device, 1, &image->present_fence, VK_TRUE, CTK_U64_MAX);
+
+        vkDestroyFence(logical_device, image->present_fence, vtk_allocation_callbacks());
+        vkDestroyImageView(logical_device, image->view, vtk_allocation_callbacks());
+        vkDestroyImage(logical_device, image->handle, vtk_allocation_callbacks());
+        vkFreeMemory(logical_device, image->memory, vtk_allocation_callbacks());
+    }
+
+    *swapchain = {};
+}
+
+// Offscreen equivalent of vkAcquireNextImageKHR: blocks until the next image in the ring has retired, then signals
+// image_acquired_semaphore (if not VK_NULL_HANDLE) on queue so frame submissions can wait on it as usual. Each acquire
+// must be followed by vtk_present_offscreen_image() for that image before the ring wraps back to it; acquiring an
+// image that was never presented would wait forever, so it asserts instead.
+static u32 vtk_acquire_offscreen_image(VTK_OffscreenSwapchain *swapchain, VkDevice logical_device, VkQueue queue,
+                                       VkSemaphore image_acquired_semaphore) {
+    VTK_CPU_ZONE("vtk_acquire_offscreen_image");
+    u32 image_index = swapchain->next_image_index;
+    VTK_OffscreenImage *image = swapchain->images + image_index;
+    CTK_ASSERT(!image->acquired);
+
+    u64 wait_start = _vtk_now_ns();
+    vtk_validate_result(vkWaitForFences(logical_device, 1, &image->present_fence, VK_TRUE, CTK_U64_MAX),
+                        "failed to wait for offscreen swapchain image %u", image_index);
+    swapchain->stats.total_acquire_wait_ns += _vtk_now_ns() - wait_start;
+    vtk_validate_result(vkResetFences(logical_device, 1, &image->present_fence),
+                        "failed to reset offscreen swapchain present fence");
+    image->acquired = true;
+
+    if (image_acquired_semaphore != VK_NULL_HANDLE)
+        _vtk_submit_sync_only(queue, VK_NULL_HANDLE, image_acquired_semaphore, VK_NULL_HANDLE);
+
+    swapchain->next_image_index = (image_index + 1) % swapchain->images.count;
+    return image_index;
+}
+
+// Offscreen equivalent of vkQueuePresentKHR: waits on render_finished_semaphore (if not VK_NULL_HANDLE) and retires the
+// image once the queue reaches this point.
+static void vtk_present_offscreen_image(VTK_OffscreenSwapchain *swapchain, VkQueue queue, u32 image_index,
+                                        VkSemaphore render_finished_semaphore) {
+    VTK_CPU_ZONE("vtk_present_offscreen_image");
+    CTK_ASSERT(image_index < swapchain->images.count);
+    VTK_OffscreenImage *image = swapchain->images + image_index;
+    CTK_ASSERT(image->acquired);
+    _vtk_submit_sync_only(queue, render_finished_semaphore, VK_NULL_HANDLE, image->present_fence);
+    image->acquired = false;
+
+    // Update frame timing stats (present-to-present, so the first frame only records a timestamp).
+    u64 now = _vtk_now_ns();
+    if (swapchain->last_present_ns != 0) {
+        u64 frame_ns = now - swapchain->last_present_ns;
+        VTK_OffscreenSwapchainStats *stats = &swapchain->stats;
+        ++stats->frame_count;
+        stats->total_frame_ns += frame_ns;
+        stats->min_frame_ns = frame_ns < stats->min_frame_ns ? frame_ns : stats->min_frame_ns;
+        stats->max_frame_ns = frame_ns > stats->max_frame_ns ? frame_ns : stats->max_frame_ns;
+    }
+    swapchain->last_present_ns = now;
+}
+
+static void vtk_log_offscreen_swapchain_stats(VTK_OffscreenSwapchain *swapchain) {
+    VTK_OffscreenSwapchainStats *stats = &swapchain->stats;
+    if (stats->frame_count == 0) {
+        ctk_info("offscreen swapchain: no frames presented");
+        return;
+    }
+
+    f64 avg_ms = (f64)stats->total_frame_ns / (f64)stats->frame_count / 1000000.0;
+    ctk_info("offscreen swapchain: %llu frames, avg %.3fms (%.1f fps), min %.3fms, max %.3fms, "
+             "acquire wait %.3fms/frame", (unsigned long long)stats->frame_count, avg_ms, 1000.0 / avg_ms, (f64)stats->min_frame_ns / 1000000.0,
+             (f64)stats->max_frame_ns / 1000000.0,
+             (f64)stats->total_acquire_wait_ns / (f64)stats->frame_count / 1000000.0);
+}
@@ -0,0 +1,211 @@
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+#include <vulkan/vulkan.h>
+#include "ctk/ctk.h"
+#include "vtk/vtk.h"
+#include "vtk/device.h"
+#include "vtk/device_memory.h"
+#include "vtk/memory_types.h"
+#include "vtk/debug_utils.h"
+
+////////////////////////////////////////////////////////////
+/// Data
+////////////////////////////////////////////////////////////
+struct VTK_HostMemoryImportStats {
+    u64 imports;
+    u64 bytes_imported;
+    u64 fallbacks;
+    u64 bytes_copied; // Copied into host-visible device memory because importing wasn't possible.
+};
+
+// Imports existing host memory (decoded images, mmap'd asset files) as VkDeviceMemory through
+// VK_EXT_external_memory_host so buffers can bind to it directly, with no CPU copy. Falls back to copying into a
+// host-visible buffer when the extension isn't enabled or the driver rejects a pointer.
+struct VTK_HostMemoryImporter {
+    VkDevice logical_device;
+    VTK_DeviceMemoryAllocator *allocator;
+    VTK_MemoryTypeSelector *selector;
+    PFN_vkGetMemoryHostPointerPropertiesEXT vkGetMemoryHostPointerPropertiesEXT;
+    VkDeviceSize min_alignment; // minImportedHostPointerAlignment; both pointer and size are aligned to it.
+    bool supported;
+    VTK_HostMemoryImportStats stats;
+};
+
+struct VTK_ImportedHostMemory {
+    VkBuffer buffer;
+    VkDeviceSize offset; // Offset of the imported data within buffer (the pointer is aligned down to import it).
+    VkDeviceSize size;
+
+    // Set when imported; otherwise the data lives in allocation, a copy made by the fallback path.
+    VkDeviceMemory memory;
+    u32 allocation;
+    bool imported;
+};
+
+////////////////////////////////////////////////////////////
+/// Internal
+////////////////////////////////////////////////////////////
+static bool _vtk_import_host_memory(VTK_HostMemoryImporter *importer, void const *data, VkDeviceSize size,
+                                    VkBufferUsageFlags usage, VTK_ImportedHostMemory *imported) {
+    uintptr_t address = (uintptr_t)data;
+    uintptr_t aligned_address = address & ~(uintptr_t)(importer->min_alignment - 1);
+    VkDeviceSize offset = address - aligned_address;
+    VkDeviceSize aligned_size = _vtk_align_up(offset + size, importer->min_alignment);
+    VkExternalMemoryHandleTypeFlagBits handle_type = VK_EXTERNAL_MEMORY_HANDLE_TYPE_HOST_ALLOCATION_BIT_EXT;
+
+    VkMemoryHostPointerPropertiesEXT pointer_properties = {};
+    pointer_properties.sType = VK_STRUCTURE_TYPE_MEMORY_HOST_POINTER_PROPERTIES_EXT;
+    VkResult result = importer->vkGetMemoryHostPointerPropertiesEXT(importer->logical_device, handle_type,
+                                                                    (void *)aligned_address, &pointer_properties);
+    if (result != VK_SUCCESS || pointer_properties.memoryTypeBits == 0)
+        return false;
+
+    VkExternalMemoryBufferCreateInfo external_info = {};
+    external_info.sType = VK_STRUCTURE_TYPE_EXTERNAL_MEMORY_BUFFER_CREATE_INFO;
+    external_info.handleTypes = handle_type;
+    VkBufferCreateInfo buffer_info = {};
+    buffer_info.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+    buffer_info.pNext = &external_info;
+    buffer_info.size = aligned_size;
+    buffer_info.usage = usage;
+    buffer_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    VkBuffer buffer = VK_NULL_HANDLE;
+    vtk_validate_result(vkCreateBuffer(importer->logical_device, &buffer_info, vtk_allocation_callbacks(), &buffer),
+                        "failed to create buffer for imported host memory");
+
+    VkMemoryRequirements requirements = {};
+    vkGetBufferMemoryRequirements(importer->logical_device, buffer, &requirements);
+    requirements.memoryTypeBits &= pointer_properties.memoryTypeBits;
+    u32 memory_type_index = vtk_select_memory_type(importer->selector, requirements.memoryTypeBits,
+                                                   VTK_MEMORY_INTENT_UPLOAD);
+    if (memory_type_index == CTK_U32_MAX || requirements.size > aligned_size) {
+        vkDestroyBuffer(importer->logical_device, buffer, vtk_allocation_callbacks());
+        return false;
+    }
+
+    VkImportMemoryHostPointerInfoEXT import_info = {};
+    import_info.sType = VK_STRUCTURE_TYPE_IMPORT_MEMORY_HOST_POINTER_INFO_EXT;
+    import_info.handleType = handle_type;
+    import_info.pHostPointer = (void *)aligned_address;
+    VkMemoryAllocateInfo allocate_info = {};
+    allocate_info.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+    allocate_info.pNext = &import_info;
+    allocate_info.allocationSize = aligned_size;
+    allocate_info.memoryTypeIndex = memory_type_index;
+    VkDeviceMemory memory = VK_NULL_HANDLE;
+    result = VTK_RECORD_RESULT(vkAllocateMemory(importer->logical_device, &allocate_info, vtk_allocation_callbacks(),
+                                                &memory));
+    if (result != VK_SUCCESS) {
+        vkDestroyBuffer(importer->logical_device, buffer, vtk_allocation_callbacks());
+        return false;
+    }
+
+    vtk_validate_result(vkBindBufferMemory(importer->logical_device, buffer, memory, 0),
+                        "failed to bind imported host memory");
+    imported->buffer = buffer;
+    imported->offset = offset;
+    imported->size = size;
+    imported->memory = memory;
+    imported->allocation = VTK_NULL_ALLOCATION;
+    imported->imported = true;
+    return true;
+}
+
+////////////////////////////////////////////////////////////
+/// Interface
+////////////////////////////////////////////////////////////
+
+// The fallback path copies through allocator, using selector's UPLOAD memory type.
+static void vtk_init_host_memory_importer(VTK_HostMemoryImporter *importer, VTK_Device *device,
+                                          VTK_DeviceMemoryAllocator *allocator, VTK_MemoryTypeSelector *selector) {
+    *importer = {};
+    importer->logical_device = device->logical;
+    importer->allocator = allocator;
+    importer->selector = selector;
+    importer->vkGetMemoryHostPointerPropertiesEXT = device->dispatch.vkGetMemoryHostPointerPropertiesEXT;
+    importer->supported = device->api_version >= VK_API_VERSION_1_1 &&
+                          vtk_device_extension_enabled(device, VK_EXT_EXTERNAL_MEMORY_HOST_EXTENSION_NAME) &&
+                          importer->vkGetMemoryHostPointerPropertiesEXT != NULL;
+    if (!importer->supported) {
+        ctk_info("VK_EXT_external_memory_host not available; host memory will be copied instead of imported");
+        return;
+    }
+
+    VkPhysicalDeviceExternalMemoryHostPropertiesEXT host_properties = {};
+    host_properties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_EXTERNAL_MEMORY_HOST_PROPERTIES_EXT;
+    VkPhysicalDeviceProperties2 properties = {};
+    properties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
+    properties.pNext = &host_properties;
+    vkGetPhysicalDeviceProperties2(device->physical, &properties);
+    importer->min_alignment = host_properties.minImportedHostPointerAlignment;
+}
+
+// Makes size bytes at data available to the GPU as a buffer with usage (typically TRANSFER_SRC for copies into
+// device-local resources, or VERTEX/INDEX/STORAGE for direct reads). The import covers data aligned out to
+// min_alignment on both ends, which is a page in practice, so the surrounding pages must be mapped; heap allocations
+// and mmap'd file ranges always satisfy this. While imported, data must stay valid and unchanged until
+// vtk_release_host_memory(); the fallback copy has no such requirement. Check imported->imported to tell them apart.
+static VTK_ImportedHostMemory vtk_import_host_memory(VTK_HostMemoryImporter *importer, void const *data,
+                                                     VkDeviceSize size, VkBufferUsageFlags usage,
+                                                     cstr debug_name = NULL) {
+    VTK_CPU_ZONE("vtk_import_host_memory");
+    VTK_ImportedHostMemory imported = {};
+    if (importer->supported && _vtk_import_host_memory(importer, data, size, usage, &imported)) {
+        ++importer->stats.imports;
+        importer->stats.bytes_imported += size;
+        VTK_SET_DEBUG_NAME(importer->logical_device, VK_OBJECT_TYPE_BUFFER, imported.buffer, debug_name);
+        VTK_SET_DEBUG_NAME(importer->logical_device, VK_OBJECT_TYPE_DEVICE_MEMORY, imported.memory, debug_name);
+        return imported;
+    }
+
+    VkBufferCreateInfo buffer_info = {};
+    buffer_info.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+    buffer_info.size = size;
+    buffer_info.usage = usage;
+    buffer_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    imported.allocation = vtk_create_allocated_buffer(importer->allocator, importer->selector, &buffer_info,
+                                                      VTK_MEMORY_INTENT_UPLOAD, false, debug_name);
+    if (imported.allocation == VTK_NULL_ALLOCATION)
+        CTK_FATAL("failed to allocate %llu bytes for host memory import fallback", (unsigned long long)size)
+
+    VTK_DeviceAllocation *allocation = vtk_device_allocation(importer->allocator, imported.allocation);
+    memcpy(allocation->mapped, data, size);
+    imported.buffer = allocation->buffer;
+    imported.size = size;
+    ++importer->stats.fallbacks;
+    importer->stats.bytes_copied += size;
+    return imported;
+}
+
+// The GPU must be done with the buffer.
+static void vtk_release_host_memory(VTK_HostMemoryImporter *importer, VTK_ImportedHostMemory *imported) {
+    if (imported->imported) {
+        vkDestroyBuffer(importer->logical_device, imported->buffer, vtk_allocation_callbacks());
+        vkFreeMemory(importer->logical_device, imported->memory, vtk_allocation_callbacks());
+    }
+    else {
+        vtk_free_device_region(importer->allocator, imported->allocation);
+    }
+
+    *imported = {};
+}
+
+// Records a copy from imported host memory straight into dst_buffer; the GPU reads the host pages directly.
+static void vtk_copy_imported_host_memory(VkCommandBuffer command_buffer, VTK_ImportedHostMemory *imported,
+                                          VkBuffer dst_buffer, VkDeviceSize dst_offset) {
+    VkBufferCopy copy = {};
+    copy.srcOffset = imported->offset;
+    copy.dstOffset = dst_offset;
+    copy.size = imported->size;
+    vkCmdCopyBuffer(command_buffer, imported->buffer, dst_buffer, 1, &copy);
+}
+
+static void vtk_log_host_memory_import_stats(VTK_HostMemoryImporter *importer) {
+    VTK_HostMemoryImportStats *stats = &importer->stats;
+    ctk_info("host memory import (%s): %llu imports (%llu MiB), %llu fallbacks (%llu MiB copied)",
+             importer->supported ? "VK_EXT_external_memory_host" : "unsupported", (unsigned long long)stats->imports,
+             (unsigned long long)(stats->bytes_imported >> 20), (unsigned long long)stats->fallbacks,
+             (unsigned long long)(stats->bytes_copied >> 20));
+}
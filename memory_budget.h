@@ -0,0 +1,217 @@
+#pragma once
+
+#include <atomic>
+#include <vulkan/vulkan.h>
+#include "ctk/ctk.h"
+#include "vtk/vtk.h"
+#include "vtk/device.h"
+
+////////////////////////////////////////////////////////////
+/// Data
+////////////////////////////////////////////////////////////
+static u32 const VTK_MEMORY_BUDGET_MAX_EVICTION_CALLBACKS = 16;
+
+enum {
+    VTK_MEMORY_PRESSURE_NONE,
+    VTK_MEMORY_PRESSURE_LOW,
+    VTK_MEMORY_PRESSURE_HIGH,
+    VTK_MEMORY_PRESSURE_CRITICAL,
+    VTK_MEMORY_PRESSURE_COUNT,
+};
+
+// Asked to free about bytes_to_free from heap_index (e.g. by dropping texture mips); returns how much it actually
+// freed. Freed memory must go through vtk_free_device_memory() (or vtk_track_device_memory_free()) to be seen by the
+// budget.
+typedef VkDeviceSize (*VTK_EvictionCallback)(void *user_data, u32 heap_index, s32 pressure,
+                                             VkDeviceSize bytes_to_free);
+
+struct VTK_EvictionHandler {
+    VTK_EvictionCallback callback;
+    void *user_data;
+    s32 min_pressure;
+};
+
+struct VTK_MemoryHeapBudget {
+    VkDeviceSize size;
+    VkDeviceSize budget;
+    VkDeviceSize usage;
+    s32 pressure;
+    bool device_local;
+};
+
+struct VTK_MemoryBudget {
+    VkPhysicalDevice physical_device;
+    VkPhysicalDeviceMemoryProperties memory_properties;
+    VTK_MemoryHeapBudget heaps[VK_MAX_MEMORY_HEAPS];
+    u32 heap_count;
+
+    // Bytes allocated through vtk per heap; the whole budget when VK_EXT_memory_budget isn't supported.
+    std::atomic<VkDeviceSize> tracked_usage[VK_MAX_MEMORY_HEAPS];
+
+    // Fractions of budget at which each pressure level starts (LOW, HIGH, CRITICAL). Eviction targets the LOW
+    // threshold.
+    f32 pressure_thresholds[VTK_MEMORY_PRESSURE_COUNT - 1];
+
+    // Fraction of a heap's size assumed available without VK_EXT_memory_budget; the rest is left for other processes
+    // and driver-internal allocations.
+    f32 fallback_budget_fraction;
+
+    CTK_StaticArray<VTK_EvictionHandler, VTK_MEMORY_BUDGET_MAX_EVICTION_CALLBACKS> eviction_handlers;
+    bool ext_memory_budget;
+};
+
+////////////////////////////////////////////////////////////
+/// Internal
+////////////////////////////////////////////////////////////
+static s32 _vtk_memory_pressure(VTK_MemoryBudget *budget, VkDeviceSize usage, VkDeviceSize heap_budget) {
+    s32 pressure = VTK_MEMORY_PRESSURE_NONE;
+    for (u32 i = 0; i < VTK_MEMORY_PRESSURE_COUNT - 1; ++i) {
+        if ((f64)usage >= (f64)heap_budget * budget->pressure_thresholds[i])
+            pressure = (s32)i + 1;
+    }
+
+    return pressure;
+}
+
+static VkDeviceSize _vtk_evict(VTK_MemoryBudget *budget, u32 heap_index, s32 pressure, VkDeviceSize bytes_to_free) {
+    VkDeviceSize freed = 0;
+    for (u32 i = 0; i < budget->eviction_handlers.count && freed < bytes_to_free; ++i) {
+        VTK_EvictionHandler *handler = budget->eviction_handlers + i;
+        if (pressure >= handler->min_pressure)
+            freed += handler->callback(handler->user_data, heap_index, pressure, bytes_to_free - freed);
+    }
+
+    return freed;
+}
+
+////////////////////////////////////////////////////////////
+/// Interface
+////////////////////////////////////////////////////////////
+
+// VK_EXT_memory_budget is physical-device-level functionality, so it only needs to be supported (not enabled), plus
+// Vulkan 1.1 for vkGetPhysicalDeviceMemoryProperties2.
+static void vtk_init_memory_budget(VTK_MemoryBudget *budget, VTK_Device *device) {
+    budget->physical_device = device->physical;
+    budget->memory_properties = device->memory_properties;
+    budget->heap_count = device->memory_properties.memoryHeapCount;
+    budget->pressure_thresholds[0] = 0.70f;
+    budget->pressure_thresholds[1] = 0.85f;
+    budget->pressure_thresholds[2] = 0.95f;
+    budget->fallback_budget_fraction = 0.8f;
+    budget->eviction_handlers.count = 0;
+    budget->ext_memory_budget = device->api_version >= VK_API_VERSION_1_1 &&
+                                vtk_device_extension_supported(device->query, VK_EXT_MEMORY_BUDGET_EXTENSION_NAME);
+    for (u32 i = 0; i < VK_MAX_MEMORY_HEAPS; ++i) {
+        budget->heaps[i] = {};
+        budget->tracked_usage[i] = 0;
+    }
+
+    for (u32 i = 0; i < budget->heap_count; ++i) {
+        VkMemoryHeap *heap = budget->memory_properties.memoryHeaps + i;
+        budget->heaps[i].size = heap->size;
+        budget->heaps[i].budget = (VkDeviceSize)((f64)heap->size * budget->fallback_budget_fraction);
+        budget->heaps[i].device_local = heap->flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT;
+    }
+
+    if (!budget->ext_memory_budget)
+        ctk_info("VK_EXT_memory_budget not supported; memory budget estimated from tracked allocations");
+}
+
+// Handlers are called in registration order until enough has been freed, so register cheap-to-rebuild content first.
+static void vtk_register_eviction_callback(VTK_MemoryBudget *budget, VTK_EvictionCallback callback, void *user_data,
+                                           s32 min_pressure) {
+    VTK_EvictionHandler handler = {};
+    handler.callback = callback;
+    handler.user_data = user_data;
+    handler.min_pressure = min_pressure;
+    ctk_push(&budget->eviction_handlers, handler);
+}
+
+static void vtk_track_device_memory_allocation(VTK_MemoryBudget *budget, u32 memory_type_index, VkDeviceSize size) {
+    u32 heap_index = budget->memory_properties.memoryTypes[memory_type_index].heapIndex;
+    budget->tracked_usage[heap_index].fetch_add(size, std::memory_order_relaxed);
+}
+
+static void vtk_track_device_memory_free(VTK_MemoryBudget *budget, u32 memory_type_index, VkDeviceSize size) {
+    u32 heap_index = budget->memory_properties.memoryTypes[memory_type_index].heapIndex;
+    budget->tracked_usage[heap_index].fetch_sub(size, std::memory_order_relaxed);
+}
+
+// Call once per frame from the thread that owns the eviction handlers. Refreshes usage/budget and evicts from any heap
+// that's reached the lowest pressure level a handler is registered for.
+static void vtk_update_memory_budget(VTK_MemoryBudget *budget) {
+    VkPhysicalDeviceMemoryBudgetPropertiesEXT budget_properties = {};
+    budget_properties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_BUDGET_PROPERTIES_EXT;
+    if (budget->ext_memory_budget) {
+        VkPhysicalDeviceMemoryProperties2 memory_properties = {};
+        memory_properties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_PROPERTIES_2;
+        memory_properties.pNext = &budget_properties;
+        vkGetPhysicalDeviceMemoryProperties2(budget->physical_device, &memory_properties);
+    }
+
+    for (u32 heap_index = 0; heap_index < budget->heap_count; ++heap_index) {
+        VTK_MemoryHeapBudget *heap = budget->heaps + heap_index;
+        VkDeviceSize tracked_usage = budget->tracked_usage[heap_index].load(std::memory_order_relaxed);
+        if (budget->ext_memory_budget) {
+            // Driver-reported usage can lag allocations made this frame.
+            heap->budget = budget_properties.heapBudget[heap_index];
+            heap->usage = budget_properties.heapUsage[heap_index] > tracked_usage
+                          ? budget_properties.heapUsage[heap_index]
+                          : tracked_usage;
+        }
+        else {
+            heap->usage = tracked_usage;
+        }
+
+        heap->pressure = _vtk_memory_pressure(budget, heap->usage, heap->budget);
+        if (heap->pressure == VTK_MEMORY_PRESSURE_NONE)
+            continue;
+
+        VkDeviceSize target = (VkDeviceSize)((f64)heap->budget * budget->pressure_thresholds[0]);
+        VkDeviceSize freed = _vtk_evict(budget, heap_index, heap->pressure, heap->usage - target);
+        heap->usage = freed < heap->usage ? heap->usage - freed : 0;
+    }
+}
+
+static s32 vtk_memory_pressure(VTK_MemoryBudget *budget, u32 memory_type_index) {
+    return budget->heaps[budget->memory_properties.memoryTypes[memory_type_index].heapIndex].pressure;
+}
+
+// Tracked vkAllocateMemory. On VK_ERROR_OUT_OF_DEVICE_MEMORY, critical eviction handlers are asked to free the
+// allocation size from the target heap and the allocation is retried once. The result is returned rather than
+// validated so callers can fall back (e.g. to a host-visible type).
+static VkResult vtk_allocate_device_memory(VTK_MemoryBudget *budget, VkDevice logical_device,
+                                           VkMemoryAllocateInfo *info, VkDeviceMemory *memory) {
+    VkResult result = vkAllocateMemory(logical_device, info, vtk_allocation_callbacks(), memory);
+    if (result == VK_ERROR_OUT_OF_DEVICE_MEMORY) {
+        u32 heap_index = budget->memory_properties.memoryTypes[info->memoryTypeIndex].heapIndex;
+        ctk_warning("out of device memory allocating %llu bytes from heap %u; evicting",
+                    (unsigned long long)info->allocationSize, heap_index);
+        if (_vtk_evict(budget, heap_index, VTK_MEMORY_PRESSURE_CRITICAL, info->allocationSize) > 0)
+            result = vkAllocateMemory(logical_device, info, vtk_allocation_callbacks(), memory);
+    }
+
+    if (result == VK_SUCCESS)
+        vtk_track_device_memory_allocation(budget, info->memoryTypeIndex, info->allocationSize);
+
+    return VTK_RECORD_RESULT(result);
+}
+
+static void vtk_free_device_memory(VTK_MemoryBudget *budget, VkDevice logical_device, VkDeviceMemory memory,
+                                   u32 memory_type_index, VkDeviceSize size) {
+    vkFreeMemory(logical_device, memory, vtk_allocation_callbacks());
+    vtk_track_device_memory_free(budget, memory_type_index, size);
+}
+
+static void vtk_log_memory_budget(VTK_MemoryBudget *budget) {
+    static cstr const PRESSURE_NAMES[] = { "none", "low", "high", "critical" };
+    ctk_info("memory budget (%s):", budget->ext_memory_budget ? "VK_EXT_memory_budget" : "estimated");
+    for (u32 i = 0; i < budget->heap_count; ++i) {
+        VTK_MemoryHeapBudget *heap = budget->heaps + i;
+        ctk_info("    heap %u%s: %llu / %llu MiB (size %llu MiB, tracked %llu MiB), pressure %s", i,
+                 heap->device_local ? " (device local)" : "", (unsigned long long)(heap->usage >> 20),
+                 (unsigned long long)(heap->budget >> 20), (unsigned long long)(heap->size >> 20),
+                 (unsigned long long)(budget->tracked_usage[i].load(std::memory_order_relaxed) >> 20),
+                 PRESSURE_NAMES[heap->pressure]);
+    }
+}
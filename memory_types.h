@@ -0,0 +1,279 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include "ctk/ctk.h"
+#include "vtk/vtk.h"
+#include "vtk/device.h"
+
+////////////////////////////////////////////////////////////
+/// Data
+////////////////////////////////////////////////////////////
+enum {
+    VTK_MEMORY_INTENT_GPU_ONLY, // Written by transfers or the GPU, never touched by the host.
+    VTK_MEMORY_INTENT_UPLOAD,   // Host-written staging source, read once by transfers.
+    VTK_MEMORY_INTENT_READBACK, // GPU-written, host-read.
+    VTK_MEMORY_INTENT_DYNAMIC,  // Host-written every frame and read directly by the GPU (uniforms, per-frame vertices).
+    VTK_MEMORY_INTENT_COUNT,
+};
+
+struct VTK_MemoryTypeRequest {
+    VkMemoryPropertyFlags required;
+    VkMemoryPropertyFlags preferred;
+    VkMemoryPropertyFlags avoided;
+};
+
+static u32 const VTK_MEMORY_TYPE_CACHE_SIZE = 32;
+
+struct _VTK_MemoryTypeCacheEntry {
+    u32 memory_type_bits;
+    u8 memory_type_indexes[VTK_MEMORY_INTENT_COUNT];
+};
+
+struct VTK_MemoryTypeSelector {
+    VkPhysicalDeviceMemoryProperties memory_properties;
+    VTK_MemoryTypeRequest requests[VTK_MEMORY_INTENT_COUNT];
+
+    // Memory types ranked best-first per intent; types that don't meet the intent's required flags are left out.
+    u8 ranked_types[VTK_MEMORY_INTENT_COUNT][VK_MAX_MEMORY_TYPES];
+    u32 ranked_type_counts[VTK_MEMORY_INTENT_COUNT];
+
+    // Resolved selections per distinct memoryTypeBits; resources of the same kind report the same bits, so this stays
+    // small and turns selection into a short scan.
+    _VTK_MemoryTypeCacheEntry cache[VTK_MEMORY_TYPE_CACHE_SIZE];
+    u32 cache_count;
+
+    // DEVICE_LOCAL | HOST_VISIBLE memory (resizable BAR, UMA, or the 256MiB PCIe window).
+    VkDeviceSize bar_heap_size;
+    bool has_bar;
+    bool unified_memory;
+
+    // Vulkan 1.1 (VK_KHR_dedicated_allocation/get_memory_requirements2 promoted); without it dedicated hints are never
+    // queried and dedicated allocations are only made by size.
+    bool dedicated_allocation;
+};
+
+////////////////////////////////////////////////////////////
+/// Internal
+////////////////////////////////////////////////////////////
+static u32 _vtk_flag_count(VkMemoryPropertyFlags flags) {
+    u32 count = 0;
+    for (; flags; flags &= flags - 1)
+        ++count;
+
+    return count;
+}
+
+static s64 _vtk_score_memory_type(VTK_MemoryTypeSelector *selector, VTK_MemoryTypeRequest *request, u32 type_index) {
+    VkMemoryType *type = selector->memory_properties.memoryTypes + type_index;
+    if ((type->propertyFlags & request->required) != request->required)
+        return -1;
+
+    // Flag matches dominate; heap size (in MiB) breaks ties so the larger of two equivalent heaps wins.
+    VkDeviceSize heap_size = selector->memory_properties.memoryHeaps[type->heapIndex].size;
+    s64 score = (s64)1 << 50;
+    score += (s64)_vtk_flag_count(type->propertyFlags & request->preferred) << 40;
+    score -= (s64)_vtk_flag_count(type->propertyFlags & request->avoided) << 44;
+    score += (s64)(heap_size >> 20);
+    return score;
+}
+
+static u32 _vtk_select_ranked_type(VTK_MemoryTypeSelector *selector, s32 intent, u32 memory_type_bits) {
+    for (u32 i = 0; i < selector->ranked_type_counts[intent]; ++i) {
+        u32 type_index = selector->ranked_types[intent][i];
+        if (memory_type_bits & (1u << type_index))
+            return type_index;
+    }
+
+    return CTK_U32_MAX;
+}
+
+////////////////////////////////////////////////////////////
+/// Interface
+////////////////////////////////////////////////////////////
+static VTK_MemoryTypeRequest vtk_default_memory_type_request(s32 intent, bool has_bar) {
+    VTK_MemoryTypeRequest request = {};
+    switch (intent) {
+        case VTK_MEMORY_INTENT_GPU_ONLY:
+            // Keep BAR free for DYNAMIC data.
+            request.required = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+            request.avoided = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT;
+            break;
+        case VTK_MEMORY_INTENT_UPLOAD:
+            request.required = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+            request.avoided = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT | VK_MEMORY_PROPERTY_HOST_CACHED_BIT;
+            break;
+        case VTK_MEMORY_INTENT_READBACK:
+            request.required = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT;
+            request.preferred = VK_MEMORY_PROPERTY_HOST_CACHED_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+            break;
+        case VTK_MEMORY_INTENT_DYNAMIC:
+            request.required = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+            request.preferred = has_bar ? VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT : 0;
+            request.avoided = VK_MEMORY_PROPERTY_HOST_CACHED_BIT;
+            break;
+        default:
+            CTK_FATAL("unknown memory intent %d", intent)
+    }
+
+    return request;
+}
+
+// Overrides an intent's flag sets and re-ranks its memory types.
+static void vtk_set_memory_type_request(VTK_MemoryTypeSelector *selector, s32 intent, VTK_MemoryTypeRequest request) {
+    selector->requests[intent] = request;
+
+    s64 scores[VK_MAX_MEMORY_TYPES] = {};
+    u32 ranked_count = 0;
+    u8 *ranked = selector->ranked_types[intent];
+    for (u32 type_index = 0; type_index < selector->memory_properties.memoryTypeCount; ++type_index) {
+        s64 score = _vtk_score_memory_type(selector, &request, type_index);
+        if (score < 0)
+            continue;
+
+        u32 i = ranked_count++;
+        for (; i > 0 && scores[i - 1] < score; --i) {
+            scores[i] = scores[i - 1];
+            ranked[i] = ranked[i - 1];
+        }
+
+        scores[i] = score;
+        ranked[i] = (u8)type_index;
+    }
+
+    selector->ranked_type_counts[intent] = ranked_count;
+    selector->cache_count = 0;
+}
+
+static void vtk_init_memory_type_selector(VTK_MemoryTypeSelector *selector, VTK_Device *device) {
+    *selector = {};
+    selector->memory_properties = device->memory_properties;
+    VkPhysicalDeviceMemoryProperties *memory_properties = &selector->memory_properties;
+
+    bool all_device_local = true;
+    for (u32 i = 0; i < memory_properties->memoryTypeCount; ++i) {
+        VkMemoryType *type = memory_properties->memoryTypes + i;
+        VkMemoryPropertyFlags bar_flags = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT | VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT;
+        if ((type->propertyFlags & bar_flags) == bar_flags) {
+            VkDeviceSize heap_size = memory_properties->memoryHeaps[type->heapIndex].size;
+            selector->has_bar = true;
+            selector->bar_heap_size = heap_size > selector->bar_heap_size ? heap_size : selector->bar_heap_size;
+        }
+
+        if (type->propertyFlags != 0)
+            all_device_local &= (type->propertyFlags & VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT) != 0;
+    }
+    selector->unified_memory = all_device_local;
+    selector->dedicated_allocation = device->api_version >= VK_API_VERSION_1_1;
+
+    for (s32 intent = 0; intent < VTK_MEMORY_INTENT_COUNT; ++intent)
+        vtk_set_memory_type_request(selector, intent, vtk_default_memory_type_request(intent, selector->has_bar));
+
+    ctk_info("memory types: %s%s, BAR heap %llu MiB", selector->has_bar ? "BAR" : "no BAR",
+             selector->unified_memory ? " (unified memory)" : "", (unsigned long long)(selector->bar_heap_size >> 20));
+}
+
+// Best memory type for intent among memory_type_bits (from VkMemoryRequirements). Returns CTK_U32_MAX if none meets
+// the intent's required flags.
+static u32 vtk_select_memory_type(VTK_MemoryTypeSelector *selector, u32 memory_type_bits, s32 intent) {
+    for (u32 i = 0; i < selector->cache_count; ++i) {
+        if (selector->cache[i].memory_type_bits == memory_type_bits) {
+            u8 type_index = selector->cache[i].memory_type_indexes[intent];
+            return type_index == 0xFF ? CTK_U32_MAX : type_index;
+        }
+    }
+
+    _VTK_MemoryTypeCacheEntry entry = {};
+    entry.memory_type_bits = memory_type_bits;
+    for (s32 i = 0; i < VTK_MEMORY_INTENT_COUNT; ++i) {
+        u32 type_index = _vtk_select_ranked_type(selector, i, memory_type_bits);
+        entry.memory_type_indexes[i] = type_index == CTK_U32_MAX ? 0xFF : (u8)type_index;
+    }
+
+    // When full, the cache stops growing and uncached lookups fall back to the ranked scan.
+    if (selector->cache_count < VTK_MEMORY_TYPE_CACHE_SIZE)
+        selector->cache[selector->cache_count++] = entry;
+
+    return entry.memory_type_indexes[intent] == 0xFF ? CTK_U32_MAX : entry.memory_type_indexes[intent];
+}
+
+// Whether data written for memory_type_index has to go through a staging copy rather than a direct write.
+static bool vtk_memory_type_needs_staging(VTK_MemoryTypeSelector *selector, u32 memory_type_index) {
+    return !(selector->memory_properties.memoryTypes[memory_type_index].propertyFlags &
+             VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT);
+}
+
+////////////////////////////////////////////////////////////
+/// Dedicated Allocations
+////////////////////////////////////////////////////////////
+
+// Resources at least this large get their own VkDeviceMemory, so they never pin mostly-empty blocks or get in the
+// defragmenter's way.
+static VkDeviceSize const VTK_DEDICATED_ALLOCATION_THRESHOLD = 32 * 1024 * 1024;
+
+// Render targets at least this large get dedicated memory; drivers can apply compression/placement optimizations
+// they can't for sub-allocated ranges.
+static VkDeviceSize const VTK_DEDICATED_RENDER_TARGET_THRESHOLD = 4 * 1024 * 1024;
+
+// Memory requirements plus the driver's dedicated allocation hints (core in Vulkan 1.1, VK_KHR_dedicated_allocation).
+struct VTK_MemoryRequirements {
+    VkMemoryRequirements requirements;
+    bool prefers_dedicated;
+    bool requires_dedicated;
+};
+
+static VTK_MemoryRequirements vtk_get_image_memory_requirements(VTK_MemoryTypeSelector *selector,
+                                                                VkDevice logical_device, VkImage image) {
+    VTK_MemoryRequirements memory_requirements = {};
+    if (!selector->dedicated_allocation) {
+        vkGetImageMemoryRequirements(logical_device, image, &memory_requirements.requirements);
+        return memory_requirements;
+    }
+
+    VkMemoryDedicatedRequirements dedicated = {};
+    dedicated.sType = VK_STRUCTURE_TYPE_MEMORY_DEDICATED_REQUIREMENTS;
+    VkMemoryRequirements2 requirements = {};
+    requirements.sType = VK_STRUCTURE_TYPE_MEMORY_REQUIREMENTS_2;
+    requirements.pNext = &dedicated;
+    VkImageMemoryRequirementsInfo2 info = {};
+    info.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_REQUIREMENTS_INFO_2;
+    info.image = image;
+    vkGetImageMemoryRequirements2(logical_device, &info, &requirements);
+
+    memory_requirements.requirements = requirements.memoryRequirements;
+    memory_requirements.prefers_dedicated = dedicated.prefersDedicatedAllocation;
+    memory_requirements.requires_dedicated = dedicated.requiresDedicatedAllocation;
+    return memory_requirements;
+}
+
+static VTK_MemoryRequirements vtk_get_buffer_memory_requirements(VTK_MemoryTypeSelector *selector,
+                                                                 VkDevice logical_device, VkBuffer buffer) {
+    VTK_MemoryRequirements memory_requirements = {};
+    if (!selector->dedicated_allocation) {
+        vkGetBufferMemoryRequirements(logical_device, buffer, &memory_requirements.requirements);
+        return memory_requirements;
+    }
+
+    VkMemoryDedicatedRequirements dedicated = {};
+    dedicated.sType = VK_STRUCTURE_TYPE_MEMORY_DEDICATED_REQUIREMENTS;
+    VkMemoryRequirements2 requirements = {};
+    requirements.sType = VK_STRUCTURE_TYPE_MEMORY_REQUIREMENTS_2;
+    requirements.pNext = &dedicated;
+    VkBufferMemoryRequirementsInfo2 info = {};
+    info.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_REQUIREMENTS_INFO_2;
+    info.buffer = buffer;
+    vkGetBufferMemoryRequirements2(logical_device, &info, &requirements);
+
+    memory_requirements.requirements = requirements.memoryRequirements;
+    memory_requirements.prefers_dedicated = dedicated.prefersDedicatedAllocation;
+    memory_requirements.requires_dedicated = dedicated.requiresDedicatedAllocation;
+    return memory_requirements;
+}
+
+static bool vtk_use_dedicated_allocation(VTK_MemoryRequirements *requirements, bool render_target) {
+    // Without Vulkan 1.1 there's no VkMemoryDedicatedAllocateInfo, but a resource alone in its own allocation still
+    // keeps large resources out of the shared blocks.
+    VkDeviceSize size = requirements->requirements.size;
+    return requirements->requires_dedicated || requirements->prefers_dedicated ||
+           size >= VTK_DEDICATED_ALLOCATION_THRESHOLD ||
+           (render_target && size >= VTK_DEDICATED_RENDER_TARGET_THRESHOLD);
+}
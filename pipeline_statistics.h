@@ -0,0 +1,253 @@
+#pragma once
+
+#include <stdio.h>
+#include <string.h>
+#include <vulkan/vulkan.h>
+#include "ctk/ctk.h"
+#include "vtk/vtk.h"
+#include "vtk/debug_utils.h"
+
+////////////////////////////////////////////////////////////
+/// Data
+////////////////////////////////////////////////////////////
+static u32 const VTK_PIPELINE_STATISTICS_MAX_FRAMES = 4;
+static u32 const VTK_PIPELINE_STATISTICS_MAX_SCOPES = 64;
+static u32 const VTK_PIPELINE_STATISTICS_MAX_SCOPE_NAMES = 128;
+
+// Results are written in flag bit order, which is the order of the counters in VTK_PipelineStatisticsCounters.
+static VkQueryPipelineStatisticFlags const VTK_PIPELINE_STATISTICS_FLAGS =
+    VK_QUERY_PIPELINE_STATISTIC_VERTEX_SHADER_INVOCATIONS_BIT |
+    VK_QUERY_PIPELINE_STATISTIC_CLIPPING_PRIMITIVES_BIT |
+    VK_QUERY_PIPELINE_STATISTIC_FRAGMENT_SHADER_INVOCATIONS_BIT |
+    VK_QUERY_PIPELINE_STATISTIC_COMPUTE_SHADER_INVOCATIONS_BIT;
+
+struct VTK_PipelineStatisticsCounters {
+    u64 vertex_invocations;
+    u64 clipping_primitives;
+    u64 fragment_invocations;
+    u64 compute_invocations;
+};
+
+struct VTK_PipelineStatisticsScope {
+    u32 name_index;
+    u32 query;
+};
+
+struct VTK_PipelineStatisticsFrame {
+    VkQueryPool query_pool;
+    CTK_StaticArray<VTK_PipelineStatisticsScope, VTK_PIPELINE_STATISTICS_MAX_SCOPES> scopes;
+    bool scope_open;
+    bool pending;
+};
+
+struct VTK_PipelineStatisticsResult {
+    cstr name;
+    VTK_PipelineStatisticsCounters last;
+    u64 frame_count;
+
+    // Derived from last; fragments per output primitive is the overdraw signal, vertices per primitive shows passes
+    // that are vertex-bound relative to what they rasterize.
+    f64 fragments_per_primitive;
+    f64 vertices_per_primitive;
+};
+
+struct VTK_PipelineStatistics {
+    VTK_PipelineStatisticsFrame frames[VTK_PIPELINE_STATISTICS_MAX_FRAMES];
+    u32 frame_count;
+    u32 frame_index;
+    CTK_StaticArray<VTK_PipelineStatisticsResult, VTK_PIPELINE_STATISTICS_MAX_SCOPE_NAMES> results;
+    bool enabled;
+};
+
+////////////////////////////////////////////////////////////
+/// Internal
+////////////////////////////////////////////////////////////
+static u32 _vtk_pipeline_statistics_name_index(VTK_PipelineStatistics *statistics, cstr name) {
+    for (u32 i = 0; i < statistics->results.count; ++i) {
+        if (statistics->results[i].name == name || strcmp(statistics->results[i].name, name) == 0)
+            return i;
+    }
+
+    if (statistics->results.count == VTK_PIPELINE_STATISTICS_MAX_SCOPE_NAMES) {
+        CTK_FATAL("pipeline statistics cannot track more than %u scope names",
+                  VTK_PIPELINE_STATISTICS_MAX_SCOPE_NAMES)
+    }
+
+    VTK_PipelineStatisticsResult result = {};
+    result.name = name;
+    ctk_push(&statistics->results, result);
+    return statistics->results.count - 1;
+}
+
+static bool _vtk_resolve_pipeline_statistics_frame(VTK_PipelineStatistics *statistics, VkDevice logical_device,
+                                                   VTK_PipelineStatisticsFrame *frame) {
+    if (!frame->pending)
+        return true;
+
+    if (frame->scopes.count > 0) {
+        VTK_PipelineStatisticsCounters counters[VTK_PIPELINE_STATISTICS_MAX_SCOPES] = {};
+        VkResult result =
+            VTK_RECORD_RESULT(vkGetQueryPoolResults(logical_device, frame->query_pool, 0, frame->scopes.count,
+                                                    sizeof(counters), counters, sizeof(VTK_PipelineStatisticsCounters),
+                                                    VK_QUERY_RESULT_64_BIT));
+        if (result == VK_NOT_READY)
+            return false;
+
+        _vtk_validate_result(result, "failed to get pipeline statistics query results");
+        for (u32 i = 0; i < frame->scopes.count; ++i) {
+            VTK_PipelineStatisticsScope *scope = frame->scopes + i;
+            VTK_PipelineStatisticsCounters *counter = counters + scope->query;
+            VTK_PipelineStatisticsResult *scope_result = statistics->results + scope->name_index;
+            scope_result->last = *counter;
+            ++scope_result->frame_count;
+            scope_result->fragments_per_primitive =
+                counter->clipping_primitives ? (f64)counter->fragment_invocations / counter->clipping_primitives : 0.0;
+            scope_result->vertices_per_primitive =
+                counter->clipping_primitives ? (f64)counter->vertex_invocations / counter->clipping_primitives : 0.0;
+        }
+    }
+
+    frame->pending = false;
+    return true;
+}
+
+////////////////////////////////////////////////////////////
+/// Interface
+////////////////////////////////////////////////////////////
+
+// Enables itself when enabled_features has pipelineStatisticsQuery (vtk_default_device_info requests it as an optional
+// feature); otherwise every call is a no-op, so instrumentation can stay in place on devices without it.
+static VTK_PipelineStatistics vtk_create_pipeline_statistics(VkDevice logical_device,
+                                                             VkPhysicalDeviceFeatures *enabled_features,
+                                                             u32 frame_count) {
+    VTK_PipelineStatistics statistics = {};
+    CTK_ASSERT(frame_count > 0 && frame_count <= VTK_PIPELINE_STATISTICS_MAX_FRAMES);
+    statistics.frame_count = frame_count;
+    statistics.enabled = enabled_features->pipelineStatisticsQuery == VK_TRUE;
+    if (!statistics.enabled) {
+        ctk_info("pipelineStatisticsQuery not enabled; pipeline statistics disabled");
+        return statistics;
+    }
+
+    for (u32 i = 0; i < frame_count; ++i) {
+        VkQueryPoolCreateInfo info = {};
+        info.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+        info.flags = 0;
+        info.queryType = VK_QUERY_TYPE_PIPELINE_STATISTICS;
+        info.queryCount = VTK_PIPELINE_STATISTICS_MAX_SCOPES;
+        info.pipelineStatistics = VTK_PIPELINE_STATISTICS_FLAGS;
+        vtk_validate_result(vkCreateQueryPool(logical_device, &info,
+                                              vtk_allocation_callbacks(), &statistics.frames[i].query_pool),
+                            "failed to create pipeline statistics query pool");
+        VTK_SET_DEBUG_NAME(logical_device, VK_OBJECT_TYPE_QUERY_POOL, statistics.frames[i].query_pool,
+                           "pipeline statistics");
+    }
+
+    return statistics;
+}
+
+static void vtk_destroy_pipeline_statistics(VTK_PipelineStatistics *statistics, VkDevice logical_device) {
+    for (u32 i = 0; i < statistics->frame_count; ++i)
+        vkDestroyQueryPool(logical_device, statistics->frames[i].query_pool, vtk_allocation_callbacks());
+
+    *statistics = {};
+}
+
+// Call once per frame, outside any render pass, before recording scopes. Resolves the frame this slot was last used for.
+static void vtk_begin_pipeline_statistics_frame(VTK_PipelineStatistics *statistics, VkDevice logical_device,
+                                                VkCommandBuffer command_buffer) {
+    if (!statistics->enabled)
+        return;
+
+    statistics->frame_index = (statistics->frame_index + 1) % statistics->frame_count;
+    VTK_PipelineStatisticsFrame *frame = statistics->frames + statistics->frame_index;
+    if (!_vtk_resolve_pipeline_statistics_frame(statistics, logical_device, frame))
+        ctk_warning("pipeline statistics frame not ready when reused; dropping its results");
+
+    vkCmdResetQueryPool(command_buffer, frame->query_pool, 0, VTK_PIPELINE_STATISTICS_MAX_SCOPES);
+    frame->scopes.count = 0;
+    frame->scope_open = false;
+    frame->pending = true;
+}
+
+// Vulkan doesn't allow pipeline statistics queries to be active at the same time, so scopes can't nest. A scope begun
+// inside a render pass must end in the same subpass. Scopes also open a debug utils label of the same name, even when
+// pipeline statistics aren't supported, but not when dropped at the scope limit.
+static void vtk_begin_pipeline_statistics_scope(VTK_PipelineStatistics *statistics, VkCommandBuffer command_buffer,
+                                                cstr name) {
+    if (!statistics->enabled) {
+        VTK_BEGIN_DEBUG_LABEL(command_buffer, name);
+        return;
+    }
+
+    VTK_PipelineStatisticsFrame *frame = statistics->frames + statistics->frame_index;
+    CTK_ASSERT(!frame->scope_open);
+    if (frame->scopes.count == VTK_PIPELINE_STATISTICS_MAX_SCOPES) {
+        ctk_warning("pipeline statistics scope limit (%u) reached; ignoring scope \"%s\"",
+                    VTK_PIPELINE_STATISTICS_MAX_SCOPES, name);
+        return;
+    }
+
+    VTK_BEGIN_DEBUG_LABEL(command_buffer, name);
+    VTK_PipelineStatisticsScope scope = {};
+    scope.name_index = _vtk_pipeline_statistics_name_index(statistics, name);
+    scope.query = frame->scopes.count;
+    vkCmdBeginQuery(command_buffer, frame->query_pool, scope.query, 0);
+    ctk_push(&frame->scopes, scope);
+    frame->scope_open = true;
+}
+
+static void vtk_end_pipeline_statistics_scope(VTK_PipelineStatistics *statistics, VkCommandBuffer command_buffer) {
+    if (!statistics->enabled) {
+        VTK_END_DEBUG_LABEL(command_buffer);
+        return;
+    }
+
+    VTK_PipelineStatisticsFrame *frame = statistics->frames + statistics->frame_index;
+    if (!frame->scope_open)
+        return; // Scope was dropped at the limit.
+
+    vkCmdEndQuery(command_buffer, frame->query_pool, frame->scopes[frame->scopes.count - 1].query);
+    VTK_END_DEBUG_LABEL(command_buffer);
+    frame->scope_open = false;
+}
+
+static VTK_PipelineStatisticsResult *vtk_pipeline_statistics_result(VTK_PipelineStatistics *statistics, cstr name) {
+    for (u32 i = 0; i < statistics->results.count; ++i) {
+        if (strcmp(statistics->results[i].name, name) == 0)
+            return statistics->results + i;
+    }
+
+    return NULL;
+}
+
+static void vtk_log_pipeline_statistics(VTK_PipelineStatistics *statistics) {
+    ctk_info("pipeline statistics:        vertices   primitives    fragments      compute  frag/prim  vert/prim");
+    for (u32 i = 0; i < statistics->results.count; ++i) {
+        VTK_PipelineStatisticsResult *result = statistics->results + i;
+        ctk_info("    %-20s %12llu %12llu %12llu %12llu %10.2f %10.2f", result->name,
+                 (unsigned long long)result->last.vertex_invocations,
+                 (unsigned long long)result->last.clipping_primitives,
+                 (unsigned long long)result->last.fragment_invocations,
+                 (unsigned long long)result->last.compute_invocations,
+                 result->fragments_per_primitive, result->vertices_per_primitive);
+    }
+}
+
+static void vtk_write_pipeline_statistics_json(VTK_PipelineStatistics *statistics, FILE *file) {
+    fprintf(file, "{\n    \"scopes\": [");
+    for (u32 i = 0; i < statistics->results.count; ++i) {
+        VTK_PipelineStatisticsResult *result = statistics->results + i;
+        fprintf(file, "%s\n        { \"name\": ", i == 0 ? "" : ",");
+        _vtk_write_json_string(file, result->name);
+        fprintf(file, ", \"vertex_invocations\": %llu, \"clipping_primitives\": %llu, "
+                      "\"fragment_invocations\": %llu, \"compute_invocations\": %llu, "
+                      "\"fragments_per_primitive\": %.4f, \"vertices_per_primitive\": %.4f }",
+                (unsigned long long)result->last.vertex_invocations,
+                (unsigned long long)result->last.clipping_primitives,
+                (unsigned long long)result->last.fragment_invocations,
+                (unsigned long long)result->last.compute_invocations,
+                result->fragments_per_primitive, result->vertices_per_primitive);
+    }
+    fprintf(file, "\n    ]\n}\n");
+}
@@ -0,0 +1,219 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include "ctk/ctk.h"
+#include "vtk/vtk.h"
+#include "vtk/device.h"
+#include "vtk/texture.h"
+#include "vtk/debug_utils.h"
+
+////////////////////////////////////////////////////////////
+/// Data
+////////////////////////////////////////////////////////////
+static u32 const VTK_SAMPLER_CACHE_MAX_ENTRIES = 512;
+
+struct _VTK_SamplerCacheEntry {
+    VkSamplerCreateInfo info; // Normalized; pNext is always NULL.
+    u64 hash;
+    VkSampler sampler;
+    u32 reference_count;
+};
+
+struct VTK_SamplerCacheStats {
+    u64 requests;
+    u64 hits;
+    u64 samplers_created;
+    u64 samplers_destroyed;
+};
+
+// Shares one VkSampler between every user of the same sampler state. Drivers can cap live samplers as low as 4000
+// (maxSamplerAllocationCount) and almost all textures sample the same way, so textures acquire samplers here instead
+// of creating their own. Samplers are reference counted; unreferenced ones stay cached until
+// vtk_trim_sampler_cache().
+struct VTK_SamplerCache {
+    VkDevice logical_device;
+    bool anisotropy_enabled;
+    f32 max_anisotropy;
+    u32 max_sampler_count;
+    CTK_StaticArray<_VTK_SamplerCacheEntry, VTK_SAMPLER_CACHE_MAX_ENTRIES> entries;
+    VTK_SamplerCacheStats stats;
+};
+
+////////////////////////////////////////////////////////////
+/// Internal
+////////////////////////////////////////////////////////////
+
+// Requests that produce the same sampler get the same key: anisotropy is clamped to what the device allows and fields
+// the driver ignores (maxAnisotropy without anisotropy, compareOp without compare) are zeroed.
+static VkSamplerCreateInfo _vtk_normalize_sampler_info(VTK_SamplerCache *cache, VkSamplerCreateInfo const *info) {
+    CTK_ASSERT(info->pNext == NULL);
+    VkSamplerCreateInfo normalized = *info;
+    normalized.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+    if (!cache->anisotropy_enabled)
+        normalized.anisotropyEnable = VK_FALSE;
+
+    if (normalized.anisotropyEnable)
+        normalized.maxAnisotropy = normalized.maxAnisotropy < cache->max_anisotropy ? normalized.maxAnisotropy
+                                                                                    : cache->max_anisotropy;
+    else
+        normalized.maxAnisotropy = 1.0f;
+
+    if (!normalized.compareEnable)
+        normalized.compareOp = VK_COMPARE_OP_NEVER;
+
+    return normalized;
+}
+
+static u64 _vtk_hash_sampler_info(VkSamplerCreateInfo const *info) {
+    u64 hash = 14695981039346656037ull;
+    auto mix = [&hash](void const *data, u32 size) {
+        for (u32 i = 0; i < size; ++i)
+            hash = (hash ^ ((u8 const *)data)[i]) * 1099511628211ull;
+    };
+
+    mix(&info->flags, sizeof(info->flags));
+    mix(&info->magFilter, sizeof(info->magFilter));
+    mix(&info->minFilter, sizeof(info->minFilter));
+    mix(&info->mipmapMode, sizeof(info->mipmapMode));
+    mix(&info->addressModeU, sizeof(info->addressModeU));
+    mix(&info->addressModeV, sizeof(info->addressModeV));
+    mix(&info->addressModeW, sizeof(info->addressModeW));
+    mix(&info->mipLodBias, sizeof(info->mipLodBias));
+    mix(&info->anisotropyEnable, sizeof(info->anisotropyEnable));
+    mix(&info->maxAnisotropy, sizeof(info->maxAnisotropy));
+    mix(&info->compareEnable, sizeof(info->compareEnable));
+    mix(&info->compareOp, sizeof(info->compareOp));
+    mix(&info->minLod, sizeof(info->minLod));
+    mix(&info->maxLod, sizeof(info->maxLod));
+    mix(&info->borderColor, sizeof(info->borderColor));
+    mix(&info->unnormalizedCoordinates, sizeof(info->unnormalizedCoordinates));
+    return hash;
+}
+
+static bool _vtk_sampler_infos_equal(VkSamplerCreateInfo const *a, VkSamplerCreateInfo const *b) {
+    return a->flags == b->flags && a->magFilter == b->magFilter && a->minFilter == b->minFilter &&
+           a->mipmapMode == b->mipmapMode && a->addressModeU == b->addressModeU &&
+           a->addressModeV == b->addressModeV && a->addressModeW == b->addressModeW &&
+           a->mipLodBias == b->mipLodBias && a->anisotropyEnable == b->anisotropyEnable &&
+           a->maxAnisotropy == b->maxAnisotropy && a->compareEnable == b->compareEnable &&
+           a->compareOp == b->compareOp && a->minLod == b->minLod && a->maxLod == b->maxLod &&
+           a->borderColor == b->borderColor && a->unnormalizedCoordinates == b->unnormalizedCoordinates;
+}
+
+static _VTK_SamplerCacheEntry *_vtk_find_sampler_entry(VTK_SamplerCache *cache, VkSampler sampler) {
+    for (u32 i = 0; i < cache->entries.count; ++i) {
+        if (cache->entries[i].sampler == sampler)
+            return cache->entries + i;
+    }
+
+    return NULL;
+}
+
+////////////////////////////////////////////////////////////
+/// Interface
+////////////////////////////////////////////////////////////
+static void vtk_init_sampler_cache(VTK_SamplerCache *cache, VTK_Device *device) {
+    cache->logical_device = device->logical;
+    cache->anisotropy_enabled = device->enabled_features.samplerAnisotropy;
+    cache->max_anisotropy = device->properties.limits.maxSamplerAnisotropy;
+    cache->max_sampler_count = device->properties.limits.maxSamplerAllocationCount;
+    cache->entries.count = 0;
+    cache->stats = {};
+}
+
+// The device must be idle; outstanding references are dropped.
+static void vtk_destroy_sampler_cache(VTK_SamplerCache *cache) {
+    for (u32 i = 0; i < cache->entries.count; ++i)
+        vkDestroySampler(cache->logical_device, cache->entries[i].sampler, vtk_allocation_callbacks());
+
+    cache->stats.samplers_destroyed += cache->entries.count;
+    cache->entries.count = 0;
+}
+
+// Returns the sampler for info's state, creating it on first use, and adds a reference. info->pNext must be NULL.
+static VkSampler vtk_acquire_sampler(VTK_SamplerCache *cache, VkSamplerCreateInfo const *info) {
+    VkSamplerCreateInfo normalized = _vtk_normalize_sampler_info(cache, info);
+    u64 hash = _vtk_hash_sampler_info(&normalized);
+    ++cache->stats.requests;
+    for (u32 i = 0; i < cache->entries.count; ++i) {
+        _VTK_SamplerCacheEntry *entry = cache->entries + i;
+        if (entry->hash == hash && _vtk_sampler_infos_equal(&entry->info, &normalized)) {
+            ++entry->reference_count;
+            ++cache->stats.hits;
+            return entry->sampler;
+        }
+    }
+
+    if (cache->entries.count == VTK_SAMPLER_CACHE_MAX_ENTRIES || cache->entries.count == cache->max_sampler_count)
+        CTK_FATAL("sampler cache full (%u samplers)", cache->entries.count)
+
+    _VTK_SamplerCacheEntry entry = {};
+    entry.info = normalized;
+    entry.hash = hash;
+    entry.reference_count = 1;
+    vtk_validate_result(vkCreateSampler(cache->logical_device, &normalized, vtk_allocation_callbacks(),
+                                        &entry.sampler),
+                        "failed to create sampler");
+    ctk_push(&cache->entries, entry);
+    ++cache->stats.samplers_created;
+    return entry.sampler;
+}
+
+// Drops a reference from vtk_acquire_sampler(). The sampler stays alive (and cached) until trimmed.
+static void vtk_release_sampler(VTK_SamplerCache *cache, VkSampler sampler) {
+    if (sampler == VK_NULL_HANDLE)
+        return;
+
+    _VTK_SamplerCacheEntry *entry = _vtk_find_sampler_entry(cache, sampler);
+    CTK_ASSERT(entry != NULL && entry->reference_count > 0);
+    --entry->reference_count;
+}
+
+// Destroys unreferenced samplers. The GPU must be done with them, e.g. call after the device has gone idle or once
+// frames in flight have cycled since their last release.
+static void vtk_trim_sampler_cache(VTK_SamplerCache *cache) {
+    for (u32 i = 0; i < cache->entries.count;) {
+        if (cache->entries[i].reference_count == 0) {
+            vkDestroySampler(cache->logical_device, cache->entries[i].sampler, vtk_allocation_callbacks());
+            cache->entries[i] = cache->entries[--cache->entries.count];
+            ++cache->stats.samplers_destroyed;
+        }
+        else {
+            ++i;
+        }
+    }
+}
+
+// Points texture at the cached sampler for info, releasing the one it held.
+static void vtk_set_texture_sampler(VTK_SamplerCache *cache, VTK_Texture *texture, VkSamplerCreateInfo const *info) {
+    VkSampler sampler = vtk_acquire_sampler(cache, info);
+    vtk_release_sampler(cache, texture->sampler);
+    texture->sampler = sampler;
+}
+
+// Call before vtk_destroy_texture() for textures given a sampler with vtk_set_texture_sampler().
+static void vtk_release_texture_sampler(VTK_SamplerCache *cache, VTK_Texture *texture) {
+    vtk_release_sampler(cache, texture->sampler);
+    texture->sampler = VK_NULL_HANDLE;
+}
+
+// Descriptor set layout binding that bakes samplers in as immutable samplers, so bindless texture arrays and atlases
+// never write sampler descriptors. samplers must stay valid (and referenced) for the layout's lifetime.
+static VkDescriptorSetLayoutBinding vtk_immutable_sampler_binding(u32 binding, VkShaderStageFlags stages,
+                                                                  VkSampler const *samplers, u32 sampler_count) {
+    VkDescriptorSetLayoutBinding layout_binding = {};
+    layout_binding.binding = binding;
+    layout_binding.descriptorType = VK_DESCRIPTOR_TYPE_SAMPLER;
+    layout_binding.descriptorCount = sampler_count;
+    layout_binding.stageFlags = stages;
+    layout_binding.pImmutableSamplers = samplers;
+    return layout_binding;
+}
+
+static void vtk_log_sampler_cache_stats(VTK_SamplerCache *cache) {
+    VTK_SamplerCacheStats *stats = &cache->stats;
+    ctk_info("sampler cache: %u live samplers (device limit %u), %llu requests, %llu hits, %llu created, "
+             "%llu destroyed", cache->entries.count, cache->max_sampler_count, (unsigned long long)stats->requests,
+             (unsigned long long)stats->hits, (unsigned long long)stats->samplers_created,
+             (unsigned long long)stats->samplers_destroyed);
+}
@@ -0,0 +1,397 @@
+#pragma once
+
+#include <string.h>
+#include <vulkan/vulkan.h>
+#include "ctk/ctk.h"
+#include "vtk/vtk.h"
+#include "vtk/device.h"
+#include "vtk/device_memory.h"
+#include "vtk/memory_types.h"
+#include "vtk/debug_utils.h"
+
+////////////////////////////////////////////////////////////
+/// Data
+////////////////////////////////////////////////////////////
+static u32 const VTK_STAGING_RING_BATCH_COUNT = 4;
+
+// A slice of the ring whose copies are recorded into one command buffer and retired by one fence.
+struct _VTK_StagingBatch {
+    VkCommandBuffer command_buffer;
+    VkFence fence;
+    u64 begin; // Ring positions (monotonic; wrapped with % size) covered by this batch.
+    u64 end;
+    bool recording;
+    bool pending;
+};
+
+struct VTK_StagingRingStats {
+    u64 bytes_uploaded;
+    u64 chunks;
+    u64 batches_submitted;
+    u64 stalls; // Times staging had to wait on the GPU for ring space.
+    u64 stall_ns;
+};
+
+// Fixed-size persistently mapped staging memory that uploads of any size stream through in chunks. While the GPU copies
+// one batch the CPU fills the next; when the ring is full, staging waits on the oldest batch (back-pressure), so memory
+// use stays bounded regardless of upload size.
+struct VTK_StagingRing {
+    VkDevice logical_device;
+    VTK_DeviceDispatch *dispatch; // Per-batch calls go through the device's dispatch table.
+    VkQueue queue;
+    VkCommandPool command_pool;
+    VTK_DeviceMemoryAllocator *allocator;
+    u32 allocation;
+    VkBuffer buffer;
+    u8 *mapped;
+    VkDeviceSize size;
+    VkDeviceSize batch_size; // Batches are submitted once they cover this many bytes.
+    VkDeviceSize non_coherent_atom_size;
+    bool coherent;
+
+    u64 head; // Next write position.
+    u64 tail; // Start of the oldest range the GPU may still be reading.
+    _VTK_StagingBatch batches[VTK_STAGING_RING_BATCH_COUNT];
+    u32 batch_index; // Batch currently being filled.
+
+    VTK_StagingRingStats stats;
+};
+
+// Destination of an image upload; the image must be in VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL when the copies execute.
+// Data is tightly packed rows of texel blocks (block_width x block_height texels of block_size bytes; 1 x 1 for
+// uncompressed formats), slice after slice, layer after layer.
+struct VTK_StagingImageRegion {
+    VkImage image;
+    VkImageSubresourceLayers subresource;
+    VkOffset3D offset;
+    VkExtent3D extent;
+    u32 block_size;
+    u32 block_width;
+    u32 block_height;
+};
+
+////////////////////////////////////////////////////////////
+/// Internal
+////////////////////////////////////////////////////////////
+static void _vtk_wait_staging_batch(VTK_StagingRing *ring, _VTK_StagingBatch *batch) {
+    vtk_validate_result(ring->dispatch->vkWaitForFences(ring->logical_device, 1, &batch->fence, VK_TRUE, CTK_U64_MAX),
+                        "failed to wait for staging batch fence");
+    batch->pending = false;
+    ring->tail = batch->end > ring->tail ? batch->end : ring->tail;
+}
+
+static void _vtk_submit_staging_batch(VTK_StagingRing *ring) {
+    _VTK_StagingBatch *batch = ring->batches + ring->batch_index;
+    if (!batch->recording)
+        return;
+
+    VTK_CPU_ZONE("_vtk_submit_staging_batch");
+    batch->end = ring->head;
+    if (!ring->coherent) {
+        // Flush only the batch's range, split in two if it wraps. The atom alignment applies to offsets in the memory
+        // object, not the ring, and a range rounded up past the end of the memory object must use VK_WHOLE_SIZE.
+        VTK_DeviceAllocation *allocation = vtk_device_allocation(ring->allocator, ring->allocation);
+        VTK_MemoryBlock *block = ring->allocator->blocks + allocation->block_index;
+        VkDeviceSize atom = ring->non_coherent_atom_size;
+        VkMappedMemoryRange ranges[2] = {};
+        u32 range_count = 0;
+        u64 begin = batch->begin;
+        while (begin < batch->end) {
+            VkDeviceSize offset = begin % ring->size;
+            VkDeviceSize length = batch->end - begin < ring->size - offset ? batch->end - begin : ring->size - offset;
+            VkDeviceSize memory_offset = allocation->offset + offset;
+            VkDeviceSize aligned_offset = memory_offset / atom * atom;
+            VkDeviceSize aligned_size = _vtk_align_up(memory_offset + length - aligned_offset, atom);
+            VkMappedMemoryRange *range = ranges + range_count++;
+            range->sType = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE;
+            range->memory = block->memory;
+            range->offset = aligned_offset;
+            range->size = aligned_offset + aligned_size > block->size ? VK_WHOLE_SIZE : aligned_size;
+            begin += length;
+        }
+
+        vtk_validate_result(ring->dispatch->vkFlushMappedMemoryRanges(ring->logical_device, range_count, ranges),
+                            "failed to flush staging ring");
+    }
+
+    // Makes the copies visible to everything submitted after this batch on the same queue.
+    VkMemoryBarrier barrier = {};
+    barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_MEMORY_READ_BIT | VK_ACCESS_MEMORY_WRITE_BIT;
+    ring->dispatch->vkCmdPipelineBarrier(batch->command_buffer, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                                         VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, 0, 1, &barrier, 0, NULL, 0, NULL);
+    VTK_END_DEBUG_LABEL(batch->command_buffer);
+    vtk_validate_result(ring->dispatch->vkEndCommandBuffer(batch->command_buffer),
+                        "failed to end staging batch command buffer");
+
+    VkSubmitInfo submit_info = {};
+    submit_info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    submit_info.commandBufferCount = 1;
+    submit_info.pCommandBuffers = &batch->command_buffer;
+    vtk_validate_result(ring->dispatch->vkQueueSubmit(ring->queue, 1, &submit_info, batch->fence),
+                        "failed to submit staging batch");
+    batch->recording = false;
+    batch->pending = true;
+    ++ring->stats.batches_submitted;
+    ring->batch_index = (ring->batch_index + 1) % VTK_STAGING_RING_BATCH_COUNT;
+}
+
+// Current batch's command buffer, begun if it isn't recording yet. Waits for the batch's previous submission first.
+static VkCommandBuffer _vtk_staging_command_buffer(VTK_StagingRing *ring) {
+    _VTK_StagingBatch *batch = ring->batches + ring->batch_index;
+    if (batch->recording)
+        return batch->command_buffer;
+
+    if (batch->pending)
+        _vtk_wait_staging_batch(ring, batch);
+
+    vtk_validate_result(ring->dispatch->vkResetFences(ring->logical_device, 1, &batch->fence),
+                        "failed to reset staging batch fence");
+    vtk_begin_temp_commands(ring->dispatch, batch->command_buffer);
+    VTK_BEGIN_DEBUG_LABEL(batch->command_buffer, "staging ring upload");
+    batch->begin = ring->head;
+    batch->recording = true;
+    return batch->command_buffer;
+}
+
+// Reserves size bytes at alignment, submitting the current batch and waiting on old ones while there isn't room. The
+// reservation belongs to the current batch, which is recording on return.
+static VkDeviceSize _vtk_reserve_staging(VTK_StagingRing *ring, VkDeviceSize size, VkDeviceSize alignment) {
+    CTK_ASSERT(size <= ring->batch_size);
+    for (;;) {
+        // alignment isn't necessarily a power of two (e.g. 12 for 3-byte texels).
+        VkDeviceSize offset = (ring->head % ring->size + alignment - 1) / alignment * alignment;
+        u64 head = ring->head - ring->head % ring->size + offset;
+        if (offset + size > ring->size) {
+            // Doesn't fit before the end; skip to the start of the ring.
+            head += ring->size - offset;
+            offset = 0;
+        }
+
+        if (head + size - ring->tail <= ring->size) {
+            _vtk_staging_command_buffer(ring);
+            ring->head = head + size;
+            return offset;
+        }
+
+        _vtk_submit_staging_batch(ring);
+
+        // Batches are reused round-robin, so the oldest pending batch is the first one from the current slot on.
+        u64 stall_start_ns = _vtk_now_ns();
+        for (u32 i = 0; i < VTK_STAGING_RING_BATCH_COUNT; ++i) {
+            _VTK_StagingBatch *batch = ring->batches + (ring->batch_index + i) % VTK_STAGING_RING_BATCH_COUNT;
+            if (batch->pending) {
+                VTK_CPU_ZONE("staging ring stall");
+                _vtk_wait_staging_batch(ring, batch);
+                break;
+            }
+        }
+
+        ++ring->stats.stalls;
+        ring->stats.stall_ns += _vtk_now_ns() - stall_start_ns;
+    }
+}
+
+static void _vtk_end_staging_chunk(VTK_StagingRing *ring, VkDeviceSize size) {
+    ring->stats.bytes_uploaded += size;
+    ++ring->stats.chunks;
+    if (ring->head - ring->batches[ring->batch_index].begin >= ring->batch_size)
+        _vtk_submit_staging_batch(ring);
+}
+
+////////////////////////////////////////////////////////////
+/// Interface
+////////////////////////////////////////////////////////////
+
+// Copies are submitted to queue (from queue_family_index). Using the queue that consumes the uploads (e.g. graphics)
+// keeps synchronization to the barrier at the end of each batch; a dedicated transfer queue needs a semaphore and
+// queue family ownership transfers on top.
+static void vtk_create_staging_ring(VTK_StagingRing *ring, VTK_Device *device, VTK_DeviceMemoryAllocator *allocator,
+                                    VTK_MemoryTypeSelector *selector, VkQueue queue, u32 queue_family_index,
+                                    VkDeviceSize size) {
+    *ring = {};
+    ring->logical_device = device->logical;
+    ring->dispatch = &device->dispatch;
+    ring->queue = queue;
+    ring->allocator = allocator;
+    ring->size = size;
+    ring->batch_size = size / VTK_STAGING_RING_BATCH_COUNT;
+    ring->non_coherent_atom_size = device->properties.limits.nonCoherentAtomSize;
+
+    VkBufferCreateInfo buffer_info = {};
+    buffer_info.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+    buffer_info.size = size;
+    buffer_info.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+    buffer_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    ring->allocation = vtk_create_allocated_buffer(allocator, selector, &buffer_info, VTK_MEMORY_INTENT_UPLOAD, false,
+                                                   "staging ring");
+    if (ring->allocation == VTK_NULL_ALLOCATION)
+        CTK_FATAL("failed to allocate %llu byte staging ring", (unsigned long long)size)
+
+    VTK_DeviceAllocation *allocation = vtk_device_allocation(allocator, ring->allocation);
+    ring->buffer = allocation->buffer;
+    ring->mapped = allocation->mapped;
+    ring->coherent = allocator->memory_properties.memoryTypes[allocation->memory_type_index].propertyFlags &
+                     VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+
+    VkCommandPoolCreateInfo pool_info = {};
+    pool_info.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+    pool_info.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT | VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+    pool_info.queueFamilyIndex = queue_family_index;
+    vtk_validate_result(vkCreateCommandPool(ring->logical_device, &pool_info, vtk_allocation_callbacks(),
+                                            &ring->command_pool),
+                        "failed to create staging ring command pool");
+
+    VkFenceCreateInfo fence_info = {};
+    fence_info.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+    for (u32 i = 0; i < VTK_STAGING_RING_BATCH_COUNT; ++i) {
+        _VTK_StagingBatch *batch = ring->batches + i;
+        batch->command_buffer = vtk_allocate_command_buffer(ring->logical_device, ring->command_pool,
+                                                            VK_COMMAND_BUFFER_LEVEL_PRIMARY);
+        vtk_validate_result(vkCreateFence(ring->logical_device, &fence_info, vtk_allocation_callbacks(), &batch->fence),
+                            "failed to create staging batch fence");
+        VTK_SET_DEBUG_NAME(ring->logical_device, VK_OBJECT_TYPE_COMMAND_BUFFER, batch->command_buffer,
+                           "staging ring batch");
+    }
+}
+
+// Submits whatever has been staged so far without waiting for it.
+static void vtk_flush_staging_ring(VTK_StagingRing *ring) {
+    _vtk_submit_staging_batch(ring);
+}
+
+// Submits and waits for every staged upload.
+static void vtk_wait_staging_ring(VTK_StagingRing *ring) {
+    VTK_CPU_ZONE("vtk_wait_staging_ring");
+    _vtk_submit_staging_batch(ring);
+    for (u32 i = 0; i < VTK_STAGING_RING_BATCH_COUNT; ++i) {
+        if (ring->batches[i].pending)
+            _vtk_wait_staging_batch(ring, ring->batches + i);
+    }
+}
+
+// Ring position after everything staged so far. Uploads staged before taking it are complete once
+// vtk_poll_staging_ring() reaches it.
+static u64 vtk_staging_ring_position(VTK_StagingRing *ring) {
+    return ring->head;
+}
+
+// Retires batches the GPU has finished, without blocking, and returns the position before which every staged upload has
+// completed.
+static u64 vtk_poll_staging_ring(VTK_StagingRing *ring) {
+    // Batches complete in submission order, and the oldest pending batch is the first one from the current slot on.
+    for (u32 i = 0; i < VTK_STAGING_RING_BATCH_COUNT; ++i) {
+        _VTK_StagingBatch *batch = ring->batches + (ring->batch_index + i) % VTK_STAGING_RING_BATCH_COUNT;
+        if (!batch->pending)
+            continue;
+
+        if (ring->dispatch->vkGetFenceStatus(ring->logical_device, batch->fence) != VK_SUCCESS)
+            break;
+
+        batch->pending = false;
+        ring->tail = batch->end > ring->tail ? batch->end : ring->tail;
+    }
+
+    bool recording = ring->batches[ring->batch_index].recording;
+    for (u32 i = 0; i < VTK_STAGING_RING_BATCH_COUNT; ++i) {
+        if (ring->batches[i].pending)
+            return ring->tail;
+    }
+
+    return recording ? ring->batches[ring->batch_index].begin : ring->head;
+}
+
+static void vtk_destroy_staging_ring(VTK_StagingRing *ring) {
+    vtk_wait_staging_ring(ring);
+    for (u32 i = 0; i < VTK_STAGING_RING_BATCH_COUNT; ++i)
+        vkDestroyFence(ring->logical_device, ring->batches[i].fence, vtk_allocation_callbacks());
+
+    vkDestroyCommandPool(ring->logical_device, ring->command_pool, vtk_allocation_callbacks());
+    vtk_free_device_region(ring->allocator, ring->allocation);
+}
+
+// Command buffer that staged copies are currently being recorded into, for recording layout transitions etc. in order
+// with them. Only valid until the next staging call.
+static VkCommandBuffer vtk_staging_ring_command_buffer(VTK_StagingRing *ring) {
+    return _vtk_staging_command_buffer(ring);
+}
+
+// Streams size bytes of data into buffer at offset. Returns once data has been copied into the ring; the GPU copies
+// complete asynchronously (see vtk_flush_staging_ring() and vtk_wait_staging_ring()).
+static void vtk_stage_buffer_upload(VTK_StagingRing *ring, VkBuffer buffer, VkDeviceSize offset, void const *data,
+                                    VkDeviceSize size) {
+    VTK_CPU_ZONE("vtk_stage_buffer_upload");
+    auto bytes = (u8 const *)data;
+    while (size > 0) {
+        VkDeviceSize chunk_size = size < ring->batch_size ? size : ring->batch_size;
+        VkDeviceSize staging_offset = _vtk_reserve_staging(ring, chunk_size, 16);
+        VkCommandBuffer command_buffer = ring->batches[ring->batch_index].command_buffer;
+        memcpy(ring->mapped + staging_offset, bytes, chunk_size);
+
+        VkBufferCopy copy = {};
+        copy.srcOffset = staging_offset;
+        copy.dstOffset = offset;
+        copy.size = chunk_size;
+        ring->dispatch->vkCmdCopyBuffer(command_buffer, ring->buffer, buffer, 1, &copy);
+        _vtk_end_staging_chunk(ring, chunk_size);
+
+        bytes += chunk_size;
+        offset += chunk_size;
+        size -= chunk_size;
+    }
+}
+
+// Streams an image region in chunks of whole block rows. A single block row must fit in a batch.
+static void vtk_stage_image_upload(VTK_StagingRing *ring, VTK_StagingImageRegion *region, void const *data) {
+    VTK_CPU_ZONE("vtk_stage_image_upload");
+    u32 block_columns = (region->extent.width + region->block_width - 1) / region->block_width;
+    u32 block_rows = (region->extent.height + region->block_height - 1) / region->block_height;
+    VkDeviceSize row_size = (VkDeviceSize)block_columns * region->block_size;
+    VkDeviceSize rows_per_chunk = ring->batch_size / row_size;
+    if (rows_per_chunk == 0)
+        CTK_FATAL("image row of %llu bytes does not fit in a staging batch", (unsigned long long)row_size)
+
+    // bufferOffset must be a multiple of 4 and of the block size.
+    VkDeviceSize alignment = region->block_size % 4 == 0 ? region->block_size : region->block_size * 4;
+    auto bytes = (u8 const *)data;
+    for (u32 layer = 0; layer < region->subresource.layerCount; ++layer) {
+        for (u32 z = 0; z < region->extent.depth; ++z) {
+            for (u32 row = 0; row < block_rows;) {
+                u32 chunk_rows = block_rows - row < rows_per_chunk ? block_rows - row : (u32)rows_per_chunk;
+                VkDeviceSize chunk_size = chunk_rows * row_size;
+                VkDeviceSize staging_offset = _vtk_reserve_staging(ring, chunk_size, alignment);
+                VkCommandBuffer command_buffer = ring->batches[ring->batch_index].command_buffer;
+                memcpy(ring->mapped + staging_offset, bytes, chunk_size);
+
+                u32 texel_row = row * region->block_height;
+                u32 texel_rows = chunk_rows * region->block_height;
+                VkBufferImageCopy copy = {};
+                copy.bufferOffset = staging_offset;
+                copy.imageSubresource = region->subresource;
+                copy.imageSubresource.baseArrayLayer += layer;
+                copy.imageSubresource.layerCount = 1;
+                copy.imageOffset = { region->offset.x, region->offset.y + (s32)texel_row, region->offset.z + (s32)z };
+                copy.imageExtent.width = region->extent.width;
+                copy.imageExtent.height = region->extent.height - texel_row < texel_rows
+                                          ? region->extent.height - texel_row
+                                          : texel_rows;
+                copy.imageExtent.depth = 1;
+                ring->dispatch->vkCmdCopyBufferToImage(command_buffer, ring->buffer, region->image,
+                                                       VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &copy);
+                _vtk_end_staging_chunk(ring, chunk_size);
+
+                bytes += chunk_size;
+                row += chunk_rows;
+            }
+        }
+    }
+}
+
+static void vtk_log_staging_ring_stats(VTK_StagingRing *ring) {
+    VTK_StagingRingStats *stats = &ring->stats;
+    ctk_info("staging ring (%llu MiB): %llu MiB uploaded in %llu chunks / %llu batches, %llu stalls (%.2f ms)",
+             (unsigned long long)(ring->size >> 20), (unsigned long long)(stats->bytes_uploaded >> 20),
+             (unsigned long long)stats->chunks, (unsigned long long)stats->batches_submitted,
+             (unsigned long long)stats->stalls, (f64)stats->stall_ns / 1000000.0);
+}
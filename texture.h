@@ -0,0 +1,272 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include "ctk/ctk.h"
+#include "vtk/vtk.h"
+#include "vtk/device_memory.h"
+#include "vtk/memory_types.h"
+#include "vtk/dispatch.h"
+#include "vtk/debug_utils.h"
+
+////////////////////////////////////////////////////////////
+/// Data
+////////////////////////////////////////////////////////////
+static u32 const VTK_MAX_MIPMAP_BATCH_TEXTURES = 256;
+
+struct VTK_TextureInfo {
+    VkFormat format;
+    VkExtent3D extent;
+    u32 mip_levels;
+    u32 layer_count;
+    VkImageUsageFlags usage;
+    VkImageViewType view_type;
+    cstr debug_name;
+};
+
+struct VTK_Texture {
+    u32 allocation; // VTK_DeviceMemoryAllocator allocation owning image and its memory.
+    VkImage image;
+    VkImageView view;
+    VkSampler sampler; // Shared VTK_SamplerCache sampler, or VK_NULL_HANDLE; not owned by the texture.
+    VkFormat format;
+    VkExtent3D extent;
+    u32 mip_levels;
+    u32 layer_count;
+};
+
+////////////////////////////////////////////////////////////
+/// Interface
+////////////////////////////////////////////////////////////
+static VTK_TextureInfo vtk_default_texture_info(VkFormat format, u32 width, u32 height) {
+    VTK_TextureInfo info = {};
+    info.format = format;
+    info.extent = { width, height, 1 };
+    info.mip_levels = 1;
+    info.layer_count = 1;
+    info.usage = VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
+    info.view_type = VK_IMAGE_VIEW_TYPE_2D;
+    return info;
+}
+
+// Levels in a full mip chain down to 1x1(x1).
+static u32 vtk_mip_level_count(VkExtent3D extent) {
+    u32 largest = extent.width > extent.height ? extent.width : extent.height;
+    largest = largest > extent.depth ? largest : extent.depth;
+    u32 level_count = 1;
+    while (largest > 1) {
+        largest >>= 1;
+        ++level_count;
+    }
+
+    return level_count;
+}
+
+static VkImageAspectFlags vtk_format_aspect(VkFormat format) {
+    switch (format) {
+        case VK_FORMAT_D16_UNORM:
+        case VK_FORMAT_X8_D24_UNORM_PACK32:
+        case VK_FORMAT_D32_SFLOAT:
+            return VK_IMAGE_ASPECT_DEPTH_BIT;
+        case VK_FORMAT_D16_UNORM_S8_UINT:
+        case VK_FORMAT_D24_UNORM_S8_UINT:
+        case VK_FORMAT_D32_SFLOAT_S8_UINT:
+            return VK_IMAGE_ASPECT_DEPTH_BIT | VK_IMAGE_ASPECT_STENCIL_BIT;
+        case VK_FORMAT_S8_UINT:
+            return VK_IMAGE_ASPECT_STENCIL_BIT;
+        default:
+            return VK_IMAGE_ASPECT_COLOR_BIT;
+    }
+}
+
+// Creates a device-local optimal-tiling image through allocator, plus a view of every mip and layer. Returns a texture
+// with allocation == VTK_NULL_ALLOCATION if device memory is exhausted.
+static VTK_Texture vtk_create_texture(VTK_DeviceMemoryAllocator *allocator, VTK_MemoryTypeSelector *selector,
+                                      VTK_TextureInfo *info) {
+    VTK_Texture texture = {};
+    texture.format = info->format;
+    texture.extent = info->extent;
+    texture.mip_levels = info->mip_levels;
+    texture.layer_count = info->layer_count;
+
+    VkImageCreateInfo image_info = {};
+    image_info.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+    image_info.imageType = info->extent.depth > 1 ? VK_IMAGE_TYPE_3D : VK_IMAGE_TYPE_2D;
+    image_info.format = info->format;
+    image_info.extent = info->extent;
+    image_info.mipLevels = info->mip_levels;
+    image_info.arrayLayers = info->layer_count;
+    image_info.samples = VK_SAMPLE_COUNT_1_BIT;
+    image_info.tiling = VK_IMAGE_TILING_OPTIMAL;
+    image_info.usage = info->usage;
+    image_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    image_info.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    if (info->view_type == VK_IMAGE_VIEW_TYPE_CUBE || info->view_type == VK_IMAGE_VIEW_TYPE_CUBE_ARRAY)
+        image_info.flags |= VK_IMAGE_CREATE_CUBE_COMPATIBLE_BIT;
+
+    texture.allocation = vtk_create_allocated_image(allocator, selector, &image_info, VTK_MEMORY_INTENT_GPU_ONLY,
+                                                    info->debug_name);
+    if (texture.allocation == VTK_NULL_ALLOCATION)
+        return texture;
+
+    texture.image = vtk_device_allocation(allocator, texture.allocation)->image;
+
+    VkImageViewCreateInfo view_info = {};
+    view_info.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+    view_info.image = texture.image;
+    view_info.viewType = info->view_type;
+    view_info.format = info->format;
+    view_info.subresourceRange.aspectMask = vtk_format_aspect(info->format);
+    view_info.subresourceRange.baseMipLevel = 0;
+    view_info.subresourceRange.levelCount = info->mip_levels;
+    view_info.subresourceRange.baseArrayLayer = 0;
+    view_info.subresourceRange.layerCount = info->layer_count;
+    vtk_validate_result(vkCreateImageView(allocator->logical_device, &view_info, vtk_allocation_callbacks(),
+                                          &texture.view),
+                        "failed to create texture view");
+    VTK_SET_DEBUG_NAME(allocator->logical_device, VK_OBJECT_TYPE_IMAGE_VIEW, texture.view, info->debug_name);
+    return texture;
+}
+
+// The GPU must be done with the texture.
+static void vtk_destroy_texture(VTK_DeviceMemoryAllocator *allocator, VTK_Texture *texture) {
+    if (texture->allocation == VTK_NULL_ALLOCATION)
+        return;
+
+    vkDestroyImageView(allocator->logical_device, texture->view, vtk_allocation_callbacks());
+    vtk_free_device_region(allocator, texture->allocation);
+    *texture = {};
+    texture->allocation = VTK_NULL_ALLOCATION;
+}
+
+// Layout transition of mip_count mips starting at base_mip, across every layer, for batching into one
+// vkCmdPipelineBarrier.
+static VkImageMemoryBarrier vtk_texture_barrier(VTK_Texture *texture, VkImageLayout old_layout,
+                                                VkImageLayout new_layout, VkAccessFlags src_access,
+                                                VkAccessFlags dst_access, u32 base_mip, u32 mip_count) {
+    VkImageMemoryBarrier barrier = {};
+    barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+    barrier.srcAccessMask = src_access;
+    barrier.dstAccessMask = dst_access;
+    barrier.oldLayout = old_layout;
+    barrier.newLayout = new_layout;
+    barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.image = texture->image;
+    barrier.subresourceRange.aspectMask = vtk_format_aspect(texture->format);
+    barrier.subresourceRange.baseMipLevel = base_mip;
+    barrier.subresourceRange.levelCount = mip_count;
+    barrier.subresourceRange.baseArrayLayer = 0;
+    barrier.subresourceRange.layerCount = texture->layer_count;
+    return barrier;
+}
+
+// Samples the full mip chain; maxLod is unclamped so the sampler works for textures of any level count.
+static VkSamplerCreateInfo vtk_default_sampler_info() {
+    VkSamplerCreateInfo info = {};
+    info.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+    info.magFilter = VK_FILTER_LINEAR;
+    info.minFilter = VK_FILTER_LINEAR;
+    info.mipmapMode = VK_SAMPLER_MIPMAP_MODE_LINEAR;
+    info.addressModeU = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+    info.addressModeV = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+    info.addressModeW = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+    info.mipLodBias = 0.0f;
+    info.anisotropyEnable = VK_FALSE;
+    info.maxAnisotropy = 1.0f;
+    info.compareEnable = VK_FALSE;
+    info.compareOp = VK_COMPARE_OP_ALWAYS;
+    info.minLod = 0.0f;
+    info.maxLod = VK_LOD_CLAMP_NONE;
+    info.borderColor = VK_BORDER_COLOR_INT_OPAQUE_BLACK;
+    info.unnormalizedCoordinates = VK_FALSE;
+    return info;
+}
+
+////////////////////////////////////////////////////////////
+/// Mipmaps
+////////////////////////////////////////////////////////////
+
+// Whether format can have its mips generated with vkCmdBlitImage, and with which filter: LINEAR where the format
+// supports linear filtering, NEAREST where it only supports blits. Formats without blit support (e.g. block-compressed
+// ones) need their mips supplied instead.
+static bool vtk_format_supports_mipmap_blit(VkPhysicalDevice physical_device, VkFormat format, VkFilter *filter) {
+    VkFormatProperties properties = {};
+    vkGetPhysicalDeviceFormatProperties(physical_device, format, &properties);
+    VkFormatFeatureFlags features = properties.optimalTilingFeatures;
+    VkFormatFeatureFlags blit = VK_FORMAT_FEATURE_BLIT_SRC_BIT | VK_FORMAT_FEATURE_BLIT_DST_BIT;
+    if ((features & blit) != blit)
+        return false;
+
+    *filter = features & VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT ? VK_FILTER_LINEAR : VK_FILTER_NEAREST;
+    return true;
+}
+
+// Fills mips 1..n of every texture by successive blits from the level above, then moves every level to
+// SHADER_READ_ONLY_OPTIMAL. On entry all levels must be in TRANSFER_DST_OPTIMAL with level 0 written, and the
+// textures need TRANSFER_SRC usage. Barriers are batched per level across all textures, so a batch costs one barrier
+// call per level rather than one per level per texture. Commands are recorded through dispatch.
+static void vtk_record_mipmap_generation(VTK_DeviceDispatch *dispatch, VkCommandBuffer command_buffer,
+                                         VTK_Texture **textures, u32 texture_count, VkFilter filter) {
+    CTK_ASSERT(texture_count <= VTK_MAX_MIPMAP_BATCH_TEXTURES);
+    u32 max_mip_levels = 0;
+    for (u32 i = 0; i < texture_count; ++i)
+        max_mip_levels = textures[i]->mip_levels > max_mip_levels ? textures[i]->mip_levels : max_mip_levels;
+
+    VkImageMemoryBarrier barriers[VTK_MAX_MIPMAP_BATCH_TEXTURES * 2];
+    for (u32 level = 1; level < max_mip_levels; ++level) {
+        u32 barrier_count = 0;
+        for (u32 i = 0; i < texture_count; ++i) {
+            if (level < textures[i]->mip_levels) {
+                barriers[barrier_count++] =
+                    vtk_texture_barrier(textures[i], VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                                        VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, VK_ACCESS_TRANSFER_WRITE_BIT,
+                                        VK_ACCESS_TRANSFER_READ_BIT, level - 1, 1);
+            }
+        }
+
+        dispatch->vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                                       0, 0, NULL, 0, NULL, barrier_count, barriers);
+
+        for (u32 i = 0; i < texture_count; ++i) {
+            VTK_Texture *texture = textures[i];
+            if (level >= texture->mip_levels)
+                continue;
+
+            s32 src_width = (s32)(texture->extent.width >> (level - 1));
+            s32 src_height = (s32)(texture->extent.height >> (level - 1));
+            s32 src_depth = (s32)(texture->extent.depth >> (level - 1));
+            VkImageBlit blit = {};
+            blit.srcSubresource.aspectMask = vtk_format_aspect(texture->format);
+            blit.srcSubresource.mipLevel = level - 1;
+            blit.srcSubresource.baseArrayLayer = 0;
+            blit.srcSubresource.layerCount = texture->layer_count;
+            blit.srcOffsets[1] = { src_width > 1 ? src_width : 1, src_height > 1 ? src_height : 1,
+                                   src_depth > 1 ? src_depth : 1 };
+            blit.dstSubresource = blit.srcSubresource;
+            blit.dstSubresource.mipLevel = level;
+            blit.dstOffsets[1] = { src_width > 1 ? src_width / 2 : 1, src_height > 1 ? src_height / 2 : 1,
+                                   src_depth > 1 ? src_depth / 2 : 1 };
+            dispatch->vkCmdBlitImage(command_buffer, texture->image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+                                     texture->image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &blit, filter);
+        }
+    }
+
+    // Every level but the last was a blit source.
+    u32 barrier_count = 0;
+    for (u32 i = 0; i < texture_count; ++i) {
+        VTK_Texture *texture = textures[i];
+        if (texture->mip_levels > 1) {
+            barriers[barrier_count++] =
+                vtk_texture_barrier(texture, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+                                    VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_ACCESS_TRANSFER_READ_BIT,
+                                    VK_ACCESS_SHADER_READ_BIT, 0, texture->mip_levels - 1);
+        }
+
+        barriers[barrier_count++] =
+            vtk_texture_barrier(texture, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+                                VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT, texture->mip_levels - 1, 1);
+    }
+
+    dispatch->vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                                   VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, 0, 0, NULL, 0, NULL, barrier_count, barriers);
+}
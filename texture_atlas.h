@@ -0,0 +1,320 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include "ctk/ctk.h"
+#include "vtk/vtk.h"
+#include "vtk/device_memory.h"
+#include "vtk/memory_types.h"
+#include "vtk/staging_ring.h"
+#include "vtk/texture.h"
+#include "vtk/debug_utils.h"
+
+////////////////////////////////////////////////////////////
+/// Data
+////////////////////////////////////////////////////////////
+static u32 const VTK_ATLAS_MAX_ENTRIES = 4096;
+static u32 const VTK_ATLAS_MAX_LAYERS = 64;
+static u32 const VTK_ATLAS_MAX_SKYLINE_NODES = 256;
+static u32 const VTK_NULL_ATLAS_ENTRY = CTK_U32_MAX;
+
+// Where a packed texture ended up. Shaders sample layer at uv_offset + uv * uv_scale.
+struct VTK_AtlasEntry {
+    u32 layer;
+    u32 x;
+    u32 y;
+    u32 width;
+    u32 height;
+    f32 uv_offset[2];
+    f32 uv_scale[2];
+};
+
+// Top edge of the packed area over [x, x + width).
+struct _VTK_SkylineNode {
+    u32 x;
+    u32 y;
+    u32 width;
+};
+
+struct _VTK_SkylinePage {
+    CTK_StaticArray<_VTK_SkylineNode, VTK_ATLAS_MAX_SKYLINE_NODES> nodes;
+};
+
+// Packs many small same-format textures into the layers of one 2D array image, so they share one image, one allocation
+// and one descriptor. Each layer is a page filled by a bottom-left skyline packer; a texture array is the special case
+// where every texture is page-sized and gets a layer of its own. Usage: pack every texture, create the atlas, upload
+// pixels for each entry through a staging ring, then finish.
+struct VTK_TextureAtlas {
+    VkFormat format;
+    u32 texel_size;
+    u32 width;
+    u32 height;
+    u32 max_layers;
+    u32 padding; // Empty texels kept around each entry so filtering doesn't bleed between neighbours.
+    bool array_mode; // Set by vtk_init_texture_array(): every texture is page-sized.
+
+    _VTK_SkylinePage pages[VTK_ATLAS_MAX_LAYERS];
+    u32 page_count;
+    CTK_StaticArray<VTK_AtlasEntry, VTK_ATLAS_MAX_ENTRIES> entries;
+    u64 packed_area;
+
+    VTK_Texture texture;
+};
+
+////////////////////////////////////////////////////////////
+/// Internal
+////////////////////////////////////////////////////////////
+
+// Lowest y at which a width x height rectangle can rest on the skyline starting at node_index; CTK_U32_MAX if it
+// doesn't fit.
+static u32 _vtk_skyline_fit(VTK_TextureAtlas *atlas, _VTK_SkylinePage *page, u32 node_index, u32 width, u32 height) {
+    _VTK_SkylineNode *node = page->nodes + node_index;
+    if (node->x + width > atlas->width)
+        return CTK_U32_MAX;
+
+    u32 y = 0;
+    u32 width_left = width;
+    for (u32 i = node_index; width_left > 0; ++i) {
+        y = page->nodes[i].y > y ? page->nodes[i].y : y;
+        if (y + height > atlas->height)
+            return CTK_U32_MAX;
+
+        width_left = page->nodes[i].width < width_left ? width_left - page->nodes[i].width : 0;
+    }
+
+    return y;
+}
+
+// Raises the skyline under a rectangle placed at node_index's x, trimming the nodes it covers and merging neighbours
+// of equal height. Returns false if the page has no node left to describe the new edge.
+static bool _vtk_skyline_insert(_VTK_SkylinePage *page, u32 node_index, u32 y, u32 width, u32 height) {
+    if (page->nodes.count == VTK_ATLAS_MAX_SKYLINE_NODES)
+        return false;
+
+    _VTK_SkylineNode new_node = { page->nodes[node_index].x, y + height, width };
+    for (u32 i = page->nodes.count; i > node_index; --i)
+        page->nodes[i] = page->nodes[i - 1];
+
+    page->nodes[node_index] = new_node;
+    ++page->nodes.count;
+
+    u32 right = new_node.x + new_node.width;
+    for (u32 i = node_index + 1; i < page->nodes.count;) {
+        _VTK_SkylineNode *node = page->nodes + i;
+        if (node->x >= right)
+            break;
+
+        u32 overlap = right - node->x;
+        if (overlap < node->width) {
+            node->x += overlap;
+            node->width -= overlap;
+            break;
+        }
+
+        for (u32 j = i; j + 1 < page->nodes.count; ++j)
+            page->nodes[j] = page->nodes[j + 1];
+
+        --page->nodes.count;
+    }
+
+    for (u32 i = 0; i + 1 < page->nodes.count;) {
+        if (page->nodes[i].y == page->nodes[i + 1].y) {
+            page->nodes[i].width += page->nodes[i + 1].width;
+            for (u32 j = i + 1; j + 1 < page->nodes.count; ++j)
+                page->nodes[j] = page->nodes[j + 1];
+
+            --page->nodes.count;
+        }
+        else {
+            ++i;
+        }
+    }
+
+    return true;
+}
+
+static void _vtk_open_atlas_page(VTK_TextureAtlas *atlas) {
+    _VTK_SkylinePage *page = atlas->pages + atlas->page_count++;
+    _VTK_SkylineNode floor = { 0, 0, atlas->width };
+    page->nodes.count = 0;
+    ctk_push(&page->nodes, floor);
+}
+
+////////////////////////////////////////////////////////////
+/// Interface
+////////////////////////////////////////////////////////////
+
+// texel_size is the format's bytes per texel. Pages are width x height; max_layers bounds how many are opened and must
+// not exceed the device's maxImageArrayLayers (at least 256).
+static void vtk_init_texture_atlas(VTK_TextureAtlas *atlas, VkFormat format, u32 texel_size, u32 width, u32 height,
+                                   u32 max_layers, u32 padding) {
+    CTK_ASSERT(max_layers > 0 && max_layers <= VTK_ATLAS_MAX_LAYERS);
+    atlas->format = format;
+    atlas->texel_size = texel_size;
+    atlas->width = width;
+    atlas->height = height;
+    atlas->max_layers = max_layers;
+    atlas->padding = padding;
+    atlas->array_mode = false;
+    atlas->page_count = 0;
+    atlas->entries.count = 0;
+    atlas->packed_area = 0;
+    atlas->texture = {};
+    atlas->texture.allocation = VTK_NULL_ALLOCATION;
+}
+
+// Texture array of width x height layers: every texture packed must be exactly that size and gets a layer of its own.
+static void vtk_init_texture_array(VTK_TextureAtlas *atlas, VkFormat format, u32 texel_size, u32 width, u32 height,
+                                   u32 max_layers) {
+    vtk_init_texture_atlas(atlas, format, texel_size, width, height, max_layers, 0);
+    atlas->array_mode = true;
+}
+
+// Reserves space for a width x height texture, on the page where it rests lowest, opening a new page if none has room.
+// Pages whose skyline has run out of nodes are skipped, so a fragmented page falls through to the next. Returns the
+// entry index, or VTK_NULL_ATLAS_ENTRY if the texture doesn't fit in max_layers pages. Must be called before
+// vtk_create_texture_atlas().
+static u32 vtk_pack_atlas_texture(VTK_TextureAtlas *atlas, u32 width, u32 height) {
+    CTK_ASSERT(atlas->texture.allocation == VTK_NULL_ALLOCATION);
+    CTK_ASSERT(!atlas->array_mode || (width == atlas->width && height == atlas->height));
+    u32 padded_width = width + atlas->padding * 2;
+    u32 padded_height = height + atlas->padding * 2;
+    if (atlas->entries.count == VTK_ATLAS_MAX_ENTRIES || padded_width > atlas->width || padded_height > atlas->height)
+        return VTK_NULL_ATLAS_ENTRY;
+
+    u32 best_page = CTK_U32_MAX;
+    u32 best_node = CTK_U32_MAX;
+    u32 best_top = CTK_U32_MAX;
+    u32 best_node_width = CTK_U32_MAX;
+    for (u32 attempt = 0; attempt < 2 && best_page == CTK_U32_MAX; ++attempt) {
+        if (attempt == 1) {
+            if (atlas->page_count == atlas->max_layers)
+                return VTK_NULL_ATLAS_ENTRY;
+
+            _vtk_open_atlas_page(atlas);
+        }
+
+        for (u32 page_index = attempt == 0 ? 0 : atlas->page_count - 1; page_index < atlas->page_count; ++page_index) {
+            _VTK_SkylinePage *page = atlas->pages + page_index;
+            if (page->nodes.count == VTK_ATLAS_MAX_SKYLINE_NODES)
+                continue;
+
+            for (u32 node_index = 0; node_index < page->nodes.count; ++node_index) {
+                u32 y = _vtk_skyline_fit(atlas, page, node_index, padded_width, padded_height);
+                if (y == CTK_U32_MAX)
+                    continue;
+
+                u32 top = y + padded_height;
+                u32 node_width = page->nodes[node_index].width;
+                if (top < best_top || (top == best_top && node_width < best_node_width)) {
+                    best_page = page_index;
+                    best_node = node_index;
+                    best_top = top;
+                    best_node_width = node_width;
+                }
+            }
+        }
+    }
+
+    _VTK_SkylinePage *page = atlas->pages + best_page;
+    u32 x = page->nodes[best_node].x;
+    u32 y = best_top - padded_height;
+    if (!_vtk_skyline_insert(page, best_node, y, padded_width, padded_height))
+        CTK_FATAL("texture atlas page %u has no skyline node left", best_page)
+
+    VTK_AtlasEntry entry = {};
+    entry.layer = best_page;
+    entry.x = x + atlas->padding;
+    entry.y = y + atlas->padding;
+    entry.width = width;
+    entry.height = height;
+    entry.uv_offset[0] = (f32)entry.x / (f32)atlas->width;
+    entry.uv_offset[1] = (f32)entry.y / (f32)atlas->height;
+    entry.uv_scale[0] = (f32)width / (f32)atlas->width;
+    entry.uv_scale[1] = (f32)height / (f32)atlas->height;
+    ctk_push(&atlas->entries, entry);
+    atlas->packed_area += (u64)width * height;
+    return atlas->entries.count - 1;
+}
+
+// Creates the array image with one layer per opened page (as a 2D_ARRAY view, even with one layer, so shaders bind
+// every atlas the same way) and records a clear of it into ring, leaving it in TRANSFER_DST_OPTIMAL for uploads.
+// Returns false if device memory is exhausted. The atlas has a single mip: downsampling would bleed between entries.
+static bool vtk_create_texture_atlas(VTK_TextureAtlas *atlas, VTK_DeviceMemoryAllocator *allocator,
+                                     VTK_MemoryTypeSelector *selector, VTK_StagingRing *ring,
+                                     cstr debug_name = NULL) {
+    VTK_TextureInfo info = vtk_default_texture_info(atlas->format, atlas->width, atlas->height);
+    info.layer_count = atlas->page_count > 0 ? atlas->page_count : 1;
+    info.view_type = VK_IMAGE_VIEW_TYPE_2D_ARRAY;
+    info.debug_name = debug_name;
+    atlas->texture = vtk_create_texture(allocator, selector, &info);
+    if (atlas->texture.allocation == VTK_NULL_ALLOCATION)
+        return false;
+
+    VTK_DeviceDispatch *dispatch = ring->dispatch;
+    VkCommandBuffer command_buffer = vtk_staging_ring_command_buffer(ring);
+    VkImageMemoryBarrier barrier = vtk_texture_barrier(&atlas->texture, VK_IMAGE_LAYOUT_UNDEFINED,
+                                                       VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 0,
+                                                       VK_ACCESS_TRANSFER_WRITE_BIT, 0, 1);
+    dispatch->vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                                   0, 0, NULL, 0, NULL, 1, &barrier);
+
+    // Padding and unused space must be defined, since filtering at entry edges reads it.
+    VkClearColorValue clear_color = {};
+    VkImageSubresourceRange range = barrier.subresourceRange;
+    dispatch->vkCmdClearColorImage(command_buffer, atlas->texture.image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                                   &clear_color, 1, &range);
+    barrier = vtk_texture_barrier(&atlas->texture, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                                  VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_ACCESS_TRANSFER_WRITE_BIT,
+                                  VK_ACCESS_TRANSFER_WRITE_BIT, 0, 1);
+    dispatch->vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0,
+                                   0, NULL, 0, NULL, 1, &barrier);
+    return true;
+}
+
+// Streams an entry's tightly packed pixels (entry.width * entry.height texels) into its place in the atlas.
+static void vtk_upload_atlas_texture(VTK_TextureAtlas *atlas, VTK_StagingRing *ring, u32 entry_index,
+                                     void const *pixels) {
+    VTK_AtlasEntry *entry = atlas->entries + entry_index;
+    VTK_StagingImageRegion region = {};
+    region.image = atlas->texture.image;
+    region.subresource.aspectMask = vtk_format_aspect(atlas->format);
+    region.subresource.mipLevel = 0;
+    region.subresource.baseArrayLayer = entry->layer;
+    region.subresource.layerCount = 1;
+    region.offset = { (s32)entry->x, (s32)entry->y, 0 };
+    region.extent = { entry->width, entry->height, 1 };
+    region.block_size = atlas->texel_size;
+    region.block_width = 1;
+    region.block_height = 1;
+    vtk_stage_image_upload(ring, &region, pixels);
+}
+
+// Records the transition to SHADER_READ_ONLY_OPTIMAL after every upload and flushes ring. The atlas is ready once the
+// ring's submission completes (vtk_wait_staging_ring(), or any later submission on the same queue).
+static void vtk_finish_texture_atlas(VTK_TextureAtlas *atlas, VTK_StagingRing *ring) {
+    VkImageMemoryBarrier barrier = vtk_texture_barrier(&atlas->texture, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                                                       VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+                                                       VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT, 0, 1);
+    ring->dispatch->vkCmdPipelineBarrier(vtk_staging_ring_command_buffer(ring), VK_PIPELINE_STAGE_TRANSFER_BIT,
+                                         VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, 0, 0, NULL, 0, NULL, 1, &barrier);
+    vtk_flush_staging_ring(ring);
+}
+
+static void vtk_destroy_texture_atlas(VTK_TextureAtlas *atlas, VTK_DeviceMemoryAllocator *allocator) {
+    vtk_destroy_texture(allocator, &atlas->texture);
+}
+
+static VTK_AtlasEntry *vtk_atlas_entry(VTK_TextureAtlas *atlas, u32 entry_index) {
+    return atlas->entries + entry_index;
+}
+
+// Fraction of opened page area covered by entries, excluding padding.
+static f64 vtk_texture_atlas_occupancy(VTK_TextureAtlas *atlas) {
+    u64 page_area = (u64)atlas->width * atlas->height * atlas->page_count;
+    return page_area > 0 ? (f64)atlas->packed_area / (f64)page_area : 0.0;
+}
+
+static void vtk_log_texture_atlas_stats(VTK_TextureAtlas *atlas) {
+    ctk_info("texture atlas %ux%u: %u entries in %u layers, %.1f%% occupied", atlas->width, atlas->height,
+             atlas->entries.count, atlas->page_count, vtk_texture_atlas_occupancy(atlas) * 100.0);
+}
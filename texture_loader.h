@@ -0,0 +1,535 @@
+#pragma once
+
+#include <condition_variable>
+#include <mutex>
+#include <string.h>
+#include <thread>
+#include <stb/stb_image.h>
+#include <vulkan/vulkan.h>
+#include "ctk/ctk.h"
+#include "vtk/vtk.h"
+#include "vtk/device.h"
+#include "vtk/device_memory.h"
+#include "vtk/memory_types.h"
+#include "vtk/texture.h"
+#include "vtk/debug_utils.h"
+
+////////////////////////////////////////////////////////////
+/// Data
+////////////////////////////////////////////////////////////
+static u32 const VTK_TEXTURE_LOADER_MAX_REQUESTS = 8192;
+static u32 const VTK_TEXTURE_LOADER_MAX_THREADS = 32;
+static u32 const VTK_TEXTURE_LOADER_MAX_BATCHES = 4;
+static u32 const VTK_TEXTURE_LOADER_MAX_BATCH_TEXTURES = 256;
+static u32 const VTK_TEXTURE_LOADER_MAX_PATH_SIZE = 256;
+static u32 const VTK_TEXTURE_STAGING_PAGE_SIZE = 64 * 1024;
+static u32 const VTK_TEXTURE_STAGING_MAX_PAGES = 8192;
+static u32 const VTK_NULL_TEXTURE_REQUEST = CTK_U32_MAX;
+
+enum {
+    VTK_TEXTURE_LOAD_QUEUED,
+    VTK_TEXTURE_LOAD_DECODING,
+    VTK_TEXTURE_LOAD_DECODED,   // Pixels are in staging memory, waiting for vtk_update_texture_loader() to upload them.
+    VTK_TEXTURE_LOAD_UPLOADING,
+    VTK_TEXTURE_LOAD_READY,
+    VTK_TEXTURE_LOAD_FAILED,
+};
+
+// Called from vtk_update_texture_loader() on the thread calling it; texture is NULL if loading failed.
+typedef void (*VTK_TextureLoadCallback)(void *user_data, u32 request, VTK_Texture *texture);
+
+struct _VTK_TextureRequest {
+    char path[VTK_TEXTURE_LOADER_MAX_PATH_SIZE];
+    VTK_TextureLoadCallback callback;
+    void *user_data;
+    bool srgb;
+    s32 state;
+    u32 width;
+    u32 height;
+    u32 staging_page;
+    u32 staging_page_count;
+    VTK_Texture texture;
+};
+
+struct _VTK_TextureUploadBatch {
+    VkCommandBuffer command_buffer;
+    VkFence fence;
+    CTK_StaticArray<u32, VTK_TEXTURE_LOADER_MAX_BATCH_TEXTURES> requests;
+    bool pending;
+};
+
+typedef CTK_StaticArray<VkImageMemoryBarrier, VTK_TEXTURE_LOADER_MAX_BATCH_TEXTURES> _VTK_TextureBarriers;
+
+struct VTK_TextureLoaderStats {
+    u64 textures_loaded;
+    u64 textures_failed;
+    u64 bytes_decoded;
+    u64 decode_ns; // Summed over all workers.
+    u64 batches_submitted;
+    u64 staging_waits; // Times a worker had to wait for staging pages.
+};
+
+// Decodes image files on a worker pool into persistently mapped staging pages and uploads them in batches: each
+// vtk_update_texture_loader() call creates images for every decoded texture and records all of their copies into a
+// single submission. Workers block when staging is full until uploaded batches retire. Vulkan objects are only touched
+// on the thread calling vtk_update_texture_loader(). Must not be copied or moved after vtk_init_texture_loader().
+struct VTK_TextureLoader {
+    VkDevice logical_device;
+    VTK_DeviceDispatch *dispatch; // Per-batch calls go through the device's dispatch table.
+    VkQueue queue;
+    VkCommandPool command_pool;
+    VTK_DeviceMemoryAllocator *allocator;
+    VTK_MemoryTypeSelector *selector;
+
+    // Set when both RGBA8 formats support blits, so loaded textures get a full mip chain generated on the GPU.
+    bool generate_mipmaps;
+    VkFilter mipmap_filter;
+
+    u32 staging_allocation;
+    VkBuffer staging_buffer;
+    u8 *staging_mapped;
+    u32 staging_page_count;
+    bool staging_pages_used[VTK_TEXTURE_STAGING_MAX_PAGES];
+
+    _VTK_TextureRequest requests[VTK_TEXTURE_LOADER_MAX_REQUESTS];
+    u32 request_count;
+    u32 outstanding_count; // Requests not yet READY or FAILED and reported.
+
+    // Request indexes waiting for a worker (ring) and decoded/failed ones waiting for the update thread.
+    u32 queued[VTK_TEXTURE_LOADER_MAX_REQUESTS];
+    u32 queued_head;
+    u32 queued_tail;
+    CTK_StaticArray<u32, VTK_TEXTURE_LOADER_MAX_REQUESTS> decoded;
+
+    _VTK_TextureUploadBatch batches[VTK_TEXTURE_LOADER_MAX_BATCHES];
+
+    std::mutex mutex;
+    std::condition_variable work_condition;
+    std::condition_variable staging_condition;
+    std::thread threads[VTK_TEXTURE_LOADER_MAX_THREADS];
+    u32 thread_count;
+    bool running;
+
+    VTK_TextureLoaderStats stats;
+};
+
+////////////////////////////////////////////////////////////
+/// Internal
+////////////////////////////////////////////////////////////
+
+// First run of page_count free pages; CTK_U32_MAX if there is none. Caller holds the mutex.
+static u32 _vtk_find_texture_staging_pages(VTK_TextureLoader *loader, u32 page_count) {
+    u32 run = 0;
+    for (u32 page = 0; page < loader->staging_page_count; ++page) {
+        run = loader->staging_pages_used[page] ? 0 : run + 1;
+        if (run == page_count)
+            return page + 1 - page_count;
+    }
+
+    return CTK_U32_MAX;
+}
+
+static void _vtk_set_texture_staging_pages(VTK_TextureLoader *loader, u32 first_page, u32 page_count, bool used) {
+    for (u32 page = first_page; page < first_page + page_count; ++page)
+        loader->staging_pages_used[page] = used;
+}
+
+static void _vtk_decode_texture(VTK_TextureLoader *loader, u32 request_index) {
+    VTK_CPU_ZONE("texture decode");
+    _VTK_TextureRequest *request = loader->requests + request_index;
+    u64 start_ns = _vtk_now_ns();
+    s32 width = 0;
+    s32 height = 0;
+    s32 channel_count = 0;
+    stbi_uc *pixels = stbi_load(request->path, &width, &height, &channel_count, STBI_rgb_alpha);
+    u64 size = (u64)width * (u64)height * 4;
+    u32 page_count = (u32)((size + VTK_TEXTURE_STAGING_PAGE_SIZE - 1) / VTK_TEXTURE_STAGING_PAGE_SIZE);
+    if (pixels == NULL || page_count > loader->staging_page_count) {
+        if (pixels == NULL)
+            ctk_warning("failed to decode texture \"%s\": %s", request->path, stbi_failure_reason());
+        else
+            ctk_warning("texture \"%s\" (%llu bytes) is larger than texture staging", request->path,
+                        (unsigned long long)size);
+
+        stbi_image_free(pixels);
+        std::lock_guard<std::mutex> lock(loader->mutex);
+        request->state = VTK_TEXTURE_LOAD_FAILED;
+        ctk_push(&loader->decoded, request_index);
+        return;
+    }
+
+    u32 first_page = CTK_U32_MAX;
+    {
+        std::unique_lock<std::mutex> lock(loader->mutex);
+        first_page = _vtk_find_texture_staging_pages(loader, page_count);
+        if (first_page == CTK_U32_MAX) {
+            VTK_CPU_ZONE("texture staging wait");
+            ++loader->stats.staging_waits;
+            loader->staging_condition.wait(lock, [&] {
+                first_page = _vtk_find_texture_staging_pages(loader, page_count);
+                return first_page != CTK_U32_MAX || !loader->running;
+            });
+        }
+
+        if (first_page == CTK_U32_MAX) {
+            stbi_image_free(pixels);
+            return;
+        }
+
+        _vtk_set_texture_staging_pages(loader, first_page, page_count, true);
+    }
+
+    // stb_image only decodes into memory it allocates, so this is the one copy into staging; it happens here on the
+    // worker rather than on the upload thread.
+    memcpy(loader->staging_mapped + (VkDeviceSize)first_page * VTK_TEXTURE_STAGING_PAGE_SIZE, pixels, size);
+    stbi_image_free(pixels);
+
+    std::lock_guard<std::mutex> lock(loader->mutex);
+    request->width = (u32)width;
+    request->height = (u32)height;
+    request->staging_page = first_page;
+    request->staging_page_count = page_count;
+    request->state = VTK_TEXTURE_LOAD_DECODED;
+    ctk_push(&loader->decoded, request_index);
+    loader->stats.bytes_decoded += size;
+    loader->stats.decode_ns += _vtk_now_ns() - start_ns;
+}
+
+static void _vtk_texture_worker_loop(VTK_TextureLoader *loader) {
+    for (;;) {
+        u32 request_index = VTK_NULL_TEXTURE_REQUEST;
+        {
+            std::unique_lock<std::mutex> lock(loader->mutex);
+            loader->work_condition.wait(lock, [&] {
+                return loader->queued_head != loader->queued_tail || !loader->running;
+            });
+            if (!loader->running)
+                return;
+
+            request_index = loader->queued[loader->queued_head];
+            loader->queued_head = (loader->queued_head + 1) % VTK_TEXTURE_LOADER_MAX_REQUESTS;
+            loader->requests[request_index].state = VTK_TEXTURE_LOAD_DECODING;
+        }
+
+        _vtk_decode_texture(loader, request_index);
+    }
+}
+
+static void _vtk_complete_texture_request(VTK_TextureLoader *loader, u32 request_index) {
+    _VTK_TextureRequest *request = loader->requests + request_index;
+    bool loaded = request->state == VTK_TEXTURE_LOAD_READY;
+    if (loaded)
+        ++loader->stats.textures_loaded;
+    else
+        ++loader->stats.textures_failed;
+
+    --loader->outstanding_count;
+    if (request->callback)
+        request->callback(request->user_data, request_index, loaded ? &request->texture : NULL);
+}
+
+static void _vtk_retire_texture_batches(VTK_TextureLoader *loader) {
+    for (u32 batch_index = 0; batch_index < VTK_TEXTURE_LOADER_MAX_BATCHES; ++batch_index) {
+        _VTK_TextureUploadBatch *batch = loader->batches + batch_index;
+        if (!batch->pending || loader->dispatch->vkGetFenceStatus(loader->logical_device, batch->fence) != VK_SUCCESS)
+            continue;
+
+        {
+            std::lock_guard<std::mutex> lock(loader->mutex);
+            for (u32 i = 0; i < batch->requests.count; ++i) {
+                _VTK_TextureRequest *request = loader->requests + batch->requests[i];
+                _vtk_set_texture_staging_pages(loader, request->staging_page, request->staging_page_count, false);
+                request->state = VTK_TEXTURE_LOAD_READY;
+            }
+        }
+
+        loader->staging_condition.notify_all();
+        for (u32 i = 0; i < batch->requests.count; ++i)
+            _vtk_complete_texture_request(loader, batch->requests[i]);
+
+        batch->requests.count = 0;
+        batch->pending = false;
+    }
+}
+
+// Records the upload of one decoded texture's top mip: UNDEFINED -> TRANSFER_DST and the copy. Barriers are collected
+// so the whole batch needs one barrier call before its copies; mip generation then finishes the batch.
+static bool _vtk_record_texture_upload(VTK_TextureLoader *loader, u32 request_index,
+                                       _VTK_TextureBarriers *pre_barriers, VkBufferImageCopy *copy) {
+    _VTK_TextureRequest *request = loader->requests + request_index;
+    VTK_TextureInfo info = vtk_default_texture_info(request->srgb ? VK_FORMAT_R8G8B8A8_SRGB : VK_FORMAT_R8G8B8A8_UNORM,
+                                                    request->width, request->height);
+    info.debug_name = request->path;
+    if (loader->generate_mipmaps) {
+        info.mip_levels = vtk_mip_level_count(info.extent);
+        info.usage |= VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+    }
+
+    request->texture = vtk_create_texture(loader->allocator, loader->selector, &info);
+    if (request->texture.allocation == VTK_NULL_ALLOCATION)
+        return false;
+
+    VTK_Texture *texture = &request->texture;
+    ctk_push(pre_barriers, vtk_texture_barrier(texture, VK_IMAGE_LAYOUT_UNDEFINED,
+                                               VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 0,
+                                               VK_ACCESS_TRANSFER_WRITE_BIT, 0, texture->mip_levels));
+
+    *copy = {};
+    copy->bufferOffset = (VkDeviceSize)request->staging_page * VTK_TEXTURE_STAGING_PAGE_SIZE;
+    copy->imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    copy->imageSubresource.mipLevel = 0;
+    copy->imageSubresource.baseArrayLayer = 0;
+    copy->imageSubresource.layerCount = 1;
+    copy->imageExtent = texture->extent;
+    return true;
+}
+
+////////////////////////////////////////////////////////////
+/// Interface
+////////////////////////////////////////////////////////////
+
+// thread_count of 0 uses one worker per hardware thread but one (the caller's). staging_size bounds the decoded pixels
+// waiting for upload, and must fit the largest texture loaded (RGBA8, so width * height * 4 bytes).
+static void vtk_init_texture_loader(VTK_TextureLoader *loader, VTK_Device *device,
+                                    VTK_DeviceMemoryAllocator *allocator, VTK_MemoryTypeSelector *selector,
+                                    VkQueue queue, u32 queue_family_index, VkDeviceSize staging_size,
+                                    u32 thread_count = 0) {
+    loader->logical_device = device->logical;
+    loader->dispatch = &device->dispatch;
+    loader->queue = queue;
+    loader->allocator = allocator;
+    loader->selector = selector;
+    VkFilter srgb_filter = VK_FILTER_NEAREST;
+    loader->mipmap_filter = VK_FILTER_NEAREST;
+    loader->generate_mipmaps =
+        vtk_format_supports_mipmap_blit(device->physical, VK_FORMAT_R8G8B8A8_UNORM, &loader->mipmap_filter) &&
+        vtk_format_supports_mipmap_blit(device->physical, VK_FORMAT_R8G8B8A8_SRGB, &srgb_filter);
+    if (srgb_filter != VK_FILTER_LINEAR)
+        loader->mipmap_filter = srgb_filter;
+
+    if (!loader->generate_mipmaps)
+        ctk_warning("RGBA8 textures don't support blits; loaded textures will have no mips");
+
+    loader->request_count = 0;
+    loader->outstanding_count = 0;
+    loader->queued_head = 0;
+    loader->queued_tail = 0;
+    loader->decoded.count = 0;
+    loader->stats = {};
+
+    loader->staging_page_count = (u32)(staging_size / VTK_TEXTURE_STAGING_PAGE_SIZE);
+    CTK_ASSERT(loader->staging_page_count > 0 && loader->staging_page_count <= VTK_TEXTURE_STAGING_MAX_PAGES);
+    memset(loader->staging_pages_used, 0, sizeof(loader->staging_pages_used));
+    VkBufferCreateInfo buffer_info = {};
+    buffer_info.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+    buffer_info.size = (VkDeviceSize)loader->staging_page_count * VTK_TEXTURE_STAGING_PAGE_SIZE;
+    buffer_info.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+    buffer_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    loader->staging_allocation = vtk_create_allocated_buffer(allocator, selector, &buffer_info,
+                                                             VTK_MEMORY_INTENT_UPLOAD, false, "texture staging");
+    if (loader->staging_allocation == VTK_NULL_ALLOCATION)
+        CTK_FATAL("failed to allocate %llu bytes of texture staging", (unsigned long long)buffer_info.size)
+
+    VTK_DeviceAllocation *staging = vtk_device_allocation(allocator, loader->staging_allocation);
+    loader->staging_buffer = staging->buffer;
+    loader->staging_mapped = staging->mapped;
+
+    VkCommandPoolCreateInfo pool_info = {};
+    pool_info.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+    pool_info.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT | VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+    pool_info.queueFamilyIndex = queue_family_index;
+    vtk_validate_result(vkCreateCommandPool(loader->logical_device, &pool_info, vtk_allocation_callbacks(),
+                                            &loader->command_pool),
+                        "failed to create texture loader command pool");
+
+    VkFenceCreateInfo fence_info = {};
+    fence_info.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+    for (u32 i = 0; i < VTK_TEXTURE_LOADER_MAX_BATCHES; ++i) {
+        _VTK_TextureUploadBatch *batch = loader->batches + i;
+        batch->command_buffer = vtk_allocate_command_buffer(loader->logical_device, loader->command_pool,
+                                                            VK_COMMAND_BUFFER_LEVEL_PRIMARY);
+        vtk_validate_result(vkCreateFence(loader->logical_device, &fence_info, vtk_allocation_callbacks(),
+                                          &batch->fence),
+                            "failed to create texture upload fence");
+        batch->requests.count = 0;
+        batch->pending = false;
+    }
+
+    if (thread_count == 0) {
+        u32 hardware_threads = std::thread::hardware_concurrency();
+        thread_count = hardware_threads > 1 ? hardware_threads - 1 : 1;
+    }
+
+    loader->thread_count =
+        thread_count < VTK_TEXTURE_LOADER_MAX_THREADS ? thread_count : VTK_TEXTURE_LOADER_MAX_THREADS;
+    loader->running = true;
+    for (u32 i = 0; i < loader->thread_count; ++i)
+        loader->threads[i] = std::thread(_vtk_texture_worker_loop, loader);
+}
+
+// Stops the workers (abandoning queued requests) and waits for submitted uploads. Loaded textures stay owned by the
+// caller; destroy them with vtk_destroy_texture().
+static void vtk_destroy_texture_loader(VTK_TextureLoader *loader) {
+    {
+        std::lock_guard<std::mutex> lock(loader->mutex);
+        loader->running = false;
+    }
+
+    loader->work_condition.notify_all();
+    loader->staging_condition.notify_all();
+    for (u32 i = 0; i < loader->thread_count; ++i)
+        loader->threads[i].join();
+
+    for (u32 i = 0; i < VTK_TEXTURE_LOADER_MAX_BATCHES; ++i) {
+        _VTK_TextureUploadBatch *batch = loader->batches + i;
+        if (batch->pending) {
+            vtk_validate_result(vkWaitForFences(loader->logical_device, 1, &batch->fence, VK_TRUE, CTK_U64_MAX),
+                                "failed to wait for texture upload fence");
+        }
+
+        vkDestroyFence(loader->logical_device, batch->fence, vtk_allocation_callbacks());
+    }
+
+    vkDestroyCommandPool(loader->logical_device, loader->command_pool, vtk_allocation_callbacks());
+    vtk_free_device_region(loader->allocator, loader->staging_allocation);
+}
+
+// Queues path for decoding and returns its request handle; call from the thread that updates the loader. path is
+// copied. Request handles aren't recycled, so a loader handles VTK_TEXTURE_LOADER_MAX_REQUESTS loads over its lifetime.
+static u32 vtk_load_texture(VTK_TextureLoader *loader, cstr path, bool srgb, VTK_TextureLoadCallback callback = NULL,
+                            void *user_data = NULL) {
+    if (loader->request_count == VTK_TEXTURE_LOADER_MAX_REQUESTS)
+        CTK_FATAL("texture loader cannot track more than %u requests", VTK_TEXTURE_LOADER_MAX_REQUESTS)
+
+    u32 request_index = loader->request_count++;
+    _VTK_TextureRequest *request = loader->requests + request_index;
+    *request = {};
+    strncpy(request->path, path, VTK_TEXTURE_LOADER_MAX_PATH_SIZE - 1);
+    request->callback = callback;
+    request->user_data = user_data;
+    request->srgb = srgb;
+    request->texture.allocation = VTK_NULL_ALLOCATION;
+    ++loader->outstanding_count;
+    {
+        std::lock_guard<std::mutex> lock(loader->mutex);
+        request->state = VTK_TEXTURE_LOAD_QUEUED;
+        loader->queued[loader->queued_tail] = request_index;
+        loader->queued_tail = (loader->queued_tail + 1) % VTK_TEXTURE_LOADER_MAX_REQUESTS;
+    }
+
+    loader->work_condition.notify_one();
+    return request_index;
+}
+
+// Call regularly (e.g. once per frame) from the thread that created the loader. Completes finished batches (firing
+// callbacks), then uploads everything decoded since the last call in one submission, if a batch slot is free.
+static void vtk_update_texture_loader(VTK_TextureLoader *loader) {
+    VTK_CPU_ZONE("vtk_update_texture_loader");
+    _vtk_retire_texture_batches(loader);
+
+    _VTK_TextureUploadBatch *batch = NULL;
+    for (u32 i = 0; i < VTK_TEXTURE_LOADER_MAX_BATCHES && batch == NULL; ++i) {
+        if (!loader->batches[i].pending)
+            batch = loader->batches + i;
+    }
+
+    if (batch == NULL)
+        return;
+
+    CTK_StaticArray<u32, VTK_TEXTURE_LOADER_MAX_BATCH_TEXTURES> decoded = {};
+    {
+        std::lock_guard<std::mutex> lock(loader->mutex);
+        while (loader->decoded.count > 0 && decoded.count < VTK_TEXTURE_LOADER_MAX_BATCH_TEXTURES)
+            ctk_push(&decoded, loader->decoded[--loader->decoded.count]);
+    }
+
+    _VTK_TextureBarriers pre_barriers = {};
+    VkBufferImageCopy copies[VTK_TEXTURE_LOADER_MAX_BATCH_TEXTURES];
+    for (u32 i = 0; i < decoded.count; ++i) {
+        u32 request_index = decoded[i];
+        _VTK_TextureRequest *request = loader->requests + request_index;
+        if (request->state == VTK_TEXTURE_LOAD_DECODED &&
+            _vtk_record_texture_upload(loader, request_index, &pre_barriers, copies + batch->requests.count)) {
+            request->state = VTK_TEXTURE_LOAD_UPLOADING;
+            ctk_push(&batch->requests, request_index);
+            continue;
+        }
+
+        if (request->state == VTK_TEXTURE_LOAD_DECODED) {
+            ctk_warning("out of device memory creating texture \"%s\"", request->path);
+            std::lock_guard<std::mutex> lock(loader->mutex);
+            _vtk_set_texture_staging_pages(loader, request->staging_page, request->staging_page_count, false);
+            request->state = VTK_TEXTURE_LOAD_FAILED;
+            loader->staging_condition.notify_all();
+        }
+
+        _vtk_complete_texture_request(loader, request_index);
+    }
+
+    if (batch->requests.count == 0)
+        return;
+
+    VTK_DeviceDispatch *dispatch = loader->dispatch;
+    vtk_validate_result(dispatch->vkResetFences(loader->logical_device, 1, &batch->fence),
+                        "failed to reset texture upload fence");
+    vtk_begin_temp_commands(dispatch, batch->command_buffer);
+    VTK_BEGIN_DEBUG_LABEL(batch->command_buffer, "texture upload");
+    dispatch->vkCmdPipelineBarrier(batch->command_buffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+                                   VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, NULL, 0, NULL, pre_barriers.count,
+                                   pre_barriers.data);
+    for (u32 i = 0; i < batch->requests.count; ++i) {
+        dispatch->vkCmdCopyBufferToImage(batch->command_buffer, loader->staging_buffer,
+                                         loader->requests[batch->requests[i]].texture.image,
+                                         VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, copies + i);
+    }
+
+    // Also transitions every level to SHADER_READ_ONLY, so it runs even when mips aren't generated.
+    VTK_Texture *textures[VTK_TEXTURE_LOADER_MAX_BATCH_TEXTURES];
+    for (u32 i = 0; i < batch->requests.count; ++i)
+        textures[i] = &loader->requests[batch->requests[i]].texture;
+
+    vtk_record_mipmap_generation(dispatch, batch->command_buffer, textures, batch->requests.count,
+                                 loader->mipmap_filter);
+    VTK_END_DEBUG_LABEL(batch->command_buffer);
+    vtk_validate_result(dispatch->vkEndCommandBuffer(batch->command_buffer),
+                        "failed to end texture upload command buffer");
+
+    VkSubmitInfo submit_info = {};
+    submit_info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    submit_info.commandBufferCount = 1;
+    submit_info.pCommandBuffers = &batch->command_buffer;
+    vtk_validate_result(dispatch->vkQueueSubmit(loader->queue, 1, &submit_info, batch->fence),
+                        "failed to submit texture upload batch");
+    batch->pending = true;
+    ++loader->stats.batches_submitted;
+}
+
+// Updates until every request so far has completed or failed.
+static void vtk_wait_texture_loader(VTK_TextureLoader *loader) {
+    VTK_CPU_ZONE("vtk_wait_texture_loader");
+    while (loader->outstanding_count > 0) {
+        vtk_update_texture_loader(loader);
+        std::this_thread::yield();
+    }
+}
+
+static s32 vtk_texture_load_state(VTK_TextureLoader *loader, u32 request_index) {
+    std::lock_guard<std::mutex> lock(loader->mutex);
+    return loader->requests[request_index].state;
+}
+
+// NULL until the request is VTK_TEXTURE_LOAD_READY.
+static VTK_Texture *vtk_loaded_texture(VTK_TextureLoader *loader, u32 request_index) {
+    return vtk_texture_load_state(loader, request_index) == VTK_TEXTURE_LOAD_READY
+           ? &loader->requests[request_index].texture
+           : NULL;
+}
+
+static void vtk_log_texture_loader_stats(VTK_TextureLoader *loader) {
+    VTK_TextureLoaderStats *stats = &loader->stats;
+    ctk_info("texture loader (%u threads): %llu loaded, %llu failed, %llu MiB decoded in %.1f ms thread time, "
+             "%llu batches, %llu staging waits", loader->thread_count, (unsigned long long)stats->textures_loaded,
+             (unsigned long long)stats->textures_failed, (unsigned long long)(stats->bytes_decoded >> 20),
+             (f64)stats->decode_ns / 1000000.0, (unsigned long long)stats->batches_submitted,
+             (unsigned long long)stats->staging_waits);
+}
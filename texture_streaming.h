@@ -0,0 +1,587 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include "ctk/ctk.h"
+#include "vtk/vtk.h"
+#include "vtk/device.h"
+#include "vtk/device_memory.h"
+#include "vtk/memory_types.h"
+#include "vtk/memory_budget.h"
+#include "vtk/staging_ring.h"
+#include "vtk/texture.h"
+#include "vtk/compressed_texture.h"
+#include "vtk/debug_utils.h"
+
+////////////////////////////////////////////////////////////
+/// Data
+////////////////////////////////////////////////////////////
+static u32 const VTK_STREAMING_MAX_TEXTURES = 4096;
+static u32 const VTK_STREAMING_MAX_MIPS = 16;
+static u32 const VTK_STREAMING_MAX_RETIRED = 1024;
+static u32 const VTK_STREAMING_TAIL_SIZE = 64; // Levels this size and smaller are always resident.
+static u32 const VTK_NULL_STREAMED_TEXTURE = CTK_U32_MAX;
+
+// Called when a streamed texture's image (and so its view) is replaced, so descriptors referencing it get rewritten.
+// The previous view stays valid for frames_in_flight more frames.
+typedef void (*VTK_TextureResidencyCallback)(void *user_data, u32 handle, VTK_Texture *texture);
+
+struct _VTK_StreamedTexture {
+    _VTK_MappedFile file; // Kept mapped; levels are read from it whenever they become resident.
+    _VTK_BlockFormat block_format;
+    VkFormat format;
+    VkExtent3D extent; // Of level 0.
+    u32 mip_levels;
+    u64 level_offsets[VTK_STREAMING_MAX_MIPS];
+
+    // texture holds levels [resident_base, mip_levels) as its own levels 0..n. tail_base is the coarsest it may go.
+    u32 tail_base;
+    u32 resident_base;
+    u32 target_base;
+    u32 requested_mip; // Finest level the renderer asked for this frame; CTK_U32_MAX if none.
+    u64 last_request_frame;
+
+    u64 demand_ns;        // When demand first exceeded residency; 0 while it's met.
+    u64 pending_position; // Staging ring position completing the latest raise; 0 if none is in flight.
+    VTK_Texture texture;
+};
+
+struct _VTK_RetiredStreamedTexture {
+    VTK_Texture texture;
+    u64 retire_frame;
+};
+
+struct VTK_TextureStreamingStats {
+    u64 mips_raised;
+    u64 mips_dropped;
+    u64 bytes_streamed;
+    u64 demands;        // Texture-frames with renderer demand.
+    u64 demands_met;    // Of those, ones where the demanded level was resident.
+    u64 budget_limited; // Of those, ones where the budget held the target below demand.
+    u64 latency_count;
+    u64 latency_total_ns; // Demand first exceeding residency to the raise's upload completing on the GPU.
+    u64 latency_max_ns;
+    u64 allocation_failures;
+    VkDeviceSize resident_bytes;
+    VkDeviceSize retiring_bytes;
+};
+
+// Streams mip levels of block-compressed KTX2/DDS textures in and out under a VRAM budget. Registering a texture makes
+// its low mips resident; each frame the renderer reports the finest level it needs per texture (from screen-space
+// size) and vtk_update_texture_streamer() raises or drops residency toward that, within the budget and a per-frame
+// upload limit. Without sparse residency a texture's mip range can't change in place, so each change builds a new
+// image: kept levels are copied GPU-side, new ones stream from the mapped file through the staging ring, and the old
+// image is destroyed frames_in_flight frames later. The staging ring must submit to the queue the renderer uses.
+struct VTK_TextureStreamer {
+    VTK_Device *device;
+    VTK_DeviceMemoryAllocator *allocator;
+    VTK_MemoryTypeSelector *selector;
+    VTK_StagingRing *ring;
+    u32 frames_in_flight;
+    u64 frame;
+
+    VkDeviceSize budget;           // Effective budget; lowered under memory pressure.
+    VkDeviceSize requested_budget; // Budget the application set, which budget recovers toward once pressure eases.
+    VkDeviceSize max_upload_bytes_per_frame;
+    u32 idle_frames; // Textures not requested for this many frames fall back to their tail.
+
+    _VTK_StreamedTexture textures[VTK_STREAMING_MAX_TEXTURES];
+    u32 texture_count;
+    CTK_StaticArray<_VTK_RetiredStreamedTexture, VTK_STREAMING_MAX_RETIRED> retired;
+
+    VTK_TextureResidencyCallback residency_callback;
+    void *residency_callback_data;
+
+    VTK_MemoryBudget *memory_budget; // NULL unless attached with vtk_attach_texture_streamer_to_memory_budget().
+
+    VTK_TextureStreamingStats stats;
+};
+
+////////////////////////////////////////////////////////////
+/// Internal
+////////////////////////////////////////////////////////////
+static VkDeviceSize _vtk_streamed_level_size(_VTK_StreamedTexture *texture, u32 level) {
+    return _vtk_compressed_image_size(&texture->block_format, texture->extent, level);
+}
+
+static VkDeviceSize _vtk_streamed_range_size(_VTK_StreamedTexture *texture, u32 base) {
+    VkDeviceSize size = 0;
+    for (u32 level = base; level < texture->mip_levels; ++level)
+        size += _vtk_streamed_level_size(texture, level);
+
+    return size;
+}
+
+static VkExtent3D _vtk_streamed_level_extent(_VTK_StreamedTexture *texture, u32 level) {
+    VkExtent3D extent = {};
+    extent.width = texture->extent.width >> level > 0 ? texture->extent.width >> level : 1;
+    extent.height = texture->extent.height >> level > 0 ? texture->extent.height >> level : 1;
+    extent.depth = 1;
+    return extent;
+}
+
+static void _vtk_retire_streamed_textures(VTK_TextureStreamer *streamer, bool all) {
+    for (u32 i = 0; i < streamer->retired.count;) {
+        _VTK_RetiredStreamedTexture *retired = streamer->retired + i;
+        if (!all && retired->retire_frame > streamer->frame) {
+            ++i;
+            continue;
+        }
+
+        streamer->stats.retiring_bytes -= vtk_device_allocation(streamer->allocator, retired->texture.allocation)->size;
+        vtk_destroy_texture(streamer->allocator, &retired->texture);
+        *retired = streamer->retired[--streamer->retired.count];
+    }
+}
+
+// Replaces handle's image with one holding levels [new_base, mip_levels): levels both images share are copied on the
+// GPU and newly resident ones are staged from the file. Returns false if memory (device or retirement slots) ran out.
+static bool _vtk_set_streamed_residency(VTK_TextureStreamer *streamer, u32 handle, u32 new_base) {
+    _VTK_StreamedTexture *streamed = streamer->textures + handle;
+    VTK_Texture *old_texture = &streamed->texture;
+    bool has_old = old_texture->allocation != VTK_NULL_ALLOCATION;
+    if (has_old && streamer->retired.count == VTK_STREAMING_MAX_RETIRED)
+        return false;
+
+    VkExtent3D base_extent = _vtk_streamed_level_extent(streamed, new_base);
+    VTK_TextureInfo info = vtk_default_texture_info(streamed->format, base_extent.width, base_extent.height);
+    info.mip_levels = streamed->mip_levels - new_base;
+    info.usage |= VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+    info.debug_name = "streamed texture";
+    VTK_Texture new_texture = vtk_create_texture(streamer->allocator, streamer->selector, &info);
+    if (new_texture.allocation == VTK_NULL_ALLOCATION) {
+        ++streamer->stats.allocation_failures;
+        return false;
+    }
+
+    new_texture.sampler = old_texture->sampler;
+    u32 old_base = has_old ? streamed->resident_base : streamed->mip_levels;
+    u32 shared_base = new_base > old_base ? new_base : old_base;
+    VTK_DeviceDispatch *dispatch = &streamer->device->dispatch;
+    VkCommandBuffer command_buffer = vtk_staging_ring_command_buffer(streamer->ring);
+    VkImageMemoryBarrier barriers[2];
+    barriers[0] = vtk_texture_barrier(&new_texture, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 0,
+                                      VK_ACCESS_TRANSFER_WRITE_BIT, 0, new_texture.mip_levels);
+    if (has_old) {
+        barriers[1] = vtk_texture_barrier(old_texture, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+                                          VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, VK_ACCESS_SHADER_READ_BIT,
+                                          VK_ACCESS_TRANSFER_READ_BIT, 0, old_texture->mip_levels);
+    }
+
+    dispatch->vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                                   0, 0, NULL, 0, NULL, has_old ? 2 : 1, barriers);
+
+    if (has_old) {
+        VkImageCopy copies[VTK_STREAMING_MAX_MIPS];
+        u32 copy_count = 0;
+        for (u32 level = shared_base; level < streamed->mip_levels; ++level) {
+            VkImageCopy *copy = copies + copy_count++;
+            *copy = {};
+            copy->srcSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+            copy->srcSubresource.mipLevel = level - old_base;
+            copy->srcSubresource.layerCount = 1;
+            copy->dstSubresource = copy->srcSubresource;
+            copy->dstSubresource.mipLevel = level - new_base;
+            copy->extent = _vtk_streamed_level_extent(streamed, level);
+        }
+
+        dispatch->vkCmdCopyImage(command_buffer, old_texture->image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+                                 new_texture.image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, copy_count, copies);
+    }
+
+    // Coarsest first, so an interrupted stream (ring back-pressure) still front-loads the cheap levels.
+    for (u32 level = shared_base; level-- > new_base;) {
+        VTK_StagingImageRegion region = {};
+        region.image = new_texture.image;
+        region.subresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        region.subresource.mipLevel = level - new_base;
+        region.subresource.layerCount = 1;
+        region.extent = _vtk_streamed_level_extent(streamed, level);
+        region.block_size = streamed->block_format.block_size;
+        region.block_width = streamed->block_format.block_width;
+        region.block_height = streamed->block_format.block_height;
+        vtk_stage_image_upload(streamer->ring, &region, streamed->file.data + streamed->level_offsets[level]);
+        streamer->stats.bytes_streamed += _vtk_streamed_level_size(streamed, level);
+    }
+
+    // Uploads may have submitted batches, so the command buffer is fetched again.
+    command_buffer = vtk_staging_ring_command_buffer(streamer->ring);
+    barriers[0] = vtk_texture_barrier(&new_texture, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                                      VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_ACCESS_TRANSFER_WRITE_BIT,
+                                      VK_ACCESS_SHADER_READ_BIT, 0, new_texture.mip_levels);
+    if (has_old) {
+        // Frames already recorded against the old image may still sample it.
+        barriers[1] = vtk_texture_barrier(old_texture, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+                                          VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_ACCESS_TRANSFER_READ_BIT,
+                                          VK_ACCESS_SHADER_READ_BIT, 0, old_texture->mip_levels);
+    }
+
+    dispatch->vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT,
+                                   0, 0, NULL, 0, NULL, has_old ? 2 : 1, barriers);
+
+    if (new_base < old_base) {
+        streamer->stats.mips_raised += old_base - new_base;
+        streamed->pending_position = vtk_staging_ring_position(streamer->ring);
+    }
+    else {
+        streamer->stats.mips_dropped += new_base - old_base;
+    }
+
+    streamer->stats.resident_bytes += vtk_device_allocation(streamer->allocator, new_texture.allocation)->size;
+    if (has_old) {
+        VkDeviceSize old_size = vtk_device_allocation(streamer->allocator, old_texture->allocation)->size;
+        streamer->stats.resident_bytes -= old_size;
+        streamer->stats.retiring_bytes += old_size;
+        _VTK_RetiredStreamedTexture retired = {};
+        retired.texture = *old_texture;
+        retired.retire_frame = streamer->frame + streamer->frames_in_flight;
+        ctk_push(&streamer->retired, retired);
+    }
+
+    streamed->texture = new_texture;
+    streamed->resident_base = new_base;
+    if (streamer->residency_callback)
+        streamer->residency_callback(streamer->residency_callback_data, handle, &streamed->texture);
+
+    return true;
+}
+
+// Drops the finest target level of textures until the planned residency fits the budget: textures the renderer didn't
+// ask for this frame first, then requested ones, finest levels across all textures before coarser ones.
+static void _vtk_fit_streaming_budget(VTK_TextureStreamer *streamer, VkDeviceSize planned_bytes) {
+    for (u32 pass = 0; pass < 2; ++pass) {
+        bool requested = pass == 1;
+        for (u32 level = 0; level < VTK_STREAMING_MAX_MIPS && planned_bytes > streamer->budget; ++level) {
+            for (u32 i = 0; i < streamer->texture_count && planned_bytes > streamer->budget; ++i) {
+                _VTK_StreamedTexture *streamed = streamer->textures + i;
+                if (streamed->file.data == NULL || streamed->target_base != level ||
+                    streamed->target_base >= streamed->tail_base ||
+                    (streamed->requested_mip != CTK_U32_MAX) != requested) {
+                    continue;
+                }
+
+                planned_bytes -= _vtk_streamed_level_size(streamed, level);
+                ++streamed->target_base;
+            }
+        }
+    }
+}
+
+// Eviction handler: lowers the effective budget below resident_bytes by bytes_to_free, so the next update drops the
+// finest levels. Nothing is freed here, since this may run inside an allocation (possibly the streamer's own) and
+// dropped images only retire frames_in_flight frames later, so it reports 0 bytes freed.
+static VkDeviceSize _vtk_evict_streamed_textures(void *user_data, u32 heap_index, s32 pressure,
+                                                 VkDeviceSize bytes_to_free) {
+    VTK_TextureStreamer *streamer = (VTK_TextureStreamer *)user_data;
+    if (!streamer->memory_budget->heaps[heap_index].device_local)
+        return 0;
+
+    VkDeviceSize resident_bytes = streamer->stats.resident_bytes;
+    VkDeviceSize lowered_budget = bytes_to_free < resident_bytes ? resident_bytes - bytes_to_free : 0;
+    if (lowered_budget < streamer->budget) {
+        ctk_info("texture streaming budget lowered to %llu MiB under memory pressure %d",
+                 (unsigned long long)(lowered_budget >> 20), pressure);
+        streamer->budget = lowered_budget;
+    }
+
+    return 0;
+}
+
+// Grows a lowered budget back toward the requested one by one frame's upload limit while no device-local heap is under
+// pressure, so it doesn't bounce straight back into eviction.
+static void _vtk_recover_streaming_budget(VTK_TextureStreamer *streamer) {
+    VTK_MemoryBudget *memory_budget = streamer->memory_budget;
+    if (memory_budget == NULL || streamer->budget == streamer->requested_budget)
+        return;
+
+    for (u32 heap_index = 0; heap_index < memory_budget->heap_count; ++heap_index) {
+        VTK_MemoryHeapBudget *heap = memory_budget->heaps + heap_index;
+        if (heap->device_local && heap->pressure != VTK_MEMORY_PRESSURE_NONE)
+            return;
+    }
+
+    VkDeviceSize headroom = streamer->requested_budget - streamer->budget;
+    streamer->budget += headroom < streamer->max_upload_bytes_per_frame ? headroom
+                                                                        : streamer->max_upload_bytes_per_frame;
+}
+
+////////////////////////////////////////////////////////////
+/// Interface
+////////////////////////////////////////////////////////////
+
+// budget bounds the streamer's resident texture memory (not counting images retiring after a change);
+// max_upload_bytes_per_frame bounds how much is streamed per update (at least one level is, however large).
+static void vtk_init_texture_streamer(VTK_TextureStreamer *streamer, VTK_Device *device,
+                                      VTK_DeviceMemoryAllocator *allocator, VTK_MemoryTypeSelector *selector,
+                                      VTK_StagingRing *ring, u32 frames_in_flight, VkDeviceSize budget,
+                                      VkDeviceSize max_upload_bytes_per_frame) {
+    streamer->device = device;
+    streamer->allocator = allocator;
+    streamer->selector = selector;
+    streamer->ring = ring;
+    streamer->frames_in_flight = frames_in_flight;
+    streamer->frame = 0;
+    streamer->budget = budget;
+    streamer->requested_budget = budget;
+    streamer->max_upload_bytes_per_frame = max_upload_bytes_per_frame;
+    streamer->idle_frames = 60;
+    streamer->texture_count = 0;
+    streamer->retired.count = 0;
+    streamer->residency_callback = NULL;
+    streamer->residency_callback_data = NULL;
+    streamer->memory_budget = NULL;
+    streamer->stats = {};
+}
+
+// The device must be idle.
+static void vtk_destroy_texture_streamer(VTK_TextureStreamer *streamer) {
+    _vtk_retire_streamed_textures(streamer, true);
+    for (u32 i = 0; i < streamer->texture_count; ++i) {
+        _VTK_StreamedTexture *streamed = streamer->textures + i;
+        if (streamed->file.data == NULL)
+            continue;
+
+        vtk_destroy_texture(streamer->allocator, &streamed->texture);
+        _vtk_unmap_file(&streamed->file);
+    }
+
+    streamer->texture_count = 0;
+}
+
+static void vtk_set_texture_residency_callback(VTK_TextureStreamer *streamer, VTK_TextureResidencyCallback callback,
+                                               void *user_data) {
+    streamer->residency_callback = callback;
+    streamer->residency_callback_data = user_data;
+}
+
+static void vtk_set_texture_streaming_budget(VTK_TextureStreamer *streamer, VkDeviceSize budget) {
+    streamer->budget = budget;
+    streamer->requested_budget = budget;
+}
+
+// Registers the streamer as an eviction handler, so pressure on a device-local heap lowers its budget (taking effect
+// on the next vtk_update_texture_streamer()); the budget recovers once pressure is gone. Register it before handlers
+// for content that's more expensive to rebuild. memory_budget must outlive the streamer.
+static void vtk_attach_texture_streamer_to_memory_budget(VTK_TextureStreamer *streamer,
+                                                         VTK_MemoryBudget *memory_budget) {
+    streamer->memory_budget = memory_budget;
+    vtk_register_eviction_callback(memory_budget, _vtk_evict_streamed_textures, streamer, VTK_MEMORY_PRESSURE_LOW);
+}
+
+// Maps a single-layer 2D KTX2 or DDS file and stages its mip tail (levels of VTK_STREAMING_TAIL_SIZE and smaller), so
+// the texture is usable right away at low detail. Returns VTK_NULL_STREAMED_TEXTURE if the file can't be streamed.
+static u32 vtk_register_streamed_texture(VTK_TextureStreamer *streamer, cstr path, bool srgb = false) {
+    if (streamer->texture_count == VTK_STREAMING_MAX_TEXTURES) {
+        ctk_warning("texture streamer cannot track more than %u textures", VTK_STREAMING_MAX_TEXTURES);
+        return VTK_NULL_STREAMED_TEXTURE;
+    }
+
+    u32 handle = streamer->texture_count;
+    _VTK_StreamedTexture *streamed = streamer->textures + handle;
+    *streamed = {};
+    if (!_vtk_map_file(path, &streamed->file)) {
+        ctk_warning("failed to map streamed texture \"%s\"", path);
+        return VTK_NULL_STREAMED_TEXTURE;
+    }
+
+    _VTK_CompressedTextureLayout layout = {};
+    bool parsed = _vtk_parse_ktx2(&streamed->file, &layout, path) ||
+                  _vtk_parse_dds(&streamed->file, &layout, srgb, path);
+    _VTK_BlockFormat block_format = _vtk_block_format(layout.format);
+    bool streamable = parsed && layout.layer_count == 1 && layout.mip_levels <= VTK_STREAMING_MAX_MIPS &&
+                      vtk_texture_compression_enabled(streamer->device, block_format.compression);
+    if (streamable) {
+        VkFormatProperties properties = {};
+        vkGetPhysicalDeviceFormatProperties(streamer->device->physical, layout.format, &properties);
+        VkFormatFeatureFlags required = VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT | VK_FORMAT_FEATURE_TRANSFER_SRC_BIT |
+                                        VK_FORMAT_FEATURE_TRANSFER_DST_BIT;
+        streamable = (properties.optimalTilingFeatures & required) == required;
+    }
+
+    if (!streamable) {
+        ctk_warning("\"%s\" isn't streamable: needs a single-layer 2D KTX2/DDS in a format the device samples", path);
+        _vtk_unmap_file(&streamed->file);
+        return VTK_NULL_STREAMED_TEXTURE;
+    }
+
+    streamed->block_format = block_format;
+    streamed->format = layout.format;
+    streamed->extent = layout.extent;
+    streamed->mip_levels = layout.mip_levels;
+    for (u32 level = 0; level < layout.mip_levels; ++level)
+        streamed->level_offsets[level] = layout.data_offset + layout.regions[level].bufferOffset;
+
+    streamed->tail_base = streamed->mip_levels - 1;
+    while (streamed->tail_base > 0) {
+        VkExtent3D extent = _vtk_streamed_level_extent(streamed, streamed->tail_base - 1);
+        if (extent.width > VTK_STREAMING_TAIL_SIZE || extent.height > VTK_STREAMING_TAIL_SIZE)
+            break;
+
+        --streamed->tail_base;
+    }
+
+    streamed->resident_base = streamed->mip_levels;
+    streamed->target_base = streamed->tail_base;
+    streamed->requested_mip = CTK_U32_MAX;
+    streamed->texture.allocation = VTK_NULL_ALLOCATION;
+    ++streamer->texture_count;
+    if (!_vtk_set_streamed_residency(streamer, handle, streamed->tail_base)) {
+        ctk_warning("out of memory making streamed texture \"%s\" resident", path);
+        _vtk_unmap_file(&streamed->file);
+        --streamer->texture_count;
+        return VTK_NULL_STREAMED_TEXTURE;
+    }
+
+    return handle;
+}
+
+// Finest level worth sampling for texture when it covers about screen_size pixels along its larger axis.
+static u32 vtk_streamed_mip_for_screen_size(VTK_TextureStreamer *streamer, u32 handle, f32 screen_size) {
+    _VTK_StreamedTexture *streamed = streamer->textures + handle;
+    u32 texture_size = streamed->extent.width > streamed->extent.height ? streamed->extent.width
+                                                                        : streamed->extent.height;
+    u32 level = 0;
+    while (level + 1 < streamed->mip_levels && (f32)(texture_size >> (level + 1)) >= screen_size)
+        ++level;
+
+    return level;
+}
+
+// Demand feedback: the renderer needs handle's mip level (and coarser) this frame. The finest request per frame wins.
+static void vtk_request_streamed_texture_mip(VTK_TextureStreamer *streamer, u32 handle, u32 mip_level) {
+    _VTK_StreamedTexture *streamed = streamer->textures + handle;
+    streamed->requested_mip = mip_level < streamed->requested_mip ? mip_level : streamed->requested_mip;
+    streamed->last_request_frame = streamer->frame;
+}
+
+// Call once per frame, after the renderer's requests. Retires old images, plans each texture's residency from demand
+// and the budget, drops surplus levels, streams missing ones up to the per-frame upload limit, and flushes the ring.
+static void vtk_update_texture_streamer(VTK_TextureStreamer *streamer) {
+    VTK_CPU_ZONE("vtk_update_texture_streamer");
+    VTK_TextureStreamingStats *stats = &streamer->stats;
+    _vtk_retire_streamed_textures(streamer, false);
+    u64 now_ns = _vtk_now_ns();
+    u64 completed_position = vtk_poll_staging_ring(streamer->ring);
+    _vtk_recover_streaming_budget(streamer);
+
+    VkDeviceSize planned_bytes = 0;
+    for (u32 i = 0; i < streamer->texture_count; ++i) {
+        _VTK_StreamedTexture *streamed = streamer->textures + i;
+        if (streamed->file.data == NULL)
+            continue;
+
+        if (streamed->pending_position != 0 && completed_position >= streamed->pending_position) {
+            streamed->pending_position = 0;
+            if (streamed->demand_ns != 0 && streamed->resident_base <= streamed->target_base) {
+                u64 latency_ns = now_ns - streamed->demand_ns;
+                ++stats->latency_count;
+                stats->latency_total_ns += latency_ns;
+                stats->latency_max_ns = latency_ns > stats->latency_max_ns ? latency_ns : stats->latency_max_ns;
+                streamed->demand_ns = 0;
+            }
+        }
+
+        if (streamed->requested_mip != CTK_U32_MAX)
+            streamed->target_base = streamed->requested_mip < streamed->tail_base ? streamed->requested_mip
+                                                                                  : streamed->tail_base;
+        else if (streamer->frame - streamed->last_request_frame > streamer->idle_frames)
+            streamed->target_base = streamed->tail_base;
+        else
+            streamed->target_base = streamed->resident_base;
+
+        planned_bytes += _vtk_streamed_range_size(streamed, streamed->target_base);
+    }
+
+    _vtk_fit_streaming_budget(streamer, planned_bytes);
+
+    // Drops first, so the memory they free is available to raises.
+    for (u32 i = 0; i < streamer->texture_count; ++i) {
+        _VTK_StreamedTexture *streamed = streamer->textures + i;
+        if (streamed->file.data != NULL && streamed->target_base > streamed->resident_base)
+            _vtk_set_streamed_residency(streamer, i, streamed->target_base);
+    }
+
+    VkDeviceSize upload_bytes = 0;
+    for (u32 i = 0; i < streamer->texture_count; ++i) {
+        _VTK_StreamedTexture *streamed = streamer->textures + i;
+        if (streamed->file.data == NULL)
+            continue;
+
+        if (streamed->target_base >= streamed->resident_base) {
+            // Demand met or withdrawn (idle, budget), so it mustn't be timed from now on. A raise still in flight is
+            // timed when its upload completes.
+            if (streamed->pending_position == 0)
+                streamed->demand_ns = 0;
+
+            continue;
+        }
+
+        if (streamed->demand_ns == 0)
+            streamed->demand_ns = now_ns;
+
+        // Coarsest missing levels first; the rest follow in later frames.
+        u32 new_base = streamed->resident_base;
+        while (new_base > streamed->target_base) {
+            VkDeviceSize level_size = _vtk_streamed_level_size(streamed, new_base - 1);
+            if (upload_bytes > 0 && upload_bytes + level_size > streamer->max_upload_bytes_per_frame)
+                break;
+
+            upload_bytes += level_size;
+            --new_base;
+        }
+
+        if (new_base < streamed->resident_base)
+            _vtk_set_streamed_residency(streamer, i, new_base);
+    }
+
+    for (u32 i = 0; i < streamer->texture_count; ++i) {
+        _VTK_StreamedTexture *streamed = streamer->textures + i;
+        if (streamed->file.data == NULL || streamed->requested_mip == CTK_U32_MAX)
+            continue;
+
+        u32 demanded_base = streamed->requested_mip < streamed->tail_base ? streamed->requested_mip
+                                                                          : streamed->tail_base;
+        ++stats->demands;
+        if (streamed->resident_base <= demanded_base)
+            ++stats->demands_met;
+
+        if (streamed->target_base > demanded_base)
+            ++stats->budget_limited;
+
+        streamed->requested_mip = CTK_U32_MAX;
+    }
+
+    vtk_flush_staging_ring(streamer->ring);
+    ++streamer->frame;
+}
+
+// Current texture for handle; its image, view and mip range change whenever residency does.
+static VTK_Texture *vtk_streamed_texture(VTK_TextureStreamer *streamer, u32 handle) {
+    return &streamer->textures[handle].texture;
+}
+
+// Finest resident level, in the full texture's mip numbering.
+static u32 vtk_streamed_texture_resident_mip(VTK_TextureStreamer *streamer, u32 handle) {
+    return streamer->textures[handle].resident_base;
+}
+
+// Fraction of renderer demands that found their level resident.
+static f64 vtk_texture_streaming_hit_rate(VTK_TextureStreamer *streamer) {
+    VTK_TextureStreamingStats *stats = &streamer->stats;
+    return stats->demands > 0 ? (f64)stats->demands_met / (f64)stats->demands : 1.0;
+}
+
+static void vtk_log_texture_streaming_stats(VTK_TextureStreamer *streamer) {
+    VTK_TextureStreamingStats *stats = &streamer->stats;
+    f64 average_latency_ms = stats->latency_count > 0
+                             ? (f64)stats->latency_total_ns / (f64)stats->latency_count / 1000000.0
+                             : 0.0;
+    ctk_info("texture streaming: %u textures, %llu/%llu MiB resident (%llu MiB retiring), %.1f%% demand hits, "
+             "%llu budget-limited", streamer->texture_count, (unsigned long long)(stats->resident_bytes >> 20),
+             (unsigned long long)(streamer->budget >> 20), (unsigned long long)(stats->retiring_bytes >> 20),
+             vtk_texture_streaming_hit_rate(streamer) * 100.0, (unsigned long long)stats->budget_limited);
+    ctk_info("texture streaming: %llu mips raised, %llu dropped, %llu MiB streamed, latency %.2f ms avg / %.2f ms max "
+             "over %llu raises, %llu allocation failures", (unsigned long long)stats->mips_raised,
+             (unsigned long long)stats->mips_dropped, (unsigned long long)(stats->bytes_streamed >> 20),
+             average_latency_ms, (f64)stats->latency_max_ns / 1000000.0, (unsigned long long)stats->latency_count,
+             (unsigned long long)stats->allocation_failures);
+}
@@ -4,8 +4,22 @@
 #include "ctk/ctk.h"
 #include "ctk/memory.h"
 #include "ctk/containers.h"
+#include "vtk/cpu_profiler.h"
 
-#define _VTK_VK_RESULT_NAME(VK_RESULT) VK_RESULT, #VK_RESULT
+#ifdef VTK_RESULT_TELEMETRY
+    #include <mutex>
+    #include <stdint.h>
+#endif
+
+#define _VTK_VK_RESULT_CASE(VK_RESULT, MESSAGE) case VK_RESULT: return { VK_RESULT, #VK_RESULT, MESSAGE };
+
+#if defined(__GNUC__) || defined(__clang__)
+    #define _VTK_LIKELY(CONDITION) __builtin_expect(!!(CONDITION), 1)
+    #define _VTK_COLD __attribute__((cold, noinline))
+#else
+    #define _VTK_LIKELY(CONDITION) (CONDITION)
+    #define _VTK_COLD
+#endif
 
 #define VTK_LOAD_INSTANCE_EXTENSION_FUNCTION(INSTANCE, FUNC_NAME)\
     auto FUNC_NAME = (PFN_ ## FUNC_NAME)vkGetInstanceProcAddr(INSTANCE, #FUNC_NAME);\
@@ -24,68 +38,157 @@ struct _VTK_VkResultInfo {
 ////////////////////////////////////////////////////////////
 /// Debugging
 ////////////////////////////////////////////////////////////
-static void _vtk_print_result(VkResult result) {
-    static _VTK_VkResultInfo VK_RESULT_DEBUG_INFOS[] = {
-        { _VTK_VK_RESULT_NAME(VK_SUCCESS), "VULKAN SPEC ERROR MESSAGE: Command successfully completed." },
-        { _VTK_VK_RESULT_NAME(VK_NOT_READY), "VULKAN SPEC ERROR MESSAGE: A fence or query has not yet completed." },
-        { _VTK_VK_RESULT_NAME(VK_TIMEOUT), "VULKAN SPEC ERROR MESSAGE: A wait operation has not completed in the specified time." },
-        { _VTK_VK_RESULT_NAME(VK_EVENT_SET), "VULKAN SPEC ERROR MESSAGE: An event is signaled." },
-        { _VTK_VK_RESULT_NAME(VK_EVENT_RESET), "VULKAN SPEC ERROR MESSAGE: An event is unsignaled." },
-        { _VTK_VK_RESULT_NAME(VK_INCOMPLETE), "VULKAN SPEC ERROR MESSAGE: A return array was too small for the result." },
-        { _VTK_VK_RESULT_NAME(VK_SUBOPTIMAL_KHR), "VULKAN SPEC ERROR MESSAGE: A swapchain no longer matches the surface properties exactly, but can still be used to present to the surface successfully." },
-        { _VTK_VK_RESULT_NAME(VK_ERROR_OUT_OF_HOST_MEMORY), "VULKAN SPEC ERROR MESSAGE: A host memory allocation has failed." },
-        { _VTK_VK_RESULT_NAME(VK_ERROR_OUT_OF_DEVICE_MEMORY), "VULKAN SPEC ERROR MESSAGE: A device memory allocation has failed." },
-        { _VTK_VK_RESULT_NAME(VK_ERROR_INITIALIZATION_FAILED), "VULKAN SPEC ERROR MESSAGE: Initialization of an object could not be completed for implementation-specific reasons." },
-        { _VTK_VK_RESULT_NAME(VK_ERROR_DEVICE_LOST), "VULKAN SPEC ERROR MESSAGE: The logical or physical device has been lost." },
-        { _VTK_VK_RESULT_NAME(VK_ERROR_MEMORY_MAP_FAILED), "VULKAN SPEC ERROR MESSAGE: Mapping of a memory object has failed." },
-        { _VTK_VK_RESULT_NAME(VK_ERROR_LAYER_NOT_PRESENT), "VULKAN SPEC ERROR MESSAGE: A requested layer is not present or could not be loaded." },
-        { _VTK_VK_RESULT_NAME(VK_ERROR_EXTENSION_NOT_PRESENT), "VULKAN SPEC ERROR MESSAGE: A requested extension is not supported." },
-        { _VTK_VK_RESULT_NAME(VK_ERROR_FEATURE_NOT_PRESENT), "VULKAN SPEC ERROR MESSAGE: A requested feature is not supported." },
-        { _VTK_VK_RESULT_NAME(VK_ERROR_INCOMPATIBLE_DRIVER), "VULKAN SPEC ERROR MESSAGE: The requested version of Vulkan is not supported by the driver or is otherwise incompatible for implementation-specific reasons." },
-        { _VTK_VK_RESULT_NAME(VK_ERROR_TOO_MANY_OBJECTS), "VULKAN SPEC ERROR MESSAGE: Too many objects of the type have already been created." },
-        { _VTK_VK_RESULT_NAME(VK_ERROR_FORMAT_NOT_SUPPORTED), "VULKAN SPEC ERROR MESSAGE: A requested format is not supported on this device." },
-        { _VTK_VK_RESULT_NAME(VK_ERROR_FRAGMENTED_POOL), "VULKAN SPEC ERROR MESSAGE: A pool allocation has failed due to fragmentation of the pool’s memory. This must only be returned if no attempt to allocate host or device memory was made to accommodate the new allocation. This should be returned in preference to VK_ERROR_OUT_OF_POOL_MEMORY, but only if the implementation is certain that the pool allocation failure was due to fragmentation." },
-        { _VTK_VK_RESULT_NAME(VK_ERROR_SURFACE_LOST_KHR), "VULKAN SPEC ERROR MESSAGE: A surface is no longer available." },
-        { _VTK_VK_RESULT_NAME(VK_ERROR_NATIVE_WINDOW_IN_USE_KHR), "VULKAN SPEC ERROR MESSAGE: The requested window is already in use by Vulkan or another API in a manner which prevents it from being used again." },
-        { _VTK_VK_RESULT_NAME(VK_ERROR_OUT_OF_DATE_KHR), "VULKAN SPEC ERROR MESSAGE: A surface has changed in such a way that it is no longer compatible with the swapchain, and further presentation requests using the swapchain will fail. Applications must query the new surface properties and recreate their swapchain if they wish to continue presenting to the surface." },
-        { _VTK_VK_RESULT_NAME(VK_ERROR_INCOMPATIBLE_DISPLAY_KHR), "VULKAN SPEC ERROR MESSAGE: The display used by a swapchain does not use the same presentable image layout, or is incompatible in a way that prevents sharing an image." },
-        { _VTK_VK_RESULT_NAME(VK_ERROR_INVALID_SHADER_NV), "VULKAN SPEC ERROR MESSAGE: One or more shaders failed to compile or link. More details are reported back to the application via https://www.khronos.org/registry/vulkan/specs/1.2-extensions/html/vkspec.html#VK_EXT_debug_report if enabled." },
-        { _VTK_VK_RESULT_NAME(VK_ERROR_OUT_OF_POOL_MEMORY), "VULKAN SPEC ERROR MESSAGE: A pool memory allocation has failed. This must only be returned if no attempt to allocate host or device memory was made to accommodate the new allocation. If the failure was definitely due to fragmentation of the pool, VK_ERROR_FRAGMENTED_POOL should be returned instead." },
-        { _VTK_VK_RESULT_NAME(VK_ERROR_INVALID_EXTERNAL_HANDLE), "VULKAN SPEC ERROR MESSAGE: An external handle is not a valid handle of the specified type." },
-        // { _VTK_VK_RESULT_NAME(VK_ERROR_FRAGMENTATION), "VULKAN SPEC ERROR MESSAGE: A descriptor pool creation has failed due to fragmentation." },
-        { _VTK_VK_RESULT_NAME(VK_ERROR_INVALID_DEVICE_ADDRESS_EXT), "VULKAN SPEC ERROR MESSAGE: A buffer creation failed because the requested address is not available." },
-        // { _VTK_VK_RESULT_NAME(VK_ERROR_INVALID_OPAQUE_CAPTURE_ADDRESS), "VULKAN SPEC ERROR MESSAGE: A buffer creation or memory allocation failed because the requested address is not available." },
-        { _VTK_VK_RESULT_NAME(VK_ERROR_FULL_SCREEN_EXCLUSIVE_MODE_LOST_EXT), "VULKAN SPEC ERROR MESSAGE: An operation on a swapchain created with VK_FULL_SCREEN_EXCLUSIVE_APPLICATION_CONTROLLED_EXT failed as it did not have exlusive full-screen access. This may occur due to implementation-dependent reasons, outside of the application’s control." },
-        // { _VTK_VK_RESULT_NAME(VK_ERROR_UNKNOWN), "VULKAN SPEC ERROR MESSAGE: An unknown error has occurred; either the application has provided invalid input, or an implementation failure has occurred." },
-    };
+static constexpr _VTK_VkResultInfo _vtk_vk_result_info(VkResult result) {
+    switch (result) {
+        _VTK_VK_RESULT_CASE(VK_SUCCESS, "VULKAN SPEC ERROR MESSAGE: Command successfully completed.")
+        _VTK_VK_RESULT_CASE(VK_NOT_READY, "VULKAN SPEC ERROR MESSAGE: A fence or query has not yet completed.")
+        _VTK_VK_RESULT_CASE(VK_TIMEOUT, "VULKAN SPEC ERROR MESSAGE: A wait operation has not completed in the specified time.")
+        _VTK_VK_RESULT_CASE(VK_EVENT_SET, "VULKAN SPEC ERROR MESSAGE: An event is signaled.")
+        _VTK_VK_RESULT_CASE(VK_EVENT_RESET, "VULKAN SPEC ERROR MESSAGE: An event is unsignaled.")
+        _VTK_VK_RESULT_CASE(VK_INCOMPLETE, "VULKAN SPEC ERROR MESSAGE: A return array was too small for the result.")
+        _VTK_VK_RESULT_CASE(VK_SUBOPTIMAL_KHR, "VULKAN SPEC ERROR MESSAGE: A swapchain no longer matches the surface properties exactly, but can still be used to present to the surface successfully.")
+        _VTK_VK_RESULT_CASE(VK_ERROR_OUT_OF_HOST_MEMORY, "VULKAN SPEC ERROR MESSAGE: A host memory allocation has failed.")
+        _VTK_VK_RESULT_CASE(VK_ERROR_OUT_OF_DEVICE_MEMORY, "VULKAN SPEC ERROR MESSAGE: A device memory allocation has failed.")
+        _VTK_VK_RESULT_CASE(VK_ERROR_INITIALIZATION_FAILED, "VULKAN SPEC ERROR MESSAGE: Initialization of an object could not be completed for implementation-specific reasons.")
+        _VTK_VK_RESULT_CASE(VK_ERROR_DEVICE_LOST, "VULKAN SPEC ERROR MESSAGE: The logical or physical device has been lost.")
+        _VTK_VK_RESULT_CASE(VK_ERROR_MEMORY_MAP_FAILED, "VULKAN SPEC ERROR MESSAGE: Mapping of a memory object has failed.")
+        _VTK_VK_RESULT_CASE(VK_ERROR_LAYER_NOT_PRESENT, "VULKAN SPEC ERROR MESSAGE: A requested layer is not present or could not be loaded.")
+        _VTK_VK_RESULT_CASE(VK_ERROR_EXTENSION_NOT_PRESENT, "VULKAN SPEC ERROR MESSAGE: A requested extension is not supported.")
+        _VTK_VK_RESULT_CASE(VK_ERROR_FEATURE_NOT_PRESENT, "VULKAN SPEC ERROR MESSAGE: A requested feature is not supported.")
+        _VTK_VK_RESULT_CASE(VK_ERROR_INCOMPATIBLE_DRIVER, "VULKAN SPEC ERROR MESSAGE: The requested version of Vulkan is not supported by the driver or is otherwise incompatible for implementation-specific reasons.")
+        _VTK_VK_RESULT_CASE(VK_ERROR_TOO_MANY_OBJECTS, "VULKAN SPEC ERROR MESSAGE: Too many objects of the type have already been created.")
+        _VTK_VK_RESULT_CASE(VK_ERROR_FORMAT_NOT_SUPPORTED, "VULKAN SPEC ERROR MESSAGE: A requested format is not supported on this device.")
+        _VTK_VK_RESULT_CASE(VK_ERROR_FRAGMENTED_POOL, "VULKAN SPEC ERROR MESSAGE: A pool allocation has failed due to fragmentation of the pool’s memory. This must only be returned if no attempt to allocate host or device memory was made to accommodate the new allocation. This should be returned in preference to VK_ERROR_OUT_OF_POOL_MEMORY, but only if the implementation is certain that the pool allocation failure was due to fragmentation.")
+        _VTK_VK_RESULT_CASE(VK_ERROR_SURFACE_LOST_KHR, "VULKAN SPEC ERROR MESSAGE: A surface is no longer available.")
+        _VTK_VK_RESULT_CASE(VK_ERROR_NATIVE_WINDOW_IN_USE_KHR, "VULKAN SPEC ERROR MESSAGE: The requested window is already in use by Vulkan or another API in a manner which prevents it from being used again.")
+        _VTK_VK_RESULT_CASE(VK_ERROR_OUT_OF_DATE_KHR, "VULKAN SPEC ERROR MESSAGE: A surface has changed in such a way that it is no longer compatible with the swapchain, and further presentation requests using the swapchain will fail. Applications must query the new surface properties and recreate their swapchain if they wish to continue presenting to the surface.")
+        _VTK_VK_RESULT_CASE(VK_ERROR_INCOMPATIBLE_DISPLAY_KHR, "VULKAN SPEC ERROR MESSAGE: The display used by a swapchain does not use the same presentable image layout, or is incompatible in a way that prevents sharing an image.")
+        _VTK_VK_RESULT_CASE(VK_ERROR_INVALID_SHADER_NV, "VULKAN SPEC ERROR MESSAGE: One or more shaders failed to compile or link. More details are reported back to the application via https://www.khronos.org/registry/vulkan/specs/1.2-extensions/html/vkspec.html#VK_EXT_debug_report if enabled.")
+        _VTK_VK_RESULT_CASE(VK_ERROR_OUT_OF_POOL_MEMORY, "VULKAN SPEC ERROR MESSAGE: A pool memory allocation has failed. This must only be returned if no attempt to allocate host or device memory was made to accommodate the new allocation. If the failure was definitely due to fragmentation of the pool, VK_ERROR_FRAGMENTED_POOL should be returned instead.")
+        _VTK_VK_RESULT_CASE(VK_ERROR_INVALID_EXTERNAL_HANDLE, "VULKAN SPEC ERROR MESSAGE: An external handle is not a valid handle of the specified type.")
+        // _VTK_VK_RESULT_CASE(VK_ERROR_FRAGMENTATION, "VULKAN SPEC ERROR MESSAGE: A descriptor pool creation has failed due to fragmentation.")
+        _VTK_VK_RESULT_CASE(VK_ERROR_INVALID_DEVICE_ADDRESS_EXT, "VULKAN SPEC ERROR MESSAGE: A buffer creation failed because the requested address is not available.")
+        // _VTK_VK_RESULT_CASE(VK_ERROR_INVALID_OPAQUE_CAPTURE_ADDRESS, "VULKAN SPEC ERROR MESSAGE: A buffer creation or memory allocation failed because the requested address is not available.")
+        _VTK_VK_RESULT_CASE(VK_ERROR_FULL_SCREEN_EXCLUSIVE_MODE_LOST_EXT, "VULKAN SPEC ERROR MESSAGE: An operation on a swapchain created with VK_FULL_SCREEN_EXCLUSIVE_APPLICATION_CONTROLLED_EXT failed as it did not have exlusive full-screen access. This may occur due to implementation-dependent reasons, outside of the application’s control.")
+        // _VTK_VK_RESULT_CASE(VK_ERROR_UNKNOWN, "VULKAN SPEC ERROR MESSAGE: An unknown error has occurred; either the application has provided invalid input, or an implementation failure has occurred.")
+        default: return { result, "UNKNOWN VkResult", "no debug info for this VkResult" };
+    }
+}
+
+_VTK_COLD static void _vtk_print_result(VkResult result) {
+    _VTK_VkResultInfo info = _vtk_vk_result_info(result);
+    if (info.result == 0)
+        ctk_info("vulkan function returned %s (%d): %s", info.name, result, info.message);
+    else if (info.result > 0)
+        ctk_warning("vulkan function returned %s (%d): %s", info.name, result, info.message);
+    else
+        ctk_error("vulkan function returned %s (%d): %s", info.name, result, info.message);
+}
+
+// Non-error success codes (VK_SUBOPTIMAL_KHR, VK_TIMEOUT, VK_INCOMPLETE, ...) pass; callers that care about them check
+// the result themselves. Call through vtk_validate_result() so results reach telemetry.
+template<typename ...Args>
+static void _vtk_validate_result(VkResult result, cstr fail_message, Args... args) {
+    if (_VTK_LIKELY(result >= VK_SUCCESS))
+        return;
+
+    _vtk_print_result(result);
+    CTK_FATAL(fail_message, args...)
+}
+
+#ifdef VTK_RESULT_TELEMETRY
+static u32 const _VTK_RESULT_TELEMETRY_MAX_SITES = 256;
+static u32 const _VTK_RESULT_TELEMETRY_MAX_SITE_RESULTS = 4;
+
+struct _VTK_ResultTelemetrySite {
+    cstr file;
+    u32 line;
+    VkResult results[_VTK_RESULT_TELEMETRY_MAX_SITE_RESULTS];
+    u64 counts[_VTK_RESULT_TELEMETRY_MAX_SITE_RESULTS];
+    u64 reported_counts[_VTK_RESULT_TELEMETRY_MAX_SITE_RESULTS];
+    u32 result_count;
+};
 
-    _VTK_VkResultInfo *info = NULL;
-    for (u32 i = 0; i < CTK_ARRAY_SIZE(VK_RESULT_DEBUG_INFOS); ++i) {
-        info = VK_RESULT_DEBUG_INFOS + i;
+struct _VTK_ResultTelemetry {
+    std::mutex mutex;
+    _VTK_ResultTelemetrySite sites[_VTK_RESULT_TELEMETRY_MAX_SITES];
+    u64 last_report_ns;
+};
+
+static _VTK_ResultTelemetry _vtk_result_telemetry;
+
+// Only non-success results reach here, so the lock and table lookup stay off the common path.
+_VTK_COLD static void _vtk_count_result(VkResult result, cstr file, u32 line) {
+    std::lock_guard<std::mutex> lock(_vtk_result_telemetry.mutex);
+    u32 hash = (u32)(((uintptr_t)file >> 4) * 31 + line);
+    for (u32 probe = 0; probe < _VTK_RESULT_TELEMETRY_MAX_SITES; ++probe) {
+        _VTK_ResultTelemetrySite *site =
+            _vtk_result_telemetry.sites + ((hash + probe) % _VTK_RESULT_TELEMETRY_MAX_SITES);
+        if (site->file == NULL) {
+            site->file = file;
+            site->line = line;
+        }
+        else if (site->file != file || site->line != line) {
+            continue;
+        }
 
-        if (info->result == result)
-            break;
+        for (u32 i = 0; i < site->result_count; ++i) {
+            if (site->results[i] == result) {
+                ++site->counts[i];
+                return;
+            }
+        }
+
+        if (site->result_count < _VTK_RESULT_TELEMETRY_MAX_SITE_RESULTS) {
+            site->results[site->result_count] = result;
+            site->counts[site->result_count] = 1;
+            ++site->result_count;
+        }
+
+        return;
     }
+}
 
-    if (!info)
-        CTK_FATAL("failed to find debug info for VkResult %d", result)
+static VkResult _vtk_record_result(VkResult result, cstr file, u32 line) {
+    if (!_VTK_LIKELY(result == VK_SUCCESS))
+        _vtk_count_result(result, file, line);
 
-    if (info->result == 0)
-        ctk_info("vulkan function returned %s: %s", info->name, info->message);
-    else if (info->result > 0)
-        ctk_warning("vulkan function returned %s: %s", info->name, info->message);
-    else
-        ctk_error("vulkan function returned %s: %s", info->name, info->message);
+    return result;
 }
 
-template<typename ...Args>
-static void vtk_validate_result(VkResult result, cstr fail_message, Args... args) {
-    if (result != VK_SUCCESS) {
-        _vtk_print_result(result);
-        CTK_FATAL(fail_message, args...)
+// Call once per frame; logs per call site counts of non-success results since the last report, at most once every
+// interval_ns.
+static void vtk_report_result_telemetry(u64 interval_ns) {
+    u64 now = _vtk_now_ns();
+    std::lock_guard<std::mutex> lock(_vtk_result_telemetry.mutex);
+    if (now - _vtk_result_telemetry.last_report_ns < interval_ns)
+        return;
+
+    _vtk_result_telemetry.last_report_ns = now;
+    for (u32 site_index = 0; site_index < _VTK_RESULT_TELEMETRY_MAX_SITES; ++site_index) {
+        _VTK_ResultTelemetrySite *site = _vtk_result_telemetry.sites + site_index;
+        for (u32 i = 0; i < site->result_count; ++i) {
+            u64 new_count = site->counts[i] - site->reported_counts[i];
+            if (new_count == 0)
+                continue;
+
+            ctk_warning("%s:%u returned %s %llu times (%llu total)", site->file, site->line,
+                        _vtk_vk_result_info(site->results[i]).name, (unsigned long long)new_count,
+                        (unsigned long long)site->counts[i]);
+            site->reported_counts[i] = site->counts[i];
+        }
     }
 }
 
+#define VTK_RECORD_RESULT(RESULT) _vtk_record_result((RESULT), __FILE__, __LINE__)
+#else
+#define VTK_RECORD_RESULT(RESULT) (RESULT)
+static void vtk_report_result_telemetry(u64) {}
+#endif
+
+// Aborts with fail_message (a format, followed by its args) if RESULT is an error code.
+#define vtk_validate_result(RESULT, ...) _vtk_validate_result(VTK_RECORD_RESULT(RESULT), __VA_ARGS__)
+
 static VKAPI_ATTR VkBool32 VKAPI_CALL
 vtk_debug_callback(VkDebugUtilsMessageSeverityFlagBitsEXT message_severity_flag_bit,
                    VkDebugUtilsMessageTypeFlagsEXT message_type_flags,
@@ -103,6 +206,48 @@ vtk_debug_callback(VkDebugUtilsMessageSeverityFlagBitsEXT message_severity_flag_
     return VK_FALSE;
 }
 
+////////////////////////////////////////////////////////////
+/// Enumeration
+////////////////////////////////////////////////////////////
+
+// Enumeration loaders either return VkResult (and can report VK_INCOMPLETE) or return nothing (and silently truncate).
+template<typename Object, typename ...Params, typename ...Args>
+static VkResult _vtk_enumerate_call(VkResult (VKAPI_PTR *loader)(Params...), u32 *count, Object *objects,
+                                    Args... args) {
+    return loader(args..., count, objects);
+}
+
+template<typename Object, typename ...Params, typename ...Args>
+static VkResult _vtk_enumerate_call(void (VKAPI_PTR *loader)(Params...), u32 *count, Object *objects, Args... args) {
+    loader(args..., count, objects);
+    return VK_SUCCESS;
+}
+
+template<typename ...Params>
+static bool _vtk_enumerator_reports_incomplete(VkResult (VKAPI_PTR *)(Params...)) {
+    return true;
+}
+
+template<typename ...Params>
+static bool _vtk_enumerator_reports_incomplete(void (VKAPI_PTR *)(Params...)) {
+    return false;
+}
+
+////////////////////////////////////////////////////////////
+/// Allocation Callbacks
+////////////////////////////////////////////////////////////
+static VkAllocationCallbacks const *_vtk_allocation_callbacks = NULL;
+
+// Host allocation callbacks passed to every vkCreate*/vkDestroy*/vkAllocate*/vkFree* call vtk makes; NULL (the default)
+// uses the driver's allocator. See allocation_callbacks.h.
+static void vtk_set_allocation_callbacks(VkAllocationCallbacks const *allocation_callbacks) {
+    _vtk_allocation_callbacks = allocation_callbacks;
+}
+
+static VkAllocationCallbacks const *vtk_allocation_callbacks() {
+    return _vtk_allocation_callbacks;
+}
+
 ////////////////////////////////////////////////////////////
 /// Interface
 ////////////////////////////////////////////////////////////
@@ -116,6 +261,54 @@ static CTK_Array<Object> *vtk_load_vk_objects(CTK_Allocator *allocator, Loader l
     return vk_objects;
 }
 
+// Loads objects into buffer when they fit (a single loader call), otherwise into memory from scratch, retrying while the
+// loader reports VK_INCOMPLETE (the set grew between the count and fill calls). Returns buffer or the scratch memory;
+// scratch may be NULL if capacity is known to be enough. Intended for temporary results with a stack buffer or a scratch
+// arena the caller resets, so enumeration never touches the global heap.
+template<typename Object, typename Loader, typename ...Args>
+static Object *vtk_enumerate_vk_objects(Object *buffer, u32 capacity, CTK_Allocator *scratch, u32 *count,
+                                        Loader loader, Args... args) {
+    if (capacity > 0) {
+        *count = capacity;
+        VkResult result = _vtk_enumerate_call(loader, count, buffer, args...);
+        if (result == VK_SUCCESS && (_vtk_enumerator_reports_incomplete(loader) || *count < capacity))
+            return buffer;
+
+        if (result != VK_INCOMPLETE)
+            vtk_validate_result(result, "failed to enumerate vulkan objects");
+    }
+
+    for (;;) {
+        u32 available = 0;
+        vtk_validate_result(_vtk_enumerate_call(loader, &available, (Object *)NULL, args...),
+                            "failed to get vulkan object count");
+
+        Object *objects = buffer;
+        if (available > capacity) {
+            if (scratch == NULL)
+                CTK_FATAL("%u vulkan objects don't fit in enumeration buffer of %u and no scratch allocator given",
+                          available, capacity)
+
+            objects = ctk_alloc<Object>(scratch, available);
+        }
+
+        *count = available;
+        VkResult result = _vtk_enumerate_call(loader, count, objects, args...);
+        if (result != VK_INCOMPLETE) {
+            vtk_validate_result(result, "failed to enumerate vulkan objects");
+            return objects;
+        }
+    }
+}
+
+template<typename Object, u32 Capacity, typename Loader, typename ...Args>
+static Object *vtk_enumerate_vk_objects(CTK_StaticArray<Object, Capacity> *buffer, CTK_Allocator *scratch, u32 *count,
+                                        Loader loader, Args... args) {
+    Object *objects = vtk_enumerate_vk_objects(buffer->data, Capacity, scratch, count, loader, args...);
+    buffer->count = objects == buffer->data ? *count : 0;
+    return objects;
+}
+
 static VkFormat vtk_find_depth_image_format(VkPhysicalDevice physical_device) {
     static VkFormat const DEPTH_IMAGE_FORMATS[] = {
         VK_FORMAT_D32_SFLOAT_S8_UINT,
@@ -199,11 +392,14 @@ static void vtk_begin_temp_commands(VkCommandBuffer command_buffer) {
 }
 
 static void vtk_submit_temp_commands(VkCommandBuffer command_buffer, VkQueue queue) {
+    VTK_CPU_ZONE("vtk_submit_temp_commands");
     vkEndCommandBuffer(command_buffer);
     VkSubmitInfo submit_info = {};
     submit_info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
     submit_info.commandBufferCount = 1;
     submit_info.pCommandBuffers = &command_buffer;
     vtk_validate_result(vkQueueSubmit(queue, 1, &submit_info, VK_NULL_HANDLE), "failed to submit temp command buffer");
+
+    VTK_CPU_ZONE("vtk_submit_temp_commands wait");
     vkQueueWaitIdle(queue);
 }